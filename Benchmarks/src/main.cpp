@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "Resha.h"
+
+// Timings of the geometry kernels on a UV sphere, the best of a few runs. the "in caller" kernels
+// are written with the vector operators here, they show whether those inline into another
+// translation unit.
+namespace
+{
+    constexpr int RUNS_COUNT = 5;
+
+    double Now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 2 * segments * (rings - 1) faces.
+    SurfaceMesh CreateSphere(uint32_t segments, uint32_t rings)
+    {
+        SurfaceMesh mesh;
+        mesh.vertices.push_back(Vec3d{ 0.0, 0.0, 1.0 });
+        for (uint32_t i = 1; i < rings; ++i)
+        {
+            const double theta = PI * i / rings;
+            for (uint32_t j = 0; j < segments; ++j)
+            {
+                const double phi = 2.0 * PI * j / segments;
+                mesh.vertices.push_back(Vec3d{ sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta) });
+            }
+        }
+        mesh.vertices.push_back(Vec3d{ 0.0, 0.0, -1.0 });
+        const uint32_t last = uint32_t(mesh.vertices.size() - 1);
+        auto vertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+        for (uint32_t j = 0; j < segments; ++j)
+        {
+            mesh.faces.push_back(Triangle{ { 0, vertex(1, j), vertex(1, j + 1) } });
+        }
+        for (uint32_t i = 1; i + 1 < rings; ++i)
+        {
+            for (uint32_t j = 0; j < segments; ++j)
+            {
+                mesh.faces.push_back(Triangle{ { vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) } });
+                mesh.faces.push_back(Triangle{ { vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) } });
+            }
+        }
+        for (uint32_t j = 0; j < segments; ++j)
+        {
+            mesh.faces.push_back(Triangle{ { vertex(rings - 1, j), last, vertex(rings - 1, j + 1) } });
+        }
+        return mesh;
+    }
+
+    // best time of func in milliseconds, sink keeps the results alive.
+    template <typename F>
+    double Measure(F func, double& sink)
+    {
+        double best = DBL_MAX;
+        for (int r = 0; r < RUNS_COUNT; ++r)
+        {
+            const double start = Now();
+            sink += func();
+            best = std::min(best, Now() - start);
+        }
+        return best * 1000.0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // 1500 x 1000 gives about 3M faces.
+    const uint32_t segments = argc > 1 ? uint32_t(atoi(argv[1])) : 1500;
+    const uint32_t rings = argc > 2 ? uint32_t(atoi(argv[2])) : 1000;
+    if (segments < 3 || rings < 2)
+    {
+        printf("usage: Benchmarks [segments >= 3] [rings >= 2]\n");
+        return EXIT_FAILURE;
+    }
+    const SurfaceMesh mesh = CreateSphere(segments, rings);
+    const VertexRings vertexRings = BuildVertexRings(mesh);
+    printf("%zu vertices, %zu faces, %zu threads, best of %d\n", mesh.vertices.size(), mesh.faces.size(),
+           GetThreadsCount(), RUNS_COUNT);
+
+    double sink = 0.0;
+    const double vertexNormals = Measure([&]() { return CalculateVertexNormals(mesh, vertexRings)[0].x; }, sink);
+    const double facesNormals = Measure([&]() { return CalculateFacesNormals(mesh)[0].x; }, sink);
+    const double boundingBox = Measure([&]() { return CalculateBoundingBox(mesh).max.x; }, sink);
+    const double callerNormals = Measure([&]()
+    {
+        std::vector<Vec3d> normals(mesh.faces.size());
+        for (size_t i = 0; i < mesh.faces.size(); ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            const Vec3d& a = mesh.vertices[t.idx[0]];
+            normals[i] = Normalised(CrossProduct(mesh.vertices[t.idx[1]] - a, mesh.vertices[t.idx[2]] - a));
+        }
+        return normals[0].x;
+    }, sink);
+    const double callerBox = Measure([&]()
+    {
+        BBox box;
+        Vec3d centroid{ 0.0, 0.0, 0.0 };
+        const double weight = 1.0 / mesh.vertices.size();
+        for (const Vec3d& v : mesh.vertices)
+        {
+            box.min = Vec3d{ std::min(box.min.x, v.x), std::min(box.min.y, v.y), std::min(box.min.z, v.z) };
+            box.max = Vec3d{ std::max(box.max.x, v.x), std::max(box.max.y, v.y), std::max(box.max.z, v.z) };
+            centroid = centroid + v * weight;
+        }
+        return box.max.x + centroid.x;
+    }, sink);
+
+    printf("vertex normals (rings)     %8.1f ms\n", vertexNormals);
+    printf("CalculateFacesNormals      %8.1f ms\n", facesNormals);
+    printf("CalculateBoundingBox       %8.1f ms\n", boundingBox);
+    printf("per-face normals in caller %8.1f ms\n", callerNormals);
+    printf("bbox + centroid in caller  %8.1f ms\n", callerBox);
+    printf("(%g)\n", sink);
+    return EXIT_SUCCESS;
+}
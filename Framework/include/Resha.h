@@ -1,5 +1,11 @@
 #pragma once
 
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
 #include <set>
 #include <string>
 #include <string_view>
@@ -36,125 +42,307 @@ template <typename F> privDefer<F> defer_func(F f)
 //------------------Math----------------------------//
 const double PI = 3.14159265358979323846264338327950288;
 
-union Vec2d
+// Vectors and matrices of N components of type T, defined here so the loops inline them and
+// constexpr where the standard allows. the Mat4 and Mat4f products run SIMD kernels instead.
+// x, y, z and w name the components and data aliases them. the matrices are column major,
+// elements[column][row].
+template <typename T, size_t N>
+union Vec;
+
+template <typename T>
+union Vec<T, 2>
 {
     struct
     {
-        double x, y;
+        T x, y;
     };
-    double data[2];
+    T data[2];
 };
 
-union Vec3d
+template <typename T>
+union Vec<T, 3>
 {
     struct
     {
-        double x, y, z;
+        T x, y, z;
     };
-    double data[3];
+    T data[3];
 };
 
-union Vec2f
+template <typename T>
+union Vec<T, 4>
 {
     struct
     {
-        float x, y;
+        T x, y, z, w;
     };
-    float data[2];
+    T data[4];
 };
 
-union Vec3f
+template <typename T, size_t N>
+union Mat
 {
-    struct
-    {
-        float x, y, z;
-    };
-    float data[3];
+    T elements[N][N];
+    T data[N * N];
 };
 
-// the matrices are column major.
-union Mat3
+using Vec2d = Vec<double, 2>;
+using Vec3d = Vec<double, 3>;
+using Vec2f = Vec<float, 2>;
+using Vec3f = Vec<float, 3>;
+using Vec4d = Vec<double, 4>;
+using Vec4f = Vec<float, 4>;
+using Mat3 = Mat<double, 3>;
+using Mat4 = Mat<double, 4>;
+using Mat4f = Mat<float, 4>;
+
+struct BBox
 {
-    double elements[3][3];
-    double data[9];
+    Vec3d min{ DBL_MAX, DBL_MAX, DBL_MAX };
+    Vec3d max{ -DBL_MAX, -DBL_MAX, -DBL_MAX };
 };
 
-union Mat4
+// the scalars aren't deduced, so v * 2 or a Vec3f times a double convert them to T.
+template <typename T>
+struct privNonDeduced
 {
-    double elements[4][4];
-    double data[16];
+    using Type = T;
 };
 
-struct BBox
+// applies f to the components of a and b.
+template <typename T, size_t N, typename F>
+constexpr Vec<T, N> privZip(const Vec<T, N>& a, const Vec<T, N>& b, F f)
 {
-    Vec3d min{ DBL_MAX, DBL_MAX, DBL_MAX };
-    Vec3d max{ -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    if constexpr (N == 2)
+    {
+        return Vec<T, N>{ f(a.x, b.x), f(a.y, b.y) };
+    }
+    else if constexpr (N == 3)
+    {
+        return Vec<T, N>{ f(a.x, b.x), f(a.y, b.y), f(a.z, b.z) };
+    }
+    else
+    {
+        return Vec<T, N>{ f(a.x, b.x), f(a.y, b.y), f(a.z, b.z), f(a.w, b.w) };
+    }
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Vec<T, N> operator+(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    return privZip(a, b, [](T u, T v) { return u + v; });
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Vec<T, N> operator-(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    return privZip(a, b, [](T u, T v) { return u - v; });
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Vec<T, N> operator*(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    return privZip(a, b, [](T u, T v) { return u * v; });
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Vec<T, N> operator*(const Vec<T, N>& a, typename privNonDeduced<T>::Type x)
+{
+    return privZip(a, a, [x](T u, T) { return u * x; });
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Vec<T, N> operator*(typename privNonDeduced<T>::Type x, const Vec<T, N>& a)
+{
+    return a * x;
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr bool operator==(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    if constexpr (N == 2)
+    {
+        return a.x == b.x && a.y == b.y;
+    }
+    else if constexpr (N == 3)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+    else
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+    }
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr bool operator!=(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    return !(a == b);
+}
+
+template <typename T>
+[[nodiscard]] constexpr Vec<T, 3> CrossProduct(const Vec<T, 3>& a, const Vec<T, 3>& b)
+{
+    return Vec<T, 3>{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// summed in T.
+template <typename T, size_t N>
+[[nodiscard]] constexpr double DotProduct(const Vec<T, N>& a, const Vec<T, N>& b)
+{
+    if constexpr (N == 2)
+    {
+        return a.x * b.x + a.y * b.y;
+    }
+    else if constexpr (N == 3)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+    else
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+}
+
+[[nodiscard]] constexpr double DotProduct(const double a[4], const double b[4])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+template <typename T, size_t N>
+[[nodiscard]] inline double Length(const Vec<T, N>& v)
+{
+    if constexpr (N == 2)
+    {
+        return sqrt(v.x * v.x + v.y * v.y);
+    }
+    else if constexpr (N == 3)
+    {
+        return sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    }
+    else
+    {
+        return sqrt(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+    }
+}
+
+template <typename T, size_t N>
+inline void Normalise(Vec<T, N>& v)
+{
+    const double length = Length(v);
+    v.x /= length;
+    v.y /= length;
+    if constexpr (N >= 3)
+    {
+        v.z /= length;
+    }
+    if constexpr (N == 4)
+    {
+        v.w /= length;
+    }
+}
+
+template <typename T, size_t N>
+[[nodiscard]] inline Vec<T, N> Normalised(const Vec<T, N>& v)
+{
+    Vec<T, N> result = v;
+    Normalise(result);
+    return result;
+}
+
+// the components of the result are the dot products of the columns of a with v.
+template <typename T>
+[[nodiscard]] constexpr Vec<T, 3> operator*(const Mat<T, 3>& a, const Vec<T, 3>& v)
+{
+    const auto& e = a.elements;
+    return Vec<T, 3>{ e[0][0] * v.x + e[0][1] * v.y + e[0][2] * v.z, e[1][0] * v.x + e[1][1] * v.y + e[1][2] * v.z,
+                      e[2][0] * v.x + e[2][1] * v.y + e[2][2] * v.z };
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Mat<T, N> operator*(const Mat<T, N>& left, const Mat<T, N>& right)
+{
+    Mat<T, N> result{};
+    for (size_t c = 0; c < N; ++c)
+    {
+        for (size_t r = 0; r < N; ++r)
+        {
+            T sum = 0;
+            for (size_t k = 0; k < N; ++k)
+            {
+                sum += left.elements[k][r] * right.elements[c][k];
+            }
+            result.elements[c][r] = sum;
+        }
+    }
+    return result;
+}
+
+// the sum of the columns of m weighted by v, in the order of the columns like the Mat4 kernels. a
+// single vector is cheaper inline than through the dispatch.
+template <typename T>
+[[nodiscard]] constexpr Vec<T, 4> operator*(const Mat<T, 4>& m, const Vec<T, 4>& v)
+{
+    const auto& e = m.elements;
+    return Vec<T, 4>{ e[0][0] * v.x + e[1][0] * v.y + e[2][0] * v.z + e[3][0] * v.w,
+                      e[0][1] * v.x + e[1][1] * v.y + e[2][1] * v.z + e[3][1] * v.w,
+                      e[0][2] * v.x + e[1][2] * v.y + e[2][2] * v.z + e[3][2] * v.w,
+                      e[0][3] * v.x + e[1][3] * v.y + e[2][3] * v.z + e[3][3] * v.w };
+}
+
+// the instruction sets the Mat4 products and the batch transforms are run with, the best one the CPU
+// supports is picked at the first call.
+enum class SimdLevel
+{
+    SCALAR, SSE2, AVX
 };
 
-Vec2f operator+(const Vec2f& a, const Vec2f& b);
-Vec2f operator-(const Vec2f& a, const Vec2f& b);
-Vec2f operator*(const Vec2f& a, const Vec2f& b);
-Vec2f operator*(const Vec2f& a, float x);
-Vec2f operator*(float x, const Vec2f& a);
-bool operator==(const Vec2f& a, const Vec2f& b);
-bool operator!=(const Vec2f& a, const Vec2f& b);
-
-Vec3f operator+(const Vec3f& a, const Vec3f& b);
-Vec3f operator-(const Vec3f& a, const Vec3f& b);
-Vec3f operator*(const Vec3f& a, const Vec3f& b);
-Vec3f operator*(const Vec3f& a, float x);
-Vec3f operator*(float x, const Vec3f& a);
-bool operator==(const Vec3f& a, const Vec3f& b);
-bool operator!=(const Vec3f& a, const Vec3f& b);
-
-Vec2d operator+(const Vec2d& a, const Vec2d& b);
-Vec2d operator-(const Vec2d& a, const Vec2d& b);
-Vec2d operator*(const Vec2d& a, const Vec2d& b);
-Vec2d operator*(const Vec2d& a, double x);
-Vec2d operator*(double x, const Vec2d& a);
-bool operator==(const Vec2d& a, const Vec2d& b);
-bool operator!=(const Vec2d& a, const Vec2d& b);
-
-Vec3d operator+(const Vec3d& a, const Vec3d& b);
-Vec3d operator-(const Vec3d& a, const Vec3d& b);
-Vec3d operator*(const Vec3d& a, const Vec3d& b);
-Vec3d operator*(const Vec3d& a, double x);
-Vec3d operator*(double x, const Vec3d& a);
-bool operator==(const Vec3d& a, const Vec3d& b);
-bool operator!=(const Vec3d& a, const Vec3d& b);
-
-Vec3d operator*(const Mat3& a, const Vec3d& v);
-
-Mat4 operator*(const Mat4& left, const Mat4& right);
-Mat4 operator*(const Mat4& left, double x);
-
-Vec3d CrossProduct(const Vec3d& a, const Vec3d& b);
-Vec3f CrossProduct(const Vec3f& a, const Vec3f& b);
-
-double DotProduct(const Vec3f& a, const Vec3f& b);
-double DotProduct(const Vec2f& a, const Vec2f& b);
-double DotProduct(const Vec3d& a, const Vec3d& b);
-double DotProduct(const Vec2d& a, const Vec2d& b);
-double DotProduct(const double a[4], const double b[4]);
-
-double Length(const Vec3f& v);
-double Length(const Vec2f& v);
-double Length(const Vec3d& v);
-double Length(const Vec2d& v);
-
-void Normalise(Vec3f& v);
-void Normalise(Vec2f& v);
-void Normalise(Vec3d& v);
-void Normalise(Vec2d& v);
-
-Vec3f Normalised(const Vec3f& v);
-Vec2f Normalised(const Vec2f& v);
-Vec3d Normalised(const Vec3d& v);
-Vec2d Normalised(const Vec2d& v);
-
-Mat3 Transpose(Mat3 m);
-Mat4 Transpose(Mat4 m);
-Mat4 Identity();
+SimdLevel GetSimdLevel();
+// clamped to what the CPU supports, to compare the kernels. all of them give the same results.
+void SetSimdLevel(SimdLevel level);
+
+// better matches than the Mat template above.
+[[nodiscard]] Mat4 operator*(const Mat4& left, const Mat4& right);
+[[nodiscard]] Mat4f operator*(const Mat4f& left, const Mat4f& right);
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Mat<T, N> operator*(const Mat<T, N>& left, typename privNonDeduced<T>::Type x)
+{
+    Mat<T, N> result{};
+    for (size_t c = 0; c < N; ++c)
+    {
+        for (size_t r = 0; r < N; ++r)
+        {
+            result.elements[c][r] = left.elements[c][r] * x;
+        }
+    }
+    return result;
+}
+
+template <typename T, size_t N>
+[[nodiscard]] constexpr Mat<T, N> Transpose(const Mat<T, N>& m)
+{
+    Mat<T, N> result{};
+    for (size_t c = 0; c < N; ++c)
+    {
+        for (size_t r = 0; r < N; ++r)
+        {
+            result.elements[c][r] = m.elements[r][c];
+        }
+    }
+    return result;
+}
+
+[[nodiscard]] constexpr Mat4 Identity()
+{
+    Mat4 m{};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        m.elements[i][i] = 1.0;
+    }
+    return m;
+}
+
 Mat4 Translate(Mat4 m, const Vec3d& translation);
 Mat4 Rotate(const Mat4& m, double angle, const Vec3d& v);
 Mat4 Perspective(double fovy, double aspect, double zNear, double zFar);
@@ -219,6 +407,20 @@ void StopStopWatch(StopWatch& in);
 double ElapsedSeconds(const StopWatch& in);
 //------------------------------------------------------------//
 
+//-----------------------Threading----------------------------//
+size_t GetThreadsCount();
+// Splits [0, count) in chunks of grainSize items (the last one can be shorter) and
+// calls func(begin, end, threadIndex) for each of them from a set of worker threads,
+// returns when all the chunks are processed.
+// chunks always start at a multiple of grainSize and threadIndex < GetThreadsCount().
+// the workers are started once and kept, a ParallelFor called from func runs on the calling thread.
+void ParallelFor(size_t count, size_t grainSize,
+                 const std::function<void(size_t, size_t, size_t)>& func);
+// Stable LSD radix sort of the indices [0, keys.size()) by their key, runs on all the threads.
+void RadixSortIndices(const std::vector<uint32_t>& keys, std::vector<uint32_t>& order);
+void RadixSortIndices(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order);
+//------------------------------------------------------------//
+
 //------------------------------------------------------------//
 
 enum class IOStatus
@@ -250,9 +452,13 @@ struct Connectivity
     std::vector<VertexNeighbours> pointCells;
 };
 
-struct SurfaceMesh
+// Vec is Vec3d or Vec3f. the algorithms that move or create positions work on double meshes, float
+// ones hold the positions as stored in STL files and on the GPU at half the memory. the routines
+// that only read the positions take both and compute in double.
+template <typename Vec>
+struct BasicSurfaceMesh
 {
-    std::vector<Vec3d> vertices;
+    std::vector<Vec> vertices;
     std::vector<Triangle> faces;
     std::string name;
     Color color;
@@ -260,15 +466,565 @@ struct SurfaceMesh
     bool visible = true;
 };
 
+using SurfaceMesh = BasicSurfaceMesh<Vec3d>;
+using SurfaceMeshF = BasicSurfaceMesh<Vec3f>;
+
+// copy the mesh with its positions converted, in parallel.
+SurfaceMesh WidenMesh(const SurfaceMeshF& mesh);
+SurfaceMeshF NarrowMesh(const SurfaceMesh& mesh);
+
+// a position of either precision read in double, by the routines that accept both meshes.
+template <typename T>
+constexpr Vec3d privWiden(const Vec<T, 3>& v)
+{
+    return Vec3d{ v.x, v.y, v.z };
+}
+
+// the templated routines are instantiated for Vec3d and Vec3f next to their definitions, the
+// normals are computed in the precision of the mesh.
+template <typename Vec>
+std::vector<Vec> CalculateFacesNormals(const BasicSurfaceMesh<Vec>& mesh);
+template <typename Vec>
+std::vector<Vec> CalculateVertexNormals(const BasicSurfaceMesh<Vec>& mesh,
+                                        const Connectivity& connectivity);
+template <typename Vec>
+BBox CalculateBoundingBox(const BasicSurfaceMesh<Vec>& mesh);
+template <typename Vec>
+Connectivity BuildConnectivity(const BasicSurfaceMesh<Vec>& mesh);
+
+// Batch transforms, in parallel chunks with the kernels of GetSimdLevel(). float points are
+// transformed in float by the narrowed matrix.
+// the matrix is applied as an affine transform, its last row is ignored. the points are changed
+// in place and their new box is returned, bounded in the same pass.
+template <typename Vec>
+BBox TransformPoints(std::vector<Vec>& points, const Mat4& m);
+// by the inverse transpose of the upper 3x3 of m and normalised, so they stay perpendicular to the
+// surface under non uniform scales.
+template <typename Vec>
+void TransformNormals(std::vector<Vec>& normals, const Mat4& m);
+// the faces are flipped when m mirrors so they keep their orientation, returns the new box.
+template <typename Vec>
+BBox TransformMesh(BasicSurfaceMesh<Vec>& mesh, const Mat4& m);
+
+// One-ring adjacency in compressed rows: the faces around vertex v are faces[faceOffsets[v]] up to
+// faces[faceOffsets[v + 1]] excluded, and its neighbour vertices are found likewise in vertices.
+// Both lists are sorted.
+struct VertexRings
+{
+    std::vector<uint32_t> faceOffsets;
+    std::vector<uint32_t> faces;
+    std::vector<uint32_t> vertexOffsets;
+    std::vector<uint32_t> vertices;
+};
+
+template <typename Vec>
+VertexRings BuildVertexRings(const BasicSurfaceMesh<Vec>& mesh);
+// average of the normals of the faces around every vertex, computed on all the threads.
+template <typename Vec>
+std::vector<Vec> CalculateVertexNormals(const BasicSurfaceMesh<Vec>& mesh, const VertexRings& rings);
+
+// Per-vertex curvatures, the mean curvature is positive where the surface bends away from its
+// normals (1 / r on a sphere of radius r with outward normals).
+struct VertexCurvatures
+{
+    std::vector<double> mean;
+    std::vector<double> gaussian;
+    std::vector<double> minPrincipal;
+    std::vector<double> maxPrincipal;
+};
+
+// cotangent Laplacian for the mean curvature and angle deficit for the Gaussian one, both over
+// the mixed Voronoi area of every vertex.
+template <typename Vec>
+VertexCurvatures CalculateCurvatures(const BasicSurfaceMesh<Vec>& mesh, const VertexRings& rings);
+
+// Smoothing with the uniform (umbrella) Laplacian.
+enum class SmoothingMethod
+{
+    TAUBIN,      // alternating shrinking (lambda) and inflating (mu) steps.
+    HC_LAPLACIAN // Laplacian steps corrected towards the original positions.
+};
+
+struct SmoothingOptions
+{
+    SmoothingMethod method = SmoothingMethod::TAUBIN;
+    size_t iterations = 10;
+    double lambda = 0.5;
+    double mu = -0.53;
+    double alpha = 0.0;       // HC: weight of the original positions against the previous ones.
+    double beta = 0.5;        // HC: weight of a vertex correction against its neighbours' ones.
+    bool fixBoundary = true;  // boundary vertices don't move.
+};
+
+// only the vertices in selection move, all of them when it's empty. every iteration reads the
+// positions of the previous one so the result doesn't depend on the threads.
+void SmoothMesh(SurfaceMesh& mesh, const VertexRings& rings, const SmoothingOptions& options,
+                const std::vector<uint32_t>& selection = {});
 
-std::vector<Vec3d> CalculateFacesNormals(const SurfaceMesh& mesh);
-std::vector<Vec3d> CalculateVertexNormals(const SurfaceMesh& mesh,
-                                          const Connectivity& connectivity);
-BBox CalculateBoundingBox(const SurfaceMesh& mesh);
-Connectivity BuildConnectivity(const SurfaceMesh& mesh);
+// Convex hull with quickhull, started from the hull of the extreme points along 13 directions so
+// most points are dropped in one parallel pass. the faces point outwards and only the hull
+// vertices are kept, in input order. empty when the points are all coplanar.
+SurfaceMesh CalculateConvexHull(const std::vector<Vec3d>& points);
 
-IOStatus ReadMesh(const char* fileName, SurfaceMesh& result);
+// Oriented bounding box, the points center + t0 * axes[0] + t1 * axes[1] + t2 * axes[2] with
+// |ti| <= halfExtents[i].
+struct OBB
+{
+    Vec3d center{ 0.0, 0.0, 0.0 };
+    Vec3d axes[3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } }; // orthonormal, right handed.
+    Vec3d halfExtents{ -1.0, -1.0, -1.0 };                                        // negative when empty.
+};
+
+// Planes whose normals point inside, p is inside when dot(normals[i], p) + offsets[i] >= 0 for all.
+struct Frustum
+{
+    Vec3d normals[6];
+    double offsets[6] = {};
+};
+
+// the axes are the principal directions of the points, their covariance is summed in parallel
+// chunks. refineOnHull starts again from the covariance of the convex hull surface and from the
+// world axes, turns each start to the smallest rectangle around the hull seen along every axis, and
+// keeps the smallest box found, several times slower but much tighter on boxy parts. Vec is Vec3d or
+// Vec3f, float points are accumulated in double.
+template <typename Vec>
+OBB CalculateOrientedBoundingBox(const std::vector<Vec>& points, bool refineOnHull = false);
+bool IsOBBValid(const OBB& box);
+void CalculateOBBCorners(const OBB& box, Vec3d corners[8]);
+// distance along direction to the first point of the box hit by origin + t * direction with t >= 0,
+// 0 from inside and DBL_MAX when missed.
+double IntersectRay(const OBB& box, const Vec3d& origin, const Vec3d& direction);
+// false only when the box is entirely outside one of the planes, so a few boxes near the corners
+// of the frustum pass without touching it.
+bool IsOBBInFrustum(const Frustum& frustum, const OBB& box);
+
+// Solid voxelisation in a sparse grid of 8 x 8 x 8 voxel blocks, only the blocks holding set voxels
+// are stored so the memory follows the part rather than its box.
+struct VoxelBlock
+{
+    uint64_t bits[8]; // voxel (x, y, z) of the block is bit x + 8y of bits[z].
+};
+
+struct VoxelGrid
+{
+    Vec3d origin{ 0.0, 0.0, 0.0 }; // lowest corner of voxel (0, 0, 0).
+    double voxelSize = 0.0;
+    uint32_t dimensions[3] = {};  // in voxels.
+    // the key of the block (x, y, z), counted in blocks, is x + X * (y + Y * z) with X and Y the
+    // grid size in blocks. sorted, blocks[i] is the block of blockKeys[i].
+    std::vector<uint64_t> blockKeys;
+    std::vector<VoxelBlock> blocks;
+};
+
+// the grid covers the mesh box with resolution voxels along its longest side and a voxel of margin.
+// the voxels the faces touch are set in a parallel pass over the faces, then the ones inside are
+// filled by the parity of the crossings along x through their centres, so the mesh should be closed.
+template <typename Vec>
+VoxelGrid VoxeliseMesh(const BasicSurfaceMesh<Vec>& mesh, uint32_t resolution);
+bool IsVoxelSet(const VoxelGrid& grid, uint32_t x, uint32_t y, uint32_t z);
+size_t CountSetVoxels(const VoxelGrid& grid);
+
+// Scalar field on the nodes of a regular grid, node (i, j, k) is at origin + spacing * (i, j, k)
+// and its value is values[i + X * (j + Y * k)] with X and Y the first two dimensions.
+struct ScalarGrid
+{
+    Vec3d origin{ 0.0, 0.0, 0.0 };
+    double spacing = 1.0;
+    uint32_t dimensions[3] = {}; // in nodes.
+    std::vector<float> values;
+};
+
+// Marching cubes in parallel over blocks of 8 x 8 x 8 nodes. the surface separates the nodes below
+// isoValue from the others with its faces towards the larger values, so a signed distance gives
+// its outer surface and a density its inner one. the vertices are shared through per block edge
+// tables and the output is the same whatever the threads. a vertex is kept 1/1000 of the spacing
+// away from the nodes, those equal to isoValue don't give coincident vertices.
+SurfaceMesh ExtractIsosurface(const ScalarGrid& grid, double isoValue);
+// the boundary of the set voxels through their centres, closed even where they reach the side of the
+// grid. only the blocks near the stored ones are visited.
+SurfaceMesh ExtractIsosurface(const VoxelGrid& grid);
+
+// Subdivision, every level splits each face in four through a new vertex on each edge.
+enum class SubdivisionScheme
+{
+    LOOP,    // approximating, smooth away from the creases (edges not shared by exactly two faces).
+    MIDPOINT // the new vertices are the edge midpoints, the shape doesn't change.
+};
+
+// the new vertices follow the original ones and the faces of face i are [4i, 4i + 4).
+SurfaceMesh SubdivideMesh(const SurfaceMesh& mesh, SubdivisionScheme scheme, size_t levels = 1);
+
+// 63 bit Morton codes (21 bits per axis) of the points quantised in box.
+template <typename Vec>
+std::vector<uint64_t> CalculateMortonCodes(const std::vector<Vec>& points, const BBox& box);
+// Sorts the vertices, and then the faces by their centroid, along a Morton curve and remaps the faces
+// indices, neighbouring vertices and faces end up close in memory.
+template <typename Vec>
+void SortMeshSpatially(BasicSurfaceMesh<Vec>& mesh);
+
+// Connected components of a mesh, faces sharing a vertex are in the same component.
+struct MeshComponents
+{
+    std::vector<uint32_t> faceComponents; // component of every face.
+    std::vector<uint32_t> facesCounts;    // number of faces of every component.
+    std::vector<double> areas;            // area of every component.
+};
+
+// components are numbered in the order of their smallest vertex index, whatever the number of threads.
+template <typename Vec>
+MeshComponents LabelMeshComponents(const BasicSurfaceMesh<Vec>& mesh);
+// one mesh per component holding only the vertices it uses, the faces keep their order.
+template <typename Vec>
+std::vector<BasicSurfaceMesh<Vec>> SplitMeshComponents(const BasicSurfaceMesh<Vec>& mesh, const MeshComponents& components);
+// drops the components with fewer faces or less area than given, and the vertices they used.
+template <typename Vec>
+BasicSurfaceMesh<Vec> RemoveSmallComponents(const BasicSurfaceMesh<Vec>& mesh, const MeshComponents& components,
+                                            size_t minFacesCount, double minArea = 0.0);
+
+// Edge of a mesh, a < b.
+struct MeshEdge
+{
+    uint32_t a;
+    uint32_t b;
+};
+
+// Defects of a mesh, the lists are sorted.
+struct MeshValidation
+{
+    std::vector<MeshEdge> boundaryEdges;    // used by a single face.
+    std::vector<MeshEdge> nonManifoldEdges; // used by more than two faces.
+    std::vector<MeshEdge> misorientedEdges; // used twice in the same direction, the two faces have opposite orientations.
+    std::vector<uint32_t> degenerateFaces;  // repeated vertex or (nearly) no area.
+    std::vector<uint32_t> duplicateFaces;   // same vertices as a face with a smaller index.
+    bool insideOut = false;                 // closed, consistently oriented and with a negative volume.
+};
+
+// a parallel sweep over the edges bucketed by their smallest vertex, cheap enough to run on every
+// mesh read.
+template <typename Vec>
+MeshValidation ValidateMesh(const BasicSurfaceMesh<Vec>& mesh);
+// no boundary or non-manifold edges.
+bool IsWatertight(const MeshValidation& validation);
+// no defect at all.
+bool IsValid(const MeshValidation& validation);
+
+// Mass properties of the solid bounded by a mesh with unit density, from divergence theorem
+// integrals over its faces. the volume terms are only meaningful for closed meshes.
+struct MassProperties
+{
+    double area = 0.0;
+    double volume = 0.0;           // negative when the faces point inwards.
+    Vec3d centroid{ 0.0, 0.0, 0.0 };
+    Mat3 inertia = {};             // inertia tensor about the centroid.
+};
+
+// the faces are summed in fixed chunks with compensated sums, the result doesn't depend on the threads.
+template <typename Vec>
+MassProperties CalculateMassProperties(const BasicSurfaceMesh<Vec>& mesh);
+
+// Bounding volume hierarchy over the faces of a mesh.
+struct BVHNode
+{
+    BBox box;
+    uint32_t start = 0; // leaf: first entry in MeshBVH::faces, inner node: index of the left child (right child is start + 1).
+    uint32_t count = 0; // number of faces in a leaf, 0 for inner nodes.
+};
+
+struct MeshBVH
+{
+    std::vector<BVHNode> nodes; // nodes[0] is the root.
+    std::vector<uint32_t> faces; // faces indices ordered such that every leaf references a contiguous range.
+};
+
+struct ClosestPointResult
+{
+    uint32_t face = UINT32_MAX;
+    Vec3d point;
+    double distance = DBL_MAX;
+};
+
+template <typename Vec>
+MeshBVH BuildMeshBVH(const BasicSurfaceMesh<Vec>& mesh);
+Vec3d ClosestPointOnTriangle(const Vec3d& p, const Vec3d& a, const Vec3d& b, const Vec3d& c);
+ClosestPointResult FindClosestPoint(const SurfaceMesh& mesh, const MeshBVH& bvh, const Vec3d& point);
+// the queries are processed in parallel, result[i] is the closest point to points[i].
+std::vector<ClosestPointResult> FindClosestPoints(const SurfaceMesh& mesh,
+                                                  const MeshBVH& bvh,
+                                                  const std::vector<Vec3d>& points);
+// unsigned distance from every point to the mesh surface.
+std::vector<double> CalculateDistances(const SurfaceMesh& mesh,
+                                       const MeshBVH& bvh,
+                                       const std::vector<Vec3d>& points);
+
+struct RayHit
+{
+    uint32_t face = UINT32_MAX;
+    double distance = DBL_MAX; // along the direction, in its units.
+    Vec3d point;
+};
+
+// closest face hit by origin + t * direction with t >= 0, both sides of the faces are hit.
+template <typename Vec>
+RayHit IntersectRay(const BasicSurfaceMesh<Vec>& mesh, const MeshBVH& bvh, const Vec3d& origin, const Vec3d& direction);
+
+// Spatial hash of points in cubic cells, the cells are hashed in a power of two table whose
+// entries reference contiguous ranges of indices. the grid doesn't keep the points, the same
+// array has to be passed to the queries.
+struct PointGrid
+{
+    double cellSize = 0.0;
+    BBox box;
+    std::vector<uint32_t> cellsStart; // indices of the entry h are indices[cellsStart[h], cellsStart[h + 1]).
+    std::vector<uint32_t> indices;    // in increasing order inside every entry.
+};
+
+// Neighbours of a set of queries, the ones of query i are indices[offsets[i], offsets[i + 1]).
+struct NeighboursList
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> indices;
+};
+
+// queries are fastest when cellSize is close to their radius. a cellSize that isn't positive and
+// finite is replaced by one giving about as many cells as points.
+PointGrid BuildPointGrid(const std::vector<Vec3d>& points, double cellSize);
+// appends to result the indices of the points within radius of p.
+void FindPointsInRadius(const PointGrid& grid, const std::vector<Vec3d>& points,
+                        const Vec3d& p, double radius, std::vector<uint32_t>& result);
+// the queries are processed in parallel.
+NeighboursList FindPointsInRadius(const PointGrid& grid, const std::vector<Vec3d>& points,
+                                  const std::vector<Vec3d>& queries, double radius);
+// the (at most) k points closest to p, from the closest to the farthest.
+void FindNearestPoints(const PointGrid& grid, const std::vector<Vec3d>& points,
+                       const Vec3d& p, size_t k, std::vector<uint32_t>& result);
+// the queries are processed in parallel, the neighbours of query i are result[k * i, k * (i + 1)),
+// padded with UINT32_MAX when there are less than k points.
+std::vector<uint32_t> FindNearestPoints(const PointGrid& grid, const std::vector<Vec3d>& points,
+                                        const std::vector<Vec3d>& queries, size_t k);
+
+// Points sampled on the faces of a mesh.
+struct SurfaceSamples
+{
+    std::vector<Vec3d> positions;
+    std::vector<Vec3d> normals;  // of the faces they are on.
+    std::vector<uint32_t> faces;
+};
+
+// count points spread uniformly over the area, point i is at a random area in [i, i + 1) * area / count
+// along the prefix sums of the faces areas so the points are stratified and come in the order of the
+// faces. every fixed chunk of points draws from its own random stream, seeded from seed and the chunk
+// index, so the result is the same whatever the threads.
+SurfaceSamples SampleSurfaceUniform(const SurfaceMesh& mesh, size_t count, uint64_t seed = 0);
+// about evenly spaced points by sample elimination: from 5 times as many uniform samples, the ones
+// most crowded by their neighbours in a PointGrid are dropped until count are left. the neighbours
+// are found in parallel and kept, about 400 bytes per point returned.
+SurfaceSamples SampleSurfacePoissonDisk(const SurfaceMesh& mesh, size_t count, uint64_t seed = 0);
+
+// Interference detection between meshes.
+struct FacePair
+{
+    uint32_t faceA;
+    uint32_t faceB;
+};
+
+struct MeshesInterference
+{
+    uint32_t meshA; // indices in the meshes array, meshA < meshB.
+    uint32_t meshB;
+    std::vector<FacePair> faces;
+    std::vector<Vec3d> segments; // the contact of faces[i] goes from segments[2 * i] to segments[2 * i + 1].
+};
+
+// returns true when the triangles a and b intersect (touching counts), start and end receive
+// the contact segment, a single point for coplanar triangles.
+bool IntersectTriangles(const Vec3d a[3], const Vec3d b[3], Vec3d& start, Vec3d& end);
+// bvhs[i] is the BVH of meshes[i]. only the pairs of meshes that intersect are returned, the
+// work is spread over all the threads and the result doesn't depend on them.
+template <typename Vec>
+std::vector<MeshesInterference> FindInterferences(const std::vector<BasicSurfaceMesh<Vec>>& meshes,
+                                                  const std::vector<MeshBVH>& bvhs);
+// builds the BVHs first.
+template <typename Vec>
+std::vector<MeshesInterference> FindInterferences(const std::vector<BasicSurfaceMesh<Vec>>& meshes);
+
+// Sparse matrix in compressed rows, the entries of row i are columns[offsets[i]] up to
+// columns[offsets[i + 1]] excluded, sorted by column, with their values alongside.
+struct SparseMatrix
+{
+    size_t rowsCount = 0;
+    size_t columnsCount = 0;
+    std::vector<size_t> offsets;
+    std::vector<uint32_t> columns;
+    std::vector<double> values;
+};
+
+struct MatrixEntry
+{
+    uint32_t row;
+    uint32_t column;
+    double value;
+};
+
+// the values of the entries at the same position are summed.
+SparseMatrix BuildSparseMatrix(size_t rowsCount, size_t columnsCount, const std::vector<MatrixEntry>& entries);
+// result = matrix * x, the rows are spread over all the threads.
+void Multiply(const SparseMatrix& matrix, const std::vector<double>& x, std::vector<double>& result);
+
+struct SolverResult
+{
+    size_t iterations = 0;
+    double residual = 0.0; // |b - Ax|
+    bool converged = false;
+};
+
+// Jacobi preconditioned conjugate gradient for symmetric positive definite matrices, x holds the
+// initial guess. stops once |b - Ax| <= tolerance * |b|, the result doesn't depend on the threads.
+SolverResult SolveConjugateGradient(const SparseMatrix& matrix, const std::vector<double>& b, std::vector<double>& x,
+                                    double tolerance = 1e-10, size_t maxIterations = 10000);
+
+// LDL^T factorisation of a symmetric positive definite matrix reordered by nested dissection.
+struct CholeskyFactor
+{
+    std::vector<uint32_t> permutation; // row k of the factorised matrix is row permutation[k] of the input.
+    std::vector<size_t> offsets;       // strictly lower part of L in compressed columns.
+    std::vector<uint32_t> rows;
+    std::vector<double> values;
+    std::vector<double> diagonal;      // D
+};
+
+// false when the matrix isn't positive definite or L would have more than maxEntriesCount entries.
+bool FactoriseCholesky(const SparseMatrix& matrix, CholeskyFactor& factor, size_t maxEntriesCount = SIZE_MAX);
+void SolveCholesky(const CholeskyFactor& factor, const std::vector<double>& b, std::vector<double>& x);
+
+// Geodesic distances with the heat method (Crane et al. 2013). the operators are factorised once
+// per mesh and reused by every set of seeds.
+struct HeatGeodesics
+{
+    double timeStep = 0.0;
+    std::vector<uint32_t> components;  // connected component of every vertex, UINT32_MAX when unused.
+    std::vector<bool> pinned;          // vertices held at 0 in the Poisson problem, one per component.
+    SparseMatrix heatOperator;         // M + t L
+    SparseMatrix poissonOperator;      // L with a vertex of every component pinned.
+    CholeskyFactor heatFactor;
+    CholeskyFactor poissonFactor;
+    bool factorised = false;           // when false the conjugate gradient solves the systems.
+};
+
+// the factors are dropped in favour of the conjugate gradient when they would hold more than
+// maxFactorEntriesCount entries (12 bytes each). the factorisation runs on one thread and outgrows
+// the mesh, the default leaves the meshes above about 60K vertices to the parallel conjugate gradient.
+HeatGeodesics PrepareHeatGeodesics(const SurfaceMesh& mesh, size_t maxFactorEntriesCount = 10000000);
+// distance of every vertex to the closest seed along the surface, DBL_MAX on the parts without seeds.
+std::vector<double> CalculateGeodesicDistances(const SurfaceMesh& mesh, const HeatGeodesics& heat,
+                                               const std::vector<uint32_t>& seeds);
+
+// Quadric error edge-collapse simplification.
+struct DecimationOptions
+{
+    size_t targetFacesCount = 0; // stop once the mesh has at most this many faces.
+    double maxError = DBL_MAX;   // never perform a collapse with a larger error (in mesh units).
+    bool preserveBoundary = true;
+    // collapses are done in rounds of independent edges, when set the rounds are spread over
+    // all the threads. the result is the same either way.
+    bool parallel = true;
+    // checked between the rounds, the decimation stops where it is once set.
+    const std::atomic<bool>* cancel = nullptr;
+};
+
+// error (optional) receives the largest error of the performed collapses.
+SurfaceMesh DecimateMesh(const SurfaceMesh& mesh, const DecimationOptions& options, double* error = nullptr);
+
+// Simplified version of a mesh ready to be uploaded.
+struct MeshLod
+{
+    SurfaceMesh mesh;
+    std::vector<Vec3d> normals;
+    double error = 0.0; // estimated largest deviation from the original mesh (in mesh units).
+};
+
+// every level has a quarter of the faces of the previous one, stops at minFacesCount. nothing is
+// returned once cancel is set, it is checked between the decimation rounds.
+std::vector<MeshLod> GenerateMeshLods(const SurfaceMesh& mesh, size_t maxLevelsCount = 6, size_t minFacesCount = 1024,
+                                      const std::atomic<bool>* cancel = nullptr);
+
+// Planar slicing.
+struct Polyline
+{
+    std::vector<Vec3d> points;
+    bool closed = false; // the last point connects to the first one.
+};
+
+struct SliceLayer
+{
+    double height = 0.0;
+    // closed contours are counter-clockwise seen from above when the mesh faces point outwards,
+    // open ones come from holes in the mesh.
+    std::vector<Polyline> contours;
+};
+
+// cuts the mesh with the planes orthogonal to direction at the given heights (measured along
+// direction from the origin), result[i] is the cut at heights[i]. the layers are processed in parallel.
+template <typename Vec>
+std::vector<SliceLayer> SliceMesh(const BasicSurfaceMesh<Vec>& mesh, const Vec3d& direction, const std::vector<double>& heights);
+
+// Faces and vertices ordering for the GPU post-transform vertex cache (a FIFO of cacheSize entries).
+struct VertexCacheStatistics
+{
+    double acmr = 0.0; // average cache miss ratio: vertices transformed per face, 0.5 is ideal.
+    double atvr = 0.0; // average transformed vertex ratio: vertices transformed per vertex, 1.0 is ideal.
+};
+
+template <typename Vec>
+VertexCacheStatistics CalculateVertexCacheStatistics(const BasicSurfaceMesh<Vec>& mesh, size_t cacheSize = 16);
+// Tipsify ordering of the faces.
+void OptimiseVertexCache(SurfaceMesh& mesh, size_t cacheSize = 16);
+// vertex cache ordering whose clusters are then sorted so the outward facing ones are drawn first,
+// threshold is how much the ACMR of a cluster can grow to split it in smaller ones.
+void OptimiseOverdraw(SurfaceMesh& mesh, size_t cacheSize = 16, double threshold = 1.05);
+// renumbers the vertices in the order the faces use them.
+void OptimiseVertexFetch(SurfaceMesh& mesh);
+// OptimiseOverdraw followed by OptimiseVertexFetch.
+void OptimiseMeshForRendering(SurfaceMesh& mesh, size_t cacheSize = 16);
+
+// Meshlets, clusters of adjacent faces drawn as ranges of the index buffer so they can be culled
+// one by one.
+struct Meshlet
+{
+    uint32_t faceOffset = 0; // the faces of the meshlet are mesh.faces[faceOffset, faceOffset + facesCount).
+    uint32_t facesCount = 0;
+    Vec3d center{ 0.0, 0.0, 0.0 }; // bounding sphere of the vertices.
+    double radius = 0.0;
+    Vec3d coneAxis{ 0.0, 0.0, 1.0 }; // the normals of the faces are in the cone around the axis.
+    double coneCutoff = 1.0;         // sine of the half angle of the cone, 1 when it is 90 degrees or more.
+};
+
+// grows meshlets of up to maxFacesCount faces over the faces sharing vertices, seeded along the
+// Morton curve of the faces, and reorders mesh.faces so each meshlet is a contiguous range. the
+// faces of a meshlet keep their relative order.
+template <typename Vec>
+std::vector<Meshlet> BuildMeshlets(BasicSurfaceMesh<Vec>& mesh, size_t maxFacesCount = 128);
+// the spheres and cones of the meshlets after the vertices moved, the faces must not have changed.
+template <typename Vec>
+void CalculateMeshletsBounds(const BasicSurfaceMesh<Vec>& mesh, std::vector<Meshlet>& meshlets);
+// OptimiseMeshForRendering within the meshlets BuildMeshlets returned: the faces of each meshlet are
+// put in vertex cache order, the meshlets are sorted for overdraw, then the vertices renumbered for
+// fetch. the bounds of the meshlets don't change.
+template <typename Vec>
+void OptimiseMeshletsForRendering(BasicSurfaceMesh<Vec>& mesh, std::vector<Meshlet>& meshlets, size_t cacheSize = 16);
+bool IsMeshletInFrustum(const Frustum& frustum, const Meshlet& meshlet);
+// true when all the faces of the meshlet face away from eye, seen from anywhere in the sphere.
+bool IsMeshletBackFacing(const Meshlet& meshlet, const Vec3d& eye);
+
+struct ReadMeshOptions
+{
+    bool spatialSort = false; // see SortMeshSpatially.
+};
+
+IOStatus ReadMesh(const char* fileName, SurfaceMesh& result, const ReadMeshOptions& options = ReadMeshOptions());
+// keeps the float positions of the file as they are.
+IOStatus ReadMesh(const char* fileName, SurfaceMeshF& result, const ReadMeshOptions& options = ReadMeshOptions());
 bool WriteStl(const SurfaceMesh& mesh, const char* fileName);
+bool WriteStl(const SurfaceMeshF& mesh, const char* fileName);
 
 Color GenerateColor();
 
@@ -297,6 +1053,15 @@ struct RenderBuffer
     uint32_t textureId; // id of the texture used to store the 3d render pipeline of the 3D view.
 };
 
+struct MeshRenderLod
+{
+    uint32_t vertexBufferObject;
+    uint32_t vertexBufferId;
+    uint32_t elementBufferId;
+    size_t facesCount;
+    double error;
+};
+
 struct MeshRenderInfo
 {
     uint32_t vertexBufferObject;
@@ -305,7 +1070,13 @@ struct MeshRenderInfo
     size_t facesCount;
     size_t verticesCount;
     BBox box;
+    OBB orientedBox;
     UUId id;
+    VertexCacheStatistics cacheStatistics;
+    std::vector<MeshRenderLod> lods; // from the finest to the coarsest.
+    uint32_t scalarBufferId = 0;     // per-vertex values in [0, 1] at the attribute location 2, 0 when unset.
+    std::vector<Meshlet> meshlets;   // of the full resolution mesh, in the order of its index buffer.
+    bool cullBackFacing = false;     // set by the caller for closed and consistently oriented meshes.
 };
 
 
@@ -322,14 +1093,47 @@ Program CreateProgram(const char* geometryShader,
 // returns -1 on failure and the shader id on success.
 int32_t CompileShader(const char* shader, ShaderType type, std::string& log);
 
+void SetProgramUniform1i(const Program& program, const char* name, int value);
 void SetProgramUniformV3f(const Program& program, const char* name, const float data[3]);
 void SetProgramUniformM4x4f(const Program& program, const char* name, const float data[16]);
 
 uint32_t GenerateTexture();
 void UpdateTexture(uint32_t textureId, size_t width, size_t height, Color* rgbaData);
 
+// Line segments drawn with GL_LINES, positions are at the attribute location 0.
+struct LinesRenderInfo
+{
+    uint32_t vertexBufferObject;
+    uint32_t vertexBufferId;
+    size_t verticesCount;
+    UUId id;
+};
+
+// the faces of mesh are reordered by BuildMeshlets and OptimiseMeshletsForRendering, which also
+// renumbers the vertices.
 MeshRenderInfo CreateSurfaceMeshRenderInfo(SurfaceMesh& mesh);
-void RenderMesh(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info);
+// uploads the positions without narrowing them.
+MeshRenderInfo CreateSurfaceMeshRenderInfo(SurfaceMeshF& mesh);
+void DestroySurfaceMeshRenderInfo(MeshRenderInfo& info);
+// values are mapped from [min, max] to [0, 1] for colour mapping, only the full resolution mesh gets them.
+void SetSurfaceMeshScalars(MeshRenderInfo& info, const std::vector<double>& values, double min, double max);
+void ClearSurfaceMeshScalars(MeshRenderInfo& info);
+// uploads the positions and normals of the vertices [begin, end) after they moved, the faces
+// must not have changed. the simplified levels are dropped as they no longer match.
+void UpdateSurfaceMeshRenderInfo(MeshRenderInfo& info, const SurfaceMesh& mesh, const std::vector<Vec3d>& vertexNormals,
+                                 size_t begin = 0, size_t end = SIZE_MAX);
+// segments holds the two ends of every line.
+LinesRenderInfo CreateLinesRenderInfo(const std::vector<Vec3d>& segments);
+LinesRenderInfo CreateContoursRenderInfo(const std::vector<SliceLayer>& layers);
+void DestroyLinesRenderInfo(LinesRenderInfo& info);
+void RenderLines(const RenderBuffer& buffer, const Program& program, const LinesRenderInfo& info);
+void AddSurfaceMeshRenderLod(MeshRenderInfo& info, const MeshLod& lod);
+// lod 0 is the full resolution mesh and lod i is info.lods[i - 1].
+void RenderMesh(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info, size_t lod = 0);
+// draws the meshlets of the full resolution mesh in the frustum in one glMultiDrawElements, the
+// back-facing ones are skipped too when info.cullBackFacing is set and eye is outside the mesh box.
+void RenderMeshlets(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info,
+                    const Frustum& frustum, const Vec3d& eye);
 
 // 3D Camera
 struct Camera
@@ -347,9 +1151,22 @@ struct Camera
 };
 
 Mat4 CameraGetViewMatrix(const Camera& c);
+Vec3d CameraGetPosition(const Camera& c);
 Mat4 CameraGetProjectionMatrix(const Camera& c, size_t width, size_t height);
 void CameraGetFrame(const Camera& c, Vec3d& look, Vec3d& up, Vec3d& right);
+// ray through a pixel of a viewport of the given size, the pixel is measured from the top left
+// corner and direction is normalised.
+void CameraGetRay(const Camera& c, size_t width, size_t height, Vec2d pixel, Vec3d& origin, Vec3d& direction);
 void CameraFitBBox(Camera& c, const BBox& box);
+// centres the box like CameraFitBBox with the distance set by the diagonal of the oriented box,
+// much shorter than the axis aligned one for rotated parts.
+void CameraFitOBB(Camera& c, const OBB& box);
+// the planes of the view volume of a viewport of the given size, near and far included.
+Frustum CameraGetFrustum(const Camera& c, size_t width, size_t height);
 void CameraProcessZoom(Camera& c, double amount);
 void CameraProcessRotate(Camera& c, Vec2d start, Vec2d end);
 void CameraProcessTranslate(Camera& c, Vec2d delta);
+
+// coarsest level of info whose error projects to at most maxPixelError pixels in a viewport
+// of the given height, the error is projected at the point of the mesh box closest to the camera.
+size_t SelectMeshLod(const MeshRenderInfo& info, const Camera& c, size_t viewportHeight, double maxPixelError = 1.0);
@@ -0,0 +1,532 @@
+#include "Resha.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t BVH_LEAF_SIZE = 4;
+    constexpr size_t BVH_BINS_COUNT = 16;
+    // beyond this depth nodes are split at the median so the tree depth stays bounded.
+    constexpr size_t BVH_MAX_SAH_DEPTH = 48;
+    constexpr size_t BVH_STACK_SIZE = 128;
+    // number of queries processed by a thread in one go, consecutive queries reuse
+    // the previous result as an initial bound.
+    constexpr size_t QUERIES_GRAIN_SIZE = 1024;
+
+    void ExtendBBox(BBox& box, const Vec3d& p)
+    {
+        box.min.x = std::min(p.x, box.min.x);
+        box.min.y = std::min(p.y, box.min.y);
+        box.min.z = std::min(p.z, box.min.z);
+        box.max.x = std::max(p.x, box.max.x);
+        box.max.y = std::max(p.y, box.max.y);
+        box.max.z = std::max(p.z, box.max.z);
+    }
+
+    double BBoxArea(const BBox& box)
+    {
+        const Vec3d d = box.max - box.min;
+        return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    double SquaredDistance(const Vec3d& a, const Vec3d& b)
+    {
+        const Vec3d d = a - b;
+        return DotProduct(d, d);
+    }
+
+    double SquaredDistanceToBBox(const Vec3d& p, const BBox& box)
+    {
+        double result = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const double v = p.data[i];
+            if (v < box.min.data[i])
+            {
+                result += (box.min.data[i] - v) * (box.min.data[i] - v);
+            }
+            else if (v > box.max.data[i])
+            {
+                result += (v - box.max.data[i]) * (v - box.max.data[i]);
+            }
+        }
+        return result;
+    }
+
+    struct BuildItem
+    {
+        BBox box;
+        Vec3d centroid;
+    };
+
+    struct Bin
+    {
+        BBox box;
+        size_t count = 0;
+    };
+
+    // Splits the faces range [begin, end) using binned SAH on the centroids,
+    // returns the position of the first face of the right child.
+    size_t PartitionNode(std::vector<uint32_t>& faces,
+                         const std::vector<BuildItem>& items,
+                         size_t begin, size_t end)
+    {
+        BBox centroidsBox;
+        for (size_t i = begin; i < end; ++i)
+        {
+            ExtendBBox(centroidsBox, items[faces[i]].centroid);
+        }
+        const Vec3d extent = centroidsBox.max - centroidsBox.min;
+        int axis = 0;
+        if (extent.y > extent.data[axis]) axis = 1;
+        if (extent.z > extent.data[axis]) axis = 2;
+        if (extent.data[axis] <= 0.0)
+        {
+            // all centroids are at the same position, split in the middle.
+            return (begin + end) / 2;
+        }
+
+        const double minValue = centroidsBox.min.data[axis];
+        const double scale = BVH_BINS_COUNT / extent.data[axis];
+        auto BinIndex = [&](uint32_t face)
+        {
+            const size_t b = size_t((items[face].centroid.data[axis] - minValue) * scale);
+            return std::min(b, BVH_BINS_COUNT - 1);
+        };
+
+        Bin bins[BVH_BINS_COUNT];
+        for (size_t i = begin; i < end; ++i)
+        {
+            Bin& bin = bins[BinIndex(faces[i])];
+            bin.box = Merge(bin.box, items[faces[i]].box);
+            bin.count++;
+        }
+
+        // sweep from the right to get the cost of the right side of every split plane.
+        double rightCost[BVH_BINS_COUNT] = {};
+        BBox rightBox;
+        size_t rightCount = 0;
+        for (size_t i = BVH_BINS_COUNT - 1; i > 0; --i)
+        {
+            rightBox = Merge(rightBox, bins[i].box);
+            rightCount += bins[i].count;
+            rightCost[i] = rightCount ? BBoxArea(rightBox) * rightCount : 0.0;
+        }
+        BBox leftBox;
+        size_t leftCount = 0;
+        double bestCost = DBL_MAX;
+        size_t bestSplit = 0;
+        for (size_t i = 1; i < BVH_BINS_COUNT; ++i)
+        {
+            leftBox = Merge(leftBox, bins[i - 1].box);
+            leftCount += bins[i - 1].count;
+            const double cost = (leftCount ? BBoxArea(leftBox) * leftCount : 0.0) + rightCost[i];
+            if (leftCount && leftCount != end - begin && cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+        if (bestSplit == 0)
+        {
+            return (begin + end) / 2;
+        }
+        const auto middle = std::partition(faces.begin() + begin, faces.begin() + end,
+                                           [&](uint32_t face) { return BinIndex(face) < bestSplit; });
+        return middle - faces.begin();
+    }
+} // namespace
+
+template <typename Vec>
+MeshBVH BuildMeshBVH(const BasicSurfaceMesh<Vec>& mesh)
+{
+    MeshBVH bvh;
+    const size_t facesCount = mesh.faces.size();
+    if (facesCount == 0)
+    {
+        return bvh;
+    }
+
+    std::vector<BuildItem> items(facesCount);
+    ParallelFor(facesCount, 64 * 1024, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            BuildItem& item = items[i];
+            item.box = BBox();
+            ExtendBBox(item.box, privWiden(mesh.vertices[t.idx[0]]));
+            ExtendBBox(item.box, privWiden(mesh.vertices[t.idx[1]]));
+            ExtendBBox(item.box, privWiden(mesh.vertices[t.idx[2]]));
+            item.centroid = CalculateBBoxCenter(item.box);
+        }
+    });
+
+    bvh.faces.resize(facesCount);
+    for (size_t i = 0; i < facesCount; ++i)
+    {
+        bvh.faces[i] = i;
+    }
+    bvh.nodes.reserve(2 * facesCount / BVH_LEAF_SIZE + 1);
+    bvh.nodes.emplace_back();
+    bvh.nodes[0].start = 0;
+    bvh.nodes[0].count = facesCount;
+
+    struct Task
+    {
+        uint32_t node;
+        uint32_t depth;
+    };
+    std::vector<Task> stack;
+    stack.push_back(Task{ 0, 0 });
+    while (!stack.empty())
+    {
+        const Task task = stack.back();
+        const uint32_t nodeIndex = task.node;
+        stack.pop_back();
+
+        const size_t begin = bvh.nodes[nodeIndex].start;
+        const size_t end = begin + bvh.nodes[nodeIndex].count;
+        BBox box;
+        for (size_t i = begin; i < end; ++i)
+        {
+            box = Merge(box, items[bvh.faces[i]].box);
+        }
+        bvh.nodes[nodeIndex].box = box;
+        if (end - begin <= BVH_LEAF_SIZE)
+        {
+            continue;
+        }
+
+        size_t split = begin;
+        if (task.depth < BVH_MAX_SAH_DEPTH)
+        {
+            split = PartitionNode(bvh.faces, items, begin, end);
+        }
+        else
+        {
+            const Vec3d extent = box.max - box.min;
+            int axis = 0;
+            if (extent.y > extent.data[axis]) axis = 1;
+            if (extent.z > extent.data[axis]) axis = 2;
+            split = (begin + end) / 2;
+            std::nth_element(bvh.faces.begin() + begin, bvh.faces.begin() + split, bvh.faces.begin() + end,
+                             [&](uint32_t a, uint32_t b)
+                             {
+                                 return items[a].centroid.data[axis] < items[b].centroid.data[axis];
+                             });
+        }
+        const uint32_t left = bvh.nodes.size();
+        bvh.nodes.emplace_back();
+        bvh.nodes.emplace_back();
+        bvh.nodes[left].start = begin;
+        bvh.nodes[left].count = split - begin;
+        bvh.nodes[left + 1].start = split;
+        bvh.nodes[left + 1].count = end - split;
+        bvh.nodes[nodeIndex].start = left;
+        bvh.nodes[nodeIndex].count = 0;
+        stack.push_back(Task{ left, task.depth + 1 });
+        stack.push_back(Task{ left + 1, task.depth + 1 });
+    }
+    return bvh;
+}
+
+template MeshBVH BuildMeshBVH(const SurfaceMesh& mesh);
+template MeshBVH BuildMeshBVH(const SurfaceMeshF& mesh);
+
+// Real-Time Collision Detection (Ericson), section 5.1.5.
+Vec3d ClosestPointOnTriangle(const Vec3d& p, const Vec3d& a, const Vec3d& b, const Vec3d& c)
+{
+    const Vec3d ab = b - a;
+    const Vec3d ac = c - a;
+    const Vec3d ap = p - a;
+    const double d1 = DotProduct(ab, ap);
+    const double d2 = DotProduct(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0)
+    {
+        return a;
+    }
+
+    const Vec3d bp = p - b;
+    const double d3 = DotProduct(ab, bp);
+    const double d4 = DotProduct(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3)
+    {
+        return b;
+    }
+
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+        const double v = d1 / (d1 - d3);
+        return a + ab * v;
+    }
+
+    const Vec3d cp = p - c;
+    const double d5 = DotProduct(ab, cp);
+    const double d6 = DotProduct(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6)
+    {
+        return c;
+    }
+
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+        const double w = d2 / (d2 - d6);
+        return a + ac * w;
+    }
+
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+    {
+        const double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return b + (c - b) * w;
+    }
+
+    const double denom = 1.0 / (va + vb + vc);
+    const double v = vb * denom;
+    const double w = vc * denom;
+    return a + ab * v + ac * w;
+}
+
+namespace
+{
+    // result holds the current best candidate (squared distance stored in bestSqr),
+    // the traversal only visits nodes that can improve it.
+    void FindClosestPoint(const SurfaceMesh& mesh, const MeshBVH& bvh, const Vec3d& point,
+                          ClosestPointResult& result, double& bestSqr)
+    {
+        uint32_t stack[BVH_STACK_SIZE];
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize)
+        {
+            const BVHNode& node = bvh.nodes[stack[--stackSize]];
+            if (SquaredDistanceToBBox(point, node.box) >= bestSqr)
+            {
+                continue;
+            }
+            if (node.count)
+            {
+                for (uint32_t i = node.start; i < node.start + node.count; ++i)
+                {
+                    const uint32_t face = bvh.faces[i];
+                    const Triangle& t = mesh.faces[face];
+                    const Vec3d p = ClosestPointOnTriangle(point,
+                                                           mesh.vertices[t.idx[0]],
+                                                           mesh.vertices[t.idx[1]],
+                                                           mesh.vertices[t.idx[2]]);
+                    const double d = SquaredDistance(point, p);
+                    if (d < bestSqr)
+                    {
+                        bestSqr = d;
+                        result.face = face;
+                        result.point = p;
+                    }
+                }
+                continue;
+            }
+            // visit the nearest child first so the far one is more likely to be pruned.
+            const double dLeft = SquaredDistanceToBBox(point, bvh.nodes[node.start].box);
+            const double dRight = SquaredDistanceToBBox(point, bvh.nodes[node.start + 1].box);
+            assert(stackSize + 2 <= BVH_STACK_SIZE);
+            if (dLeft < dRight)
+            {
+                if (dRight < bestSqr) stack[stackSize++] = node.start + 1;
+                if (dLeft < bestSqr) stack[stackSize++] = node.start;
+            }
+            else
+            {
+                if (dLeft < bestSqr) stack[stackSize++] = node.start;
+                if (dRight < bestSqr) stack[stackSize++] = node.start + 1;
+            }
+        }
+    }
+} // namespace
+
+ClosestPointResult FindClosestPoint(const SurfaceMesh& mesh, const MeshBVH& bvh, const Vec3d& point)
+{
+    ClosestPointResult result;
+    if (bvh.nodes.empty())
+    {
+        return result;
+    }
+    double bestSqr = DBL_MAX;
+    FindClosestPoint(mesh, bvh, point, result, bestSqr);
+    result.distance = sqrt(bestSqr);
+    return result;
+}
+
+std::vector<ClosestPointResult> FindClosestPoints(const SurfaceMesh& mesh,
+                                                  const MeshBVH& bvh,
+                                                  const std::vector<Vec3d>& points)
+{
+    std::vector<ClosestPointResult> result(points.size());
+    if (bvh.nodes.empty())
+    {
+        return result;
+    }
+    ParallelFor(points.size(), QUERIES_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint32_t previousFace = UINT32_MAX;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Vec3d& p = points[i];
+            ClosestPointResult& r = result[i];
+            double bestSqr = DBL_MAX;
+            // sample points are usually coherent, the face found for the previous
+            // point gives a tight initial bound that prunes most of the tree.
+            if (previousFace != UINT32_MAX)
+            {
+                const Triangle& t = mesh.faces[previousFace];
+                r.point = ClosestPointOnTriangle(p,
+                                                 mesh.vertices[t.idx[0]],
+                                                 mesh.vertices[t.idx[1]],
+                                                 mesh.vertices[t.idx[2]]);
+                r.face = previousFace;
+                bestSqr = SquaredDistance(p, r.point);
+            }
+            FindClosestPoint(mesh, bvh, p, r, bestSqr);
+            r.distance = sqrt(bestSqr);
+            previousFace = r.face;
+        }
+    });
+    return result;
+}
+
+std::vector<double> CalculateDistances(const SurfaceMesh& mesh,
+                                       const MeshBVH& bvh,
+                                       const std::vector<Vec3d>& points)
+{
+    const std::vector<ClosestPointResult> closest = FindClosestPoints(mesh, bvh, points);
+    std::vector<double> result(closest.size());
+    for (size_t i = 0; i < closest.size(); ++i)
+    {
+        result[i] = closest[i].distance;
+    }
+    return result;
+}
+
+namespace
+{
+    // entry distance of the ray in the box, DBL_MAX when it misses or enters beyond maxDistance.
+    double IntersectBBox(const BBox& box, const Vec3d& origin, const Vec3d& inverseDirection, double maxDistance)
+    {
+        double tMin = 0.0;
+        double tMax = maxDistance;
+        for (int i = 0; i < 3; ++i)
+        {
+            double t0 = (box.min.data[i] - origin.data[i]) * inverseDirection.data[i];
+            double t1 = (box.max.data[i] - origin.data[i]) * inverseDirection.data[i];
+            if (t0 > t1)
+            {
+                std::swap(t0, t1);
+            }
+            // NaN when the ray lies in a slab plane, the comparisons then keep the previous bounds.
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+            if (tMin > tMax)
+            {
+                return DBL_MAX;
+            }
+        }
+        return tMin;
+    }
+
+    // Moller-Trumbore, false when the ray misses or hits beyond maxDistance.
+    bool IntersectTriangle(const Vec3d& origin, const Vec3d& direction,
+                           const Vec3d& a, const Vec3d& b, const Vec3d& c, double maxDistance, double& distance)
+    {
+        const Vec3d ab = b - a;
+        const Vec3d ac = c - a;
+        const Vec3d p = CrossProduct(direction, ac);
+        const double det = DotProduct(ab, p);
+        if (det == 0.0)
+        {
+            return false;
+        }
+        const double inverseDet = 1.0 / det;
+        const Vec3d s = origin - a;
+        const double u = DotProduct(s, p) * inverseDet;
+        if (u < 0.0 || u > 1.0)
+        {
+            return false;
+        }
+        const Vec3d q = CrossProduct(s, ab);
+        const double v = DotProduct(direction, q) * inverseDet;
+        if (v < 0.0 || u + v > 1.0)
+        {
+            return false;
+        }
+        const double t = DotProduct(ac, q) * inverseDet;
+        if (t < 0.0 || t >= maxDistance)
+        {
+            return false;
+        }
+        distance = t;
+        return true;
+    }
+} // namespace
+
+template <typename Vec>
+RayHit IntersectRay(const BasicSurfaceMesh<Vec>& mesh, const MeshBVH& bvh, const Vec3d& origin, const Vec3d& direction)
+{
+    RayHit result;
+    if (bvh.nodes.empty())
+    {
+        return result;
+    }
+    const Vec3d inverseDirection{ 1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z };
+    uint32_t stack[BVH_STACK_SIZE];
+    size_t stackSize = 0;
+    if (IntersectBBox(bvh.nodes[0].box, origin, inverseDirection, DBL_MAX) != DBL_MAX)
+    {
+        stack[stackSize++] = 0;
+    }
+    while (stackSize)
+    {
+        const BVHNode& node = bvh.nodes[stack[--stackSize]];
+        if (node.count)
+        {
+            for (uint32_t i = node.start; i < node.start + node.count; ++i)
+            {
+                const Triangle& t = mesh.faces[bvh.faces[i]];
+                double distance;
+                if (IntersectTriangle(origin, direction, privWiden(mesh.vertices[t.idx[0]]),
+                                      privWiden(mesh.vertices[t.idx[1]]), privWiden(mesh.vertices[t.idx[2]]),
+                                      result.distance, distance))
+                {
+                    result.distance = distance;
+                    result.face = bvh.faces[i];
+                }
+            }
+            continue;
+        }
+        // the nearest child is visited first, its hits prune the far one.
+        const double dLeft = IntersectBBox(bvh.nodes[node.start].box, origin, inverseDirection, result.distance);
+        const double dRight = IntersectBBox(bvh.nodes[node.start + 1].box, origin, inverseDirection, result.distance);
+        assert(stackSize + 2 <= BVH_STACK_SIZE);
+        if (dLeft < dRight)
+        {
+            if (dRight != DBL_MAX) stack[stackSize++] = node.start + 1;
+            stack[stackSize++] = node.start;
+        }
+        else
+        {
+            if (dLeft != DBL_MAX) stack[stackSize++] = node.start;
+            if (dRight != DBL_MAX) stack[stackSize++] = node.start + 1;
+        }
+    }
+    if (result.face != UINT32_MAX)
+    {
+        result.point = origin + direction * result.distance;
+    }
+    return result;
+}
+
+template RayHit IntersectRay(const SurfaceMesh& mesh, const MeshBVH& bvh, const Vec3d& origin, const Vec3d& direction);
+template RayHit IntersectRay(const SurfaceMeshF& mesh, const MeshBVH& bvh, const Vec3d& origin, const Vec3d& direction);
@@ -0,0 +1,431 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    // below this relative magnitude a signed distance to a plane is considered 0.
+    constexpr double PLANE_EPSILON = 1e-12;
+    // node pairs are expanded breadth first until there are this many tasks per thread.
+    constexpr size_t TASKS_PER_THREAD = 64;
+    constexpr size_t TRAVERSAL_STACK_SIZE = 256;
+
+    bool BBoxesOverlap(const BBox& a, const BBox& b)
+    {
+        return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+               a.min.y <= b.max.y && b.min.y <= a.max.y &&
+               a.min.z <= b.max.z && b.min.z <= a.max.z;
+    }
+
+    BBox TriangleBBox(const Vec3d t[3])
+    {
+        BBox box;
+        for (int i = 0; i < 3; ++i)
+        {
+            box.min.x = std::min(box.min.x, t[i].x);
+            box.min.y = std::min(box.min.y, t[i].y);
+            box.min.z = std::min(box.min.z, t[i].z);
+            box.max.x = std::max(box.max.x, t[i].x);
+            box.max.y = std::max(box.max.y, t[i].y);
+            box.max.z = std::max(box.max.z, t[i].z);
+        }
+        return box;
+    }
+
+    double BBoxArea(const BBox& box)
+    {
+        const Vec3d d = box.max - box.min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    // Signed distances (scaled by the normal length) of the vertices of t to the plane of p,
+    // the ones too small to be trusted are snapped to 0.
+    void PlaneDistances(const Vec3d p[3], const Vec3d t[3], Vec3d& normal, double d[3])
+    {
+        normal = CrossProduct(p[1] - p[0], p[2] - p[0]);
+        double scale = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            d[i] = DotProduct(normal, t[i] - p[0]);
+            const Vec3d r = t[i] - p[0];
+            scale = std::max(scale, DotProduct(r, r));
+        }
+        const double epsilon = PLANE_EPSILON * Length(normal) * sqrt(scale);
+        for (int i = 0; i < 3; ++i)
+        {
+            if (fabs(d[i]) <= epsilon)
+            {
+                d[i] = 0.0;
+            }
+        }
+    }
+
+    // points where the triangle t meets the plane it has the distances d to, returns false when
+    // it doesn't. first and last are the extremes along direction.
+    bool PlaneCrossing(const Vec3d t[3], const double d[3], const Vec3d& direction,
+                       Vec3d& first, Vec3d& last, double& firstT, double& lastT)
+    {
+        firstT = DBL_MAX;
+        lastT = -DBL_MAX;
+        auto add = [&](const Vec3d& p)
+        {
+            const double v = DotProduct(p, direction);
+            if (v < firstT)
+            {
+                firstT = v;
+                first = p;
+            }
+            if (v > lastT)
+            {
+                lastT = v;
+                last = p;
+            }
+        };
+        for (int i = 0; i < 3; ++i)
+        {
+            const int j = (i + 1) % 3;
+            if (d[i] == 0.0)
+            {
+                add(t[i]);
+            }
+            if ((d[i] < 0.0 && d[j] > 0.0) || (d[i] > 0.0 && d[j] < 0.0))
+            {
+                add(t[i] + (t[j] - t[i]) * (d[i] / (d[i] - d[j])));
+            }
+        }
+        return firstT <= lastT;
+    }
+
+    double Cross2D(double ax, double ay, double bx, double by)
+    {
+        return ax * by - ay * bx;
+    }
+
+    // coplanar triangles, tested in the coordinate plane the normal is the most aligned with.
+    bool IntersectCoplanarTriangles(const Vec3d a[3], const Vec3d b[3], const Vec3d& normal, Vec3d& point)
+    {
+        int axis = 0;
+        if (fabs(normal.y) > fabs(normal.data[axis])) axis = 1;
+        if (fabs(normal.z) > fabs(normal.data[axis])) axis = 2;
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const Vec3d& p0 = a[i];
+            const Vec3d& p1 = a[(i + 1) % 3];
+            for (int j = 0; j < 3; ++j)
+            {
+                const Vec3d& q0 = b[j];
+                const Vec3d& q1 = b[(j + 1) % 3];
+                const double rx = p1.data[u] - p0.data[u], ry = p1.data[v] - p0.data[v];
+                const double sx = q1.data[u] - q0.data[u], sy = q1.data[v] - q0.data[v];
+                const double qpx = q0.data[u] - p0.data[u], qpy = q0.data[v] - p0.data[v];
+                const double denominator = Cross2D(rx, ry, sx, sy);
+                if (denominator == 0.0)
+                {
+                    continue;
+                }
+                const double t = Cross2D(qpx, qpy, sx, sy) / denominator;
+                const double s = Cross2D(qpx, qpy, rx, ry) / denominator;
+                if (t >= 0.0 && t <= 1.0 && s >= 0.0 && s <= 1.0)
+                {
+                    point = p0 + (p1 - p0) * t;
+                    return true;
+                }
+            }
+        }
+
+        // no edges cross, one triangle is inside the other or they are apart.
+        auto inside = [&](const Vec3d& p, const Vec3d t[3])
+        {
+            double signs[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                const Vec3d& e0 = t[i];
+                const Vec3d& e1 = t[(i + 1) % 3];
+                signs[i] = Cross2D(e1.data[u] - e0.data[u], e1.data[v] - e0.data[v],
+                                   p.data[u] - e0.data[u], p.data[v] - e0.data[v]);
+            }
+            return (signs[0] >= 0.0 && signs[1] >= 0.0 && signs[2] >= 0.0) ||
+                   (signs[0] <= 0.0 && signs[1] <= 0.0 && signs[2] <= 0.0);
+        };
+        if (inside(a[0], b))
+        {
+            point = a[0];
+            return true;
+        }
+        if (inside(b[0], a))
+        {
+            point = b[0];
+            return true;
+        }
+        return false;
+    }
+
+    struct NodePair
+    {
+        uint32_t pair; // index of the meshes pair.
+        uint32_t nodeA;
+        uint32_t nodeB;
+    };
+
+    struct Contact
+    {
+        FacePair faces;
+        Vec3d start;
+        Vec3d end;
+    };
+}
+
+bool IntersectTriangles(const Vec3d a[3], const Vec3d b[3], Vec3d& start, Vec3d& end)
+{
+    Vec3d normalA, normalB;
+    double da[3], db[3];
+    PlaneDistances(b, a, normalB, da);
+    if ((da[0] > 0.0 && da[1] > 0.0 && da[2] > 0.0) || (da[0] < 0.0 && da[1] < 0.0 && da[2] < 0.0))
+    {
+        return false;
+    }
+    PlaneDistances(a, b, normalA, db);
+    if ((db[0] > 0.0 && db[1] > 0.0 && db[2] > 0.0) || (db[0] < 0.0 && db[1] < 0.0 && db[2] < 0.0))
+    {
+        return false;
+    }
+    const Vec3d direction = CrossProduct(normalA, normalB);
+    if ((da[0] == 0.0 && da[1] == 0.0 && da[2] == 0.0) || (db[0] == 0.0 && db[1] == 0.0 && db[2] == 0.0) ||
+        DotProduct(direction, direction) == 0.0)
+    {
+        if (IntersectCoplanarTriangles(a, b, normalA, start))
+        {
+            end = start;
+            return true;
+        }
+        return false;
+    }
+
+    // both triangles cross the line shared by the planes, they intersect where their intervals
+    // on it overlap.
+    Vec3d firstA, lastA, firstB, lastB;
+    double firstTA, lastTA, firstTB, lastTB;
+    if (!PlaneCrossing(a, da, direction, firstA, lastA, firstTA, lastTA) ||
+        !PlaneCrossing(b, db, direction, firstB, lastB, firstTB, lastTB))
+    {
+        return false;
+    }
+    if (lastTA < firstTB || lastTB < firstTA)
+    {
+        return false;
+    }
+    start = firstTA > firstTB ? firstA : firstB;
+    end = lastTA < lastTB ? lastA : lastB;
+    return true;
+}
+
+template <typename Vec>
+std::vector<MeshesInterference> FindInterferences(const std::vector<BasicSurfaceMesh<Vec>>& meshes,
+                                                  const std::vector<MeshBVH>& bvhs)
+{
+    // broadphase, sweep and prune of the meshes boxes along X.
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < meshes.size(); ++i)
+    {
+        if (!bvhs[i].nodes.empty())
+        {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return bvhs[a].nodes[0].box.min.x < bvhs[b].nodes[0].box.min.x;
+    });
+    std::vector<MeshesInterference> pairs;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const BBox& box = bvhs[order[i]].nodes[0].box;
+        for (size_t j = i + 1; j < order.size() && bvhs[order[j]].nodes[0].box.min.x <= box.max.x; ++j)
+        {
+            if (BBoxesOverlap(box, bvhs[order[j]].nodes[0].box))
+            {
+                MeshesInterference pair;
+                pair.meshA = std::min(order[i], order[j]);
+                pair.meshB = std::max(order[i], order[j]);
+                pairs.push_back(pair);
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const MeshesInterference& a, const MeshesInterference& b)
+    {
+        return a.meshA < b.meshA || (a.meshA == b.meshA && a.meshB < b.meshB);
+    });
+
+    // a single pair of large meshes is as much work as many small ones, so the tasks are
+    // node pairs taken from the first levels of the traversals.
+    auto overlap = [&](const NodePair& p)
+    {
+        return BBoxesOverlap(bvhs[pairs[p.pair].meshA].nodes[p.nodeA].box,
+                             bvhs[pairs[p.pair].meshB].nodes[p.nodeB].box);
+    };
+    // descends the node with the largest box, returns false for two leaves.
+    auto split = [&](const NodePair& p, NodePair children[2])
+    {
+        const BVHNode& a = bvhs[pairs[p.pair].meshA].nodes[p.nodeA];
+        const BVHNode& b = bvhs[pairs[p.pair].meshB].nodes[p.nodeB];
+        if (a.count > 0 && b.count > 0)
+        {
+            return false;
+        }
+        const bool splitA = b.count > 0 || (a.count == 0 && BBoxArea(a.box) >= BBoxArea(b.box));
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            children[i] = p;
+            if (splitA)
+            {
+                children[i].nodeA = a.start + i;
+            }
+            else
+            {
+                children[i].nodeB = b.start + i;
+            }
+        }
+        return true;
+    };
+
+    std::vector<NodePair> tasks;
+    for (uint32_t i = 0; i < pairs.size(); ++i)
+    {
+        tasks.push_back(NodePair{ i, 0, 0 });
+    }
+    const size_t targetTasksCount = TASKS_PER_THREAD * GetThreadsCount();
+    bool expanded = true;
+    while (expanded && tasks.size() < targetTasksCount)
+    {
+        expanded = false;
+        std::vector<NodePair> next;
+        for (const NodePair& task : tasks)
+        {
+            NodePair children[2];
+            if (split(task, children))
+            {
+                expanded = true;
+                for (const NodePair& child : children)
+                {
+                    if (overlap(child))
+                    {
+                        next.push_back(child);
+                    }
+                }
+            }
+            else
+            {
+                next.push_back(task);
+            }
+        }
+        tasks.swap(next);
+    }
+
+    std::vector<std::vector<Contact>> tasksContacts(tasks.size());
+    ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t taskIndex = begin; taskIndex < end; ++taskIndex)
+        {
+            const NodePair& task = tasks[taskIndex];
+            const BasicSurfaceMesh<Vec>& meshA = meshes[pairs[task.pair].meshA];
+            const BasicSurfaceMesh<Vec>& meshB = meshes[pairs[task.pair].meshB];
+            const MeshBVH& bvhA = bvhs[pairs[task.pair].meshA];
+            const MeshBVH& bvhB = bvhs[pairs[task.pair].meshB];
+            std::vector<Contact>& contacts = tasksContacts[taskIndex];
+
+            NodePair stack[TRAVERSAL_STACK_SIZE];
+            size_t stackSize = 0;
+            stack[stackSize++] = task;
+            while (stackSize > 0)
+            {
+                const NodePair current = stack[--stackSize];
+                if (!overlap(current))
+                {
+                    continue;
+                }
+                NodePair children[2];
+                if (split(current, children))
+                {
+                    stack[stackSize++] = children[1];
+                    stack[stackSize++] = children[0];
+                    continue;
+                }
+                const BVHNode& leafA = bvhA.nodes[current.nodeA];
+                const BVHNode& leafB = bvhB.nodes[current.nodeB];
+                for (uint32_t i = leafA.start; i < leafA.start + leafA.count; ++i)
+                {
+                    const uint32_t faceA = bvhA.faces[i];
+                    const Triangle& ta = meshA.faces[faceA];
+                    const Vec3d a[3] =
+                    {
+                        privWiden(meshA.vertices[ta.idx[0]]), privWiden(meshA.vertices[ta.idx[1]]),
+                        privWiden(meshA.vertices[ta.idx[2]])
+                    };
+                    if (!BBoxesOverlap(TriangleBBox(a), leafB.box))
+                    {
+                        continue;
+                    }
+                    for (uint32_t j = leafB.start; j < leafB.start + leafB.count; ++j)
+                    {
+                        const uint32_t faceB = bvhB.faces[j];
+                        const Triangle& tb = meshB.faces[faceB];
+                        const Vec3d b[3] =
+                        {
+                            privWiden(meshB.vertices[tb.idx[0]]), privWiden(meshB.vertices[tb.idx[1]]),
+                            privWiden(meshB.vertices[tb.idx[2]])
+                        };
+                        Contact contact;
+                        if (IntersectTriangles(a, b, contact.start, contact.end))
+                        {
+                            contact.faces = FacePair{ faceA, faceB };
+                            contacts.push_back(contact);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // tasks are grouped by meshes pair and in a fixed order, the result doesn't depend on the threads.
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        MeshesInterference& pair = pairs[tasks[i].pair];
+        for (const Contact& contact : tasksContacts[i])
+        {
+            pair.faces.push_back(contact.faces);
+            pair.segments.push_back(contact.start);
+            pair.segments.push_back(contact.end);
+        }
+    }
+    pairs.erase(std::remove_if(pairs.begin(), pairs.end(), [](const MeshesInterference& p)
+    {
+        return p.faces.empty();
+    }), pairs.end());
+    return pairs;
+}
+
+template <typename Vec>
+std::vector<MeshesInterference> FindInterferences(const std::vector<BasicSurfaceMesh<Vec>>& meshes)
+{
+    std::vector<MeshBVH> bvhs(meshes.size());
+    ParallelFor(meshes.size(), 1, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            bvhs[i] = BuildMeshBVH(meshes[i]);
+        }
+    });
+    return FindInterferences(meshes, bvhs);
+}
+
+template std::vector<MeshesInterference> FindInterferences(const std::vector<SurfaceMesh>& meshes,
+                                                           const std::vector<MeshBVH>& bvhs);
+template std::vector<MeshesInterference> FindInterferences(const std::vector<SurfaceMeshF>& meshes,
+                                                           const std::vector<MeshBVH>& bvhs);
+template std::vector<MeshesInterference> FindInterferences(const std::vector<SurfaceMesh>& meshes);
+template std::vector<MeshesInterference> FindInterferences(const std::vector<SurfaceMeshF>& meshes);
@@ -0,0 +1,239 @@
+#include "Resha.h"
+
+#include <atomic>
+#include <string>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+
+    // lock-free union-find. a root is always linked below a smaller root, so the root of a set
+    // is its smallest element whatever the order the threads merged it in.
+    struct ConcurrentDisjointSets
+    {
+        std::vector<std::atomic<uint32_t>> parents;
+
+        explicit ConcurrentDisjointSets(size_t count)
+            : parents(count)
+        {
+            ParallelFor(count, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    parents[i].store(uint32_t(i), std::memory_order_relaxed);
+                }
+            });
+        }
+
+        uint32_t Find(uint32_t x)
+        {
+            while (true)
+            {
+                uint32_t parent = parents[x].load(std::memory_order_relaxed);
+                if (parent == x)
+                {
+                    return x;
+                }
+                const uint32_t grandParent = parents[parent].load(std::memory_order_relaxed);
+                // path halving, losing the race only leaves the path longer.
+                if (grandParent != parent)
+                {
+                    parents[x].compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+                }
+                x = grandParent;
+            }
+        }
+
+        void Unite(uint32_t a, uint32_t b)
+        {
+            while (true)
+            {
+                a = Find(a);
+                b = Find(b);
+                if (a == b)
+                {
+                    return;
+                }
+                if (a < b)
+                {
+                    std::swap(a, b);
+                }
+                // fails when another thread linked a meanwhile, start again from the new roots.
+                uint32_t expected = a;
+                if (parents[a].compare_exchange_strong(expected, b))
+                {
+                    return;
+                }
+            }
+        }
+    };
+
+    template <typename Vec>
+    double TriangleArea(const BasicSurfaceMesh<Vec>& mesh, const Triangle& t)
+    {
+        const Vec3d a = privWiden(mesh.vertices[t.idx[0]]);
+        return 0.5 * Length(CrossProduct(privWiden(mesh.vertices[t.idx[1]]) - a, privWiden(mesh.vertices[t.idx[2]]) - a));
+    }
+}
+
+template <typename Vec>
+MeshComponents LabelMeshComponents(const BasicSurfaceMesh<Vec>& mesh)
+{
+    MeshComponents result;
+    const size_t verticesCount = mesh.vertices.size();
+    const size_t facesCount = mesh.faces.size();
+    ConcurrentDisjointSets sets(verticesCount);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            sets.Unite(t.idx[0], t.idx[1]);
+            sets.Unite(t.idx[0], t.idx[2]);
+        }
+    });
+
+    // every root used by a face starts a component, numbered in vertex order.
+    std::vector<std::atomic<uint8_t>> used(verticesCount);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            used[sets.Find(mesh.faces[i].idx[0])].store(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint32_t> labels(verticesCount, UINT32_MAX);
+    uint32_t componentsCount = 0;
+    for (size_t i = 0; i < verticesCount; ++i)
+    {
+        if (used[i].load(std::memory_order_relaxed))
+        {
+            labels[i] = componentsCount++;
+        }
+    }
+
+    result.faceComponents.resize(facesCount);
+    std::vector<double> areas(facesCount);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            result.faceComponents[i] = labels[sets.Find(mesh.faces[i].idx[0])];
+            areas[i] = TriangleArea(mesh, mesh.faces[i]);
+        }
+    });
+    // summed in face order so the areas don't depend on the threads.
+    result.facesCounts.assign(componentsCount, 0);
+    result.areas.assign(componentsCount, 0.0);
+    for (size_t i = 0; i < facesCount; ++i)
+    {
+        result.facesCounts[result.faceComponents[i]]++;
+        result.areas[result.faceComponents[i]] += areas[i];
+    }
+    return result;
+}
+
+template MeshComponents LabelMeshComponents(const SurfaceMesh& mesh);
+template MeshComponents LabelMeshComponents(const SurfaceMeshF& mesh);
+
+template <typename Vec>
+std::vector<BasicSurfaceMesh<Vec>> SplitMeshComponents(const BasicSurfaceMesh<Vec>& mesh, const MeshComponents& components)
+{
+    const size_t componentsCount = components.facesCounts.size();
+    std::vector<BasicSurfaceMesh<Vec>> result(componentsCount);
+    std::vector<uint32_t> order;
+    RadixSortIndices(components.faceComponents, order);
+    std::vector<size_t> starts(componentsCount + 1, 0);
+    for (size_t i = 0; i < componentsCount; ++i)
+    {
+        starts[i + 1] = starts[i] + components.facesCounts[i];
+    }
+
+    // a vertex belongs to a single component, the parts can fill the remap concurrently.
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    ParallelFor(componentsCount, 1, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t c = begin; c < end; ++c)
+        {
+            BasicSurfaceMesh<Vec>& part = result[c];
+            part.faces.reserve(starts[c + 1] - starts[c]);
+            for (size_t i = starts[c]; i < starts[c + 1]; ++i)
+            {
+                Triangle t = mesh.faces[order[i]];
+                for (uint32_t& v : t.idx)
+                {
+                    if (remap[v] == UINT32_MAX)
+                    {
+                        remap[v] = uint32_t(part.vertices.size());
+                        part.vertices.push_back(mesh.vertices[v]);
+                    }
+                    v = remap[v];
+                }
+                part.faces.push_back(t);
+            }
+        }
+    });
+    for (size_t c = 0; c < componentsCount; ++c)
+    {
+        result[c].name = mesh.name + "_" + std::to_string(c + 1);
+        result[c].color = GenerateColor();
+        result[c].visible = mesh.visible;
+        result[c].id = GenerateUUID();
+    }
+    return result;
+}
+
+template std::vector<SurfaceMesh> SplitMeshComponents(const SurfaceMesh& mesh, const MeshComponents& components);
+template std::vector<SurfaceMeshF> SplitMeshComponents(const SurfaceMeshF& mesh, const MeshComponents& components);
+
+template <typename Vec>
+BasicSurfaceMesh<Vec> RemoveSmallComponents(const BasicSurfaceMesh<Vec>& mesh, const MeshComponents& components,
+                                            size_t minFacesCount, double minArea)
+{
+    std::vector<bool> keep(components.facesCounts.size());
+    for (size_t c = 0; c < keep.size(); ++c)
+    {
+        keep[c] = components.facesCounts[c] >= minFacesCount && components.areas[c] >= minArea;
+    }
+
+    BasicSurfaceMesh<Vec> result;
+    std::vector<bool> used(mesh.vertices.size(), false);
+    for (size_t i = 0; i < mesh.faces.size(); ++i)
+    {
+        if (keep[components.faceComponents[i]])
+        {
+            result.faces.push_back(mesh.faces[i]);
+            for (uint32_t v : mesh.faces[i].idx)
+            {
+                used[v] = true;
+            }
+        }
+    }
+    // the kept vertices stay in their original order.
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        if (used[i])
+        {
+            remap[i] = uint32_t(result.vertices.size());
+            result.vertices.push_back(mesh.vertices[i]);
+        }
+    }
+    for (Triangle& t : result.faces)
+    {
+        for (uint32_t& v : t.idx)
+        {
+            v = remap[v];
+        }
+    }
+    result.name = mesh.name;
+    result.color = mesh.color;
+    result.visible = mesh.visible;
+    result.id = GenerateUUID();
+    return result;
+}
+
+template SurfaceMesh RemoveSmallComponents(const SurfaceMesh& mesh, const MeshComponents& components,
+                                           size_t minFacesCount, double minArea);
+template SurfaceMeshF RemoveSmallComponents(const SurfaceMeshF& mesh, const MeshComponents& components,
+                                            size_t minFacesCount, double minArea);
@@ -0,0 +1,487 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    // below this many points a conflict list is redistributed on the calling thread.
+    constexpr size_t PARALLEL_POINTS_COUNT = 64 * 1024;
+    // relative to the extent of the points. nearly coplanar points tilt the faces through them more
+    // than rounding alone, the points this close to a face are taken as on it.
+    constexpr double HULL_EPSILON = 1e-10;
+
+    struct HullFace
+    {
+        uint32_t v[3];
+        // face across the edge v[i] -> v[(i + 1) % 3].
+        uint32_t neighbours[3] = { UINT32_MAX, UINT32_MAX, UINT32_MAX };
+        Vec3d normal;           // unit, pointing out of the hull.
+        double offset;
+        std::vector<uint32_t> outside; // points in front of the face, not yet on the hull.
+        uint32_t furthest = UINT32_MAX;
+        bool alive = true;
+        bool visible = false;
+    };
+
+    // written out per coordinate, this is evaluated for every candidate against every new face.
+    inline double Distance(const HullFace& face, const Vec3d& p)
+    {
+        return face.normal.x * p.x + face.normal.y * p.y + face.normal.z * p.z - face.offset;
+    }
+
+    struct Quickhull
+    {
+        const std::vector<Vec3d>& points;
+        double epsilon;
+        std::vector<HullFace> faces;
+        // rounding can put a vertex of the hull in front of a face, adding it twice would pinch
+        // the hull.
+        std::vector<bool> isVertex;
+
+        Quickhull(const std::vector<Vec3d>& points, double epsilon)
+            : points(points), epsilon(epsilon), isVertex(points.size(), false)
+        {
+        }
+
+        // false when the face has no area.
+        bool AddFace(uint32_t a, uint32_t b, uint32_t c)
+        {
+            HullFace face;
+            face.v[0] = a;
+            face.v[1] = b;
+            face.v[2] = c;
+            isVertex[a] = isVertex[b] = isVertex[c] = true;
+            // the normal from the two shortest edges and the plane through the centre of the face
+            // are the least sensitive to rounding on thin faces.
+            const Vec3d& pa = points[a];
+            const Vec3d& pb = points[b];
+            const Vec3d& pc = points[c];
+            const Vec3d ab = pb - pa, bc = pc - pb, ca = pa - pc;
+            const double lab = DotProduct(ab, ab), lbc = DotProduct(bc, bc), lca = DotProduct(ca, ca);
+            Vec3d n;
+            if (lab >= lbc && lab >= lca)
+            {
+                n = CrossProduct(bc, ca);
+            }
+            else if (lbc >= lca)
+            {
+                n = CrossProduct(ca, ab);
+            }
+            else
+            {
+                n = CrossProduct(ab, bc);
+            }
+            const double length = Length(n);
+            face.normal = length > 0.0 ? n * (1.0 / length) : Vec3d{ 0.0, 0.0, 0.0 };
+            face.offset = DotProduct(face.normal, (pa + pb + pc) * (1.0 / 3.0));
+            faces.push_back(std::move(face));
+            return length > 0.0;
+        }
+
+        // moves every candidate to the new face it is furthest in front of, the points in front
+        // of none of them are inside the hull and dropped. the distances are evaluated on all
+        // the threads for large lists, the lists are filled in candidate order either way.
+        void Distribute(const std::vector<uint32_t>& candidates, uint32_t firstFace)
+        {
+            const uint32_t facesCount = uint32_t(faces.size()) - firstFace;
+            // the planes packed together, the faces themselves are too large to stream through.
+            std::vector<double> planes(facesCount * 4);
+            for (uint32_t f = 0; f < facesCount; ++f)
+            {
+                const HullFace& face = faces[firstFace + f];
+                planes[f * 4 + 0] = face.normal.x;
+                planes[f * 4 + 1] = face.normal.y;
+                planes[f * 4 + 2] = face.normal.z;
+                planes[f * 4 + 3] = face.offset;
+            }
+            std::vector<uint32_t> targets(candidates.size());
+            auto assign = [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Vec3d& p = points[candidates[i]];
+                    double best = epsilon;
+                    targets[i] = UINT32_MAX;
+                    if (isVertex[candidates[i]])
+                    {
+                        continue;
+                    }
+                    for (uint32_t f = 0; f < facesCount; ++f)
+                    {
+                        const double* plane = planes.data() + f * 4;
+                        const double d = plane[0] * p.x + plane[1] * p.y + plane[2] * p.z - plane[3];
+                        if (d > best)
+                        {
+                            best = d;
+                            targets[i] = firstFace + f;
+                        }
+                    }
+                }
+            };
+            if (candidates.size() < PARALLEL_POINTS_COUNT)
+            {
+                assign(0, candidates.size(), 0);
+            }
+            else
+            {
+                ParallelFor(candidates.size(), GRAIN_SIZE, assign);
+            }
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                if (targets[i] != UINT32_MAX)
+                {
+                    faces[targets[i]].outside.push_back(candidates[i]);
+                }
+            }
+            for (uint32_t f = firstFace; f < faces.size(); ++f)
+            {
+                HullFace& face = faces[f];
+                double best = -DBL_MAX;
+                for (uint32_t p : face.outside)
+                {
+                    const double d = Distance(face, points[p]);
+                    if (d > best)
+                    {
+                        best = d;
+                        face.furthest = p;
+                    }
+                }
+            }
+        }
+
+        // replaces the faces the furthest point of face can see by a cone from that point.
+        void AddPoint(uint32_t start)
+        {
+            const uint32_t eye = faces[start].furthest;
+            const Vec3d& p = points[eye];
+            std::vector<uint32_t> visible{ start };
+            faces[start].visible = true;
+            for (size_t i = 0; i < visible.size(); ++i)
+            {
+                for (uint32_t n : faces[visible[i]].neighbours)
+                {
+                    if (!faces[n].visible && Distance(faces[n], p) > epsilon)
+                    {
+                        faces[n].visible = true;
+                        visible.push_back(n);
+                    }
+                }
+            }
+
+            // one new face per horizon edge, linked to the face behind the edge.
+            const uint32_t firstFace = uint32_t(faces.size());
+            std::vector<std::pair<uint32_t, uint32_t>> starts; // start vertex of a horizon edge and its face.
+            for (uint32_t f : visible)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    const uint32_t behind = faces[f].neighbours[e];
+                    if (faces[behind].visible)
+                    {
+                        continue;
+                    }
+                    const uint32_t a = faces[f].v[e];
+                    const uint32_t b = faces[f].v[(e + 1) % 3];
+                    const uint32_t face = uint32_t(faces.size());
+                    AddFace(a, b, eye);
+                    faces[face].neighbours[0] = behind;
+                    for (uint32_t& n : faces[behind].neighbours)
+                    {
+                        if (n == f)
+                        {
+                            n = face;
+                        }
+                    }
+                    starts.push_back({ a, face });
+                }
+            }
+            // the horizon is a loop, the face after (a, b, eye) is the one starting at b.
+            std::sort(starts.begin(), starts.end());
+            auto faceStartingAt = [&](uint32_t v)
+            {
+                return std::lower_bound(starts.begin(), starts.end(), std::make_pair(v, 0u))->second;
+            };
+            for (const auto& start : starts)
+            {
+                HullFace& face = faces[start.second];
+                const uint32_t next = faceStartingAt(face.v[1]);
+                face.neighbours[1] = next;
+                faces[next].neighbours[2] = start.second;
+            }
+
+            std::vector<uint32_t> candidates;
+            for (uint32_t f : visible)
+            {
+                HullFace& face = faces[f];
+                face.alive = false;
+                for (uint32_t point : face.outside)
+                {
+                    if (point != eye)
+                    {
+                        candidates.push_back(point);
+                    }
+                }
+                face.outside = std::vector<uint32_t>();
+            }
+            Distribute(candidates, firstFace);
+        }
+
+        // adds the furthest points of the faces with points in front of them until there are none.
+        void Expand()
+        {
+            for (uint32_t f = 0; f < faces.size(); ++f)
+            {
+                if (faces[f].alive && !faces[f].outside.empty())
+                {
+                    AddPoint(f);
+                }
+            }
+        }
+
+        // drops the faces that are no longer on the hull.
+        void Compact()
+        {
+            std::vector<uint32_t> remap(faces.size(), UINT32_MAX);
+            uint32_t count = 0;
+            for (uint32_t f = 0; f < faces.size(); ++f)
+            {
+                if (faces[f].alive)
+                {
+                    remap[f] = count++;
+                }
+            }
+            for (uint32_t f = 0; f < faces.size(); ++f)
+            {
+                if (faces[f].alive)
+                {
+                    for (uint32_t& n : faces[f].neighbours)
+                    {
+                        n = remap[n];
+                    }
+                    if (remap[f] != f)
+                    {
+                        faces[remap[f]] = std::move(faces[f]);
+                    }
+                }
+            }
+            faces.resize(count);
+        }
+    };
+
+    // directions to the neighbours of a cube cell, one of each opposite pair. they don't need to
+    // be unit to find the extreme points along them.
+    constexpr int DIRECTIONS_COUNT = 13;
+    const double DIRECTIONS[DIRECTIONS_COUNT][3] =
+    {
+        { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 0 }, { 1, -1, 0 }, { 0, 1, 1 }, { 0, 1, -1 },
+        { 1, 0, 1 }, { -1, 0, 1 }, { 1, 1, 1 }, { 1, 1, -1 }, { 1, -1, 1 }, { -1, 1, 1 }
+    };
+}
+
+SurfaceMesh CalculateConvexHull(const std::vector<Vec3d>& points)
+{
+    SurfaceMesh result;
+    const size_t pointsCount = points.size();
+    if (pointsCount < 4)
+    {
+        return result;
+    }
+
+    // extreme points along both ways of every direction, the smallest index wins the ties.
+    const size_t chunksCount = (pointsCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<uint32_t> chunkExtremes(chunksCount * DIRECTIONS_COUNT * 2);
+    auto project = [&](uint32_t i, int d)
+    {
+        return DIRECTIONS[d][0] * points[i].x + DIRECTIONS[d][1] * points[i].y + DIRECTIONS[d][2] * points[i].z;
+    };
+    ParallelFor(pointsCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint32_t* extremes = chunkExtremes.data() + (begin / GRAIN_SIZE) * DIRECTIONS_COUNT * 2;
+        double low[DIRECTIONS_COUNT], high[DIRECTIONS_COUNT];
+        for (int d = 0; d < DIRECTIONS_COUNT; ++d)
+        {
+            extremes[d * 2] = extremes[d * 2 + 1] = uint32_t(begin);
+            low[d] = high[d] = project(uint32_t(begin), d);
+        }
+        for (size_t i = begin + 1; i < end; ++i)
+        {
+            for (int d = 0; d < DIRECTIONS_COUNT; ++d)
+            {
+                const double value = project(uint32_t(i), d);
+                if (value < low[d]) { low[d] = value; extremes[d * 2] = uint32_t(i); }
+                if (value > high[d]) { high[d] = value; extremes[d * 2 + 1] = uint32_t(i); }
+            }
+        }
+    });
+    std::vector<uint32_t> seeds(chunkExtremes.begin(), chunkExtremes.begin() + DIRECTIONS_COUNT * 2);
+    for (size_t c = 1; c < chunksCount; ++c)
+    {
+        for (int d = 0; d < DIRECTIONS_COUNT; ++d)
+        {
+            const uint32_t low = chunkExtremes[(c * DIRECTIONS_COUNT + d) * 2];
+            const uint32_t high = chunkExtremes[(c * DIRECTIONS_COUNT + d) * 2 + 1];
+            if (project(low, d) < project(seeds[d * 2], d)) seeds[d * 2] = low;
+            if (project(high, d) > project(seeds[d * 2 + 1], d)) seeds[d * 2 + 1] = high;
+        }
+    }
+    // the first three directions are the axes.
+    double scale = 0.0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        scale += std::max(fabs(points[seeds[axis * 2]].data[axis]), fabs(points[seeds[axis * 2 + 1]].data[axis]));
+    }
+    const double epsilon = HULL_EPSILON * scale;
+    std::sort(seeds.begin(), seeds.end());
+    seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+
+    // initial tetrahedron: the most distant extremes, the extreme furthest from their line and
+    // the point furthest from the plane of the three, an extreme when there is one off the plane.
+    uint32_t simplex[4] = { seeds[0], seeds[0], seeds[0], 0 };
+    double best = -1.0;
+    for (size_t i = 0; i < seeds.size(); ++i)
+    {
+        for (size_t j = i + 1; j < seeds.size(); ++j)
+        {
+            const Vec3d d = points[seeds[j]] - points[seeds[i]];
+            if (DotProduct(d, d) > best)
+            {
+                best = DotProduct(d, d);
+                simplex[0] = seeds[i];
+                simplex[1] = seeds[j];
+            }
+        }
+    }
+    const Vec3d axis = points[simplex[1]] - points[simplex[0]];
+    best = 0.0;
+    for (uint32_t e : seeds)
+    {
+        const double d = Length(CrossProduct(axis, points[e] - points[simplex[0]]));
+        if (d > best)
+        {
+            best = d;
+            simplex[2] = e;
+        }
+    }
+    if (best <= epsilon * Length(axis))
+    {
+        return result;
+    }
+    const Vec3d n = Normalised(CrossProduct(axis, points[simplex[2]] - points[simplex[0]]));
+    const double planeOffset = DotProduct(n, points[simplex[0]]);
+    auto furthestFromPlane = [&](const uint32_t* indices, size_t count, double& best)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vec3d& p = points[indices ? indices[i] : i];
+            const double d = fabs(n.x * p.x + n.y * p.y + n.z * p.z - planeOffset);
+            if (d > best)
+            {
+                best = d;
+                simplex[3] = indices ? indices[i] : uint32_t(i);
+            }
+        }
+    };
+    best = 0.0;
+    furthestFromPlane(seeds.data(), seeds.size(), best);
+    if (best <= epsilon)
+    {
+        // the extremes can be flat while the points aren't, when the points are off the plane
+        // along none of the directions.
+        furthestFromPlane(nullptr, pointsCount, best);
+        seeds.push_back(simplex[3]);
+    }
+    if (best <= epsilon)
+    {
+        return result;
+    }
+    if (DotProduct(n, points[simplex[3]]) - planeOffset > 0.0)
+    {
+        std::swap(simplex[0], simplex[1]);
+    }
+
+    Quickhull hull(points, epsilon);
+    // the apex is behind (s0, s1, s2), every face is seen counter clockwise from outside.
+    hull.AddFace(simplex[0], simplex[1], simplex[2]);
+    hull.AddFace(simplex[1], simplex[0], simplex[3]);
+    hull.AddFace(simplex[2], simplex[1], simplex[3]);
+    hull.AddFace(simplex[0], simplex[2], simplex[3]);
+    static const uint32_t TETRAHEDRON_NEIGHBOURS[4][3] = { { 1, 2, 3 }, { 0, 3, 2 }, { 0, 1, 3 }, { 0, 2, 1 } };
+    for (int f = 0; f < 4; ++f)
+    {
+        std::copy(TETRAHEDRON_NEIGHBOURS[f], TETRAHEDRON_NEIGHBOURS[f] + 3, hull.faces[f].neighbours);
+    }
+    // the hull of the extremes already encloses most of the points, distributing them over its
+    // faces at once drops those and saves splitting the lists of the tetrahedron step by step.
+    hull.Distribute(seeds, 0);
+    hull.Expand();
+    hull.Compact();
+    // the points inside the largest ball around the centre of the extremes that fits in their
+    // hull are dropped with a single test.
+    Vec3d centre{ 0.0, 0.0, 0.0 };
+    for (uint32_t e : seeds)
+    {
+        centre = centre + points[e] * (1.0 / double(seeds.size()));
+    }
+    double radius = DBL_MAX;
+    for (const HullFace& face : hull.faces)
+    {
+        radius = std::min(radius, face.offset - DotProduct(face.normal, centre) - epsilon);
+    }
+    const double squaredRadius = radius > 0.0 ? radius * radius : 0.0;
+    std::vector<std::vector<uint32_t>> chunkCandidates(chunksCount);
+    ParallelFor(pointsCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t>& candidates = chunkCandidates[begin / GRAIN_SIZE];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const double x = points[i].x - centre.x, y = points[i].y - centre.y, z = points[i].z - centre.z;
+            if (x * x + y * y + z * z >= squaredRadius)
+            {
+                candidates.push_back(uint32_t(i));
+            }
+        }
+    });
+    std::vector<uint32_t> candidates;
+    for (const std::vector<uint32_t>& chunk : chunkCandidates)
+    {
+        candidates.insert(candidates.end(), chunk.begin(), chunk.end());
+    }
+    chunkCandidates = std::vector<std::vector<uint32_t>>();
+    hull.Distribute(candidates, 0);
+    candidates = std::vector<uint32_t>();
+    hull.Expand();
+
+    // only the vertices of the hull are kept, in the order of the input points.
+    std::vector<uint32_t> remap(pointsCount, UINT32_MAX);
+    for (const HullFace& face : hull.faces)
+    {
+        if (face.alive)
+        {
+            for (uint32_t v : face.v)
+            {
+                remap[v] = 0;
+            }
+        }
+    }
+    for (size_t i = 0; i < pointsCount; ++i)
+    {
+        if (remap[i] != UINT32_MAX)
+        {
+            remap[i] = uint32_t(result.vertices.size());
+            result.vertices.push_back(points[i]);
+        }
+    }
+    for (const HullFace& face : hull.faces)
+    {
+        if (face.alive)
+        {
+            result.faces.push_back(Triangle{ { remap[face.v[0]], remap[face.v[1]], remap[face.v[2]] } });
+        }
+    }
+    result.color = GenerateColor();
+    result.id = GenerateUUID();
+    return result;
+}
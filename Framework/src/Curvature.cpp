@@ -0,0 +1,87 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 16 * 1024;
+}
+
+template <typename Vec>
+VertexCurvatures CalculateCurvatures(const BasicSurfaceMesh<Vec>& mesh, const VertexRings& rings)
+{
+    VertexCurvatures result;
+    const size_t verticesCount = mesh.vertices.size();
+    result.mean.assign(verticesCount, 0.0);
+    result.gaussian.assign(verticesCount, 0.0);
+    result.minPrincipal.assign(verticesCount, 0.0);
+    result.maxPrincipal.assign(verticesCount, 0.0);
+    ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            const Vec3d p = privWiden(mesh.vertices[v]);
+            // mean curvature normal from the cotangent Laplacian over the mixed Voronoi area (Meyer et al. 2003).
+            Vec3d laplacian{ 0.0, 0.0, 0.0 };
+            Vec3d normal{ 0.0, 0.0, 0.0 };
+            double area = 0.0;
+            double angles = 0.0;
+            for (uint32_t i = rings.faceOffsets[v]; i < rings.faceOffsets[v + 1]; ++i)
+            {
+                const Triangle& t = mesh.faces[rings.faces[i]];
+                const int corner = t.idx[0] == v ? 0 : (t.idx[1] == v ? 1 : 2);
+                const Vec3d pq = privWiden(mesh.vertices[t.idx[(corner + 1) % 3]]) - p;
+                const Vec3d pr = privWiden(mesh.vertices[t.idx[(corner + 2) % 3]]) - p;
+                const Vec3d qr = pr - pq;
+                const Vec3d faceNormal = CrossProduct(pq, pr);
+                // all the angles of the face share the sine part, |pq x pr|.
+                const double doubleArea = Length(faceNormal);
+                if (doubleArea == 0.0)
+                {
+                    continue;
+                }
+                const double cotQ = -DotProduct(pq, qr) / doubleArea;
+                const double cotR = DotProduct(pr, qr) / doubleArea;
+                const double cosP = DotProduct(pq, pr);
+                laplacian = laplacian - pq * cotR - pr * cotQ;
+                normal = normal + faceNormal;
+                angles += atan2(doubleArea, cosP);
+                if (cosP < 0.0)
+                {
+                    area += doubleArea / 4;
+                }
+                else if (cotQ < 0.0 || cotR < 0.0)
+                {
+                    area += doubleArea / 8;
+                }
+                else
+                {
+                    area += (DotProduct(pq, pq) * cotR + DotProduct(pr, pr) * cotQ) / 8;
+                }
+            }
+            if (area == 0.0)
+            {
+                continue;
+            }
+            const double normalLength = Length(normal);
+            const double mean = normalLength > 0.0 ? DotProduct(laplacian, normal) / (4.0 * area * normalLength) : 0.0;
+            // a boundary vertex has more neighbours than faces and its angle deficit is measured
+            // against a half plane.
+            const uint32_t facesCount = rings.faceOffsets[v + 1] - rings.faceOffsets[v];
+            const uint32_t neighboursCount = rings.vertexOffsets[v + 1] - rings.vertexOffsets[v];
+            const double fullAngle = neighboursCount > facesCount ? PI : 2.0 * PI;
+            const double gaussian = (fullAngle - angles) / area;
+            const double spread = sqrt(std::max(mean * mean - gaussian, 0.0));
+            result.mean[v] = mean;
+            result.gaussian[v] = gaussian;
+            result.minPrincipal[v] = mean - spread;
+            result.maxPrincipal[v] = mean + spread;
+        }
+    });
+    return result;
+}
+
+template VertexCurvatures CalculateCurvatures(const SurfaceMesh& mesh, const VertexRings& rings);
+template VertexCurvatures CalculateCurvatures(const SurfaceMeshF& mesh, const VertexRings& rings);
@@ -0,0 +1,667 @@
+#include "Resha.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 16 * 1024;
+    // boundary constraint planes are weighted more than the faces planes so open edges keep their shape.
+    constexpr double BOUNDARY_WEIGHT = 10.0;
+    // a collapse is rejected when it rotates an adjacent face normal by more than ~78 degrees.
+    constexpr double MIN_NORMAL_COSINE = 0.2;
+    // many candidates get blocked by the collapses of their neighbours, so each round accepts
+    // errors a bit larger than the one of the last collapse needed to reach the target.
+    constexpr double ROUND_ERROR_SLACK = 1.5;
+
+    // Symmetric 4x4 matrix of the sum of the squared distances to a set of planes.
+    struct Quadric
+    {
+        double a2, ab, ac, ad;
+        double b2, bc, bd;
+        double c2, cd;
+        double d2;
+        double weight;
+    };
+
+    Quadric PlaneQuadric(const Vec3d& n, double d, double weight)
+    {
+        Quadric q;
+        q.a2 = weight * n.x * n.x;
+        q.ab = weight * n.x * n.y;
+        q.ac = weight * n.x * n.z;
+        q.ad = weight * n.x * d;
+        q.b2 = weight * n.y * n.y;
+        q.bc = weight * n.y * n.z;
+        q.bd = weight * n.y * d;
+        q.c2 = weight * n.z * n.z;
+        q.cd = weight * n.z * d;
+        q.d2 = weight * d * d;
+        q.weight = weight;
+        return q;
+    }
+
+    void AddQuadric(Quadric& a, const Quadric& b)
+    {
+        a.a2 += b.a2; a.ab += b.ab; a.ac += b.ac; a.ad += b.ad;
+        a.b2 += b.b2; a.bc += b.bc; a.bd += b.bd;
+        a.c2 += b.c2; a.cd += b.cd;
+        a.d2 += b.d2;
+        a.weight += b.weight;
+    }
+
+    // mean squared distance of p to the planes of the quadric.
+    double QuadricError(const Quadric& q, const Vec3d& p)
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z + 2 * q.ad * x +
+            q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y +
+            q.c2 * z * z + 2 * q.cd * z +
+            q.d2;
+        return q.weight > 0.0 ? std::max(0.0, e) / q.weight : 0.0;
+    }
+
+    // position minimising the quadric, returns false when the system is close to singular.
+    bool QuadricOptimum(const Quadric& q, Vec3d& result)
+    {
+        const double det = q.a2 * (q.b2 * q.c2 - q.bc * q.bc) -
+            q.ab * (q.ab * q.c2 - q.bc * q.ac) +
+            q.ac * (q.ab * q.bc - q.b2 * q.ac);
+        const double scale = q.a2 * q.b2 * q.c2;
+        if (fabs(det) <= 1e-6 * fabs(scale) || det == 0.0)
+        {
+            return false;
+        }
+        const double inv = 1.0 / det;
+        const Vec3d b{ -q.ad, -q.bd, -q.cd };
+        result.x = inv * (b.x * (q.b2 * q.c2 - q.bc * q.bc) -
+                          q.ab * (b.y * q.c2 - q.bc * b.z) +
+                          q.ac * (b.y * q.bc - q.b2 * b.z));
+        result.y = inv * (q.a2 * (b.y * q.c2 - q.bc * b.z) -
+                          b.x * (q.ab * q.c2 - q.bc * q.ac) +
+                          q.ac * (q.ab * b.z - b.y * q.ac));
+        result.z = inv * (q.a2 * (q.b2 * b.z - b.y * q.bc) -
+                          q.ab * (q.ab * b.z - b.y * q.ac) +
+                          b.x * (q.ab * q.bc - q.b2 * q.ac));
+        return true;
+    }
+
+    // vertex -> faces adjacency stored as compressed rows.
+    struct VertexFaces
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> faces;
+    };
+
+    void BuildVertexFaces(const std::vector<Triangle>& faces, size_t verticesCount, VertexFaces& result)
+    {
+        result.offsets.assign(verticesCount + 1, 0);
+        for (const Triangle& t : faces)
+        {
+            result.offsets[t.idx[0] + 1]++;
+            result.offsets[t.idx[1] + 1]++;
+            result.offsets[t.idx[2] + 1]++;
+        }
+        for (size_t i = 0; i < verticesCount; ++i)
+        {
+            result.offsets[i + 1] += result.offsets[i];
+        }
+        result.faces.resize(3 * faces.size());
+        std::vector<uint32_t> cursor(result.offsets.begin(), result.offsets.end() - 1);
+        for (size_t i = 0; i < faces.size(); ++i)
+        {
+            const Triangle& t = faces[i];
+            result.faces[cursor[t.idx[0]]++] = i;
+            result.faces[cursor[t.idx[1]]++] = i;
+            result.faces[cursor[t.idx[2]]++] = i;
+        }
+    }
+
+    bool HasVertex(const Triangle& t, uint32_t v)
+    {
+        return t.idx[0] == v || t.idx[1] == v || t.idx[2] == v;
+    }
+
+    // number of faces sharing the edge (a, b).
+    size_t EdgeFacesCount(const std::vector<Triangle>& faces, const VertexFaces& adjacency, uint32_t a, uint32_t b)
+    {
+        size_t count = 0;
+        for (uint32_t i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; ++i)
+        {
+            count += HasVertex(faces[adjacency.faces[i]], b);
+        }
+        return count;
+    }
+
+    struct Collapse
+    {
+        uint32_t a; // vertex that is kept.
+        uint32_t b; // vertex that is removed.
+    };
+
+    uint32_t FloatKey(float v)
+    {
+        // costs are never negative, the bits of a positive float sort like the float.
+        uint32_t key;
+        memcpy(&key, &v, sizeof(key));
+        return key;
+    }
+
+    struct Decimator
+    {
+        const DecimationOptions& options;
+        std::vector<Vec3d> positions;
+        std::vector<Triangle> faces;
+        std::vector<Quadric> quadrics;
+        std::vector<uint8_t> boundary;
+        VertexFaces adjacency;
+        double maxError = 0.0;
+
+        explicit Decimator(const DecimationOptions& options) : options(options)
+        {
+        }
+
+        void For(size_t count, const std::function<void(size_t, size_t, size_t)>& func) const
+        {
+            if (options.parallel)
+            {
+                ParallelFor(count, GRAIN_SIZE, func);
+                return;
+            }
+            for (size_t begin = 0; begin < count; begin += GRAIN_SIZE)
+            {
+                func(begin, std::min(count, begin + GRAIN_SIZE), 0);
+            }
+        }
+
+        void UpdateBoundary()
+        {
+            boundary.resize(positions.size());
+            For(positions.size(), [&](size_t begin, size_t end, size_t)
+            {
+                // in a closed fan every neighbour is seen from two faces, a neighbour seen
+                // only once is the end of an open edge.
+                std::vector<uint32_t> ring;
+                for (size_t v = begin; v < end; ++v)
+                {
+                    ring.clear();
+                    for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                    {
+                        const Triangle& t = faces[adjacency.faces[i]];
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            if (t.idx[k] != v) ring.push_back(t.idx[k]);
+                        }
+                    }
+                    std::sort(ring.begin(), ring.end());
+                    uint8_t isBoundary = 0;
+                    for (size_t i = 0; i < ring.size() && !isBoundary;)
+                    {
+                        size_t j = i + 1;
+                        while (j < ring.size() && ring[j] == ring[i]) ++j;
+                        isBoundary = (j - i) == 1;
+                        i = j;
+                    }
+                    boundary[v] = isBoundary;
+                }
+            });
+        }
+
+        // removes the vertices that are no longer referenced by any face.
+        void CompactVertices()
+        {
+            std::vector<uint32_t> newIndex(positions.size(), 0);
+            for (const Triangle& t : faces)
+            {
+                newIndex[t.idx[0]] = newIndex[t.idx[1]] = newIndex[t.idx[2]] = 1;
+            }
+            size_t count = 0;
+            for (size_t i = 0; i < positions.size(); ++i)
+            {
+                if (newIndex[i])
+                {
+                    newIndex[i] = count;
+                    positions[count] = positions[i];
+                    quadrics[count] = quadrics[i];
+                    count++;
+                }
+            }
+            positions.resize(count);
+            quadrics.resize(count);
+            For(faces.size(), [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    Triangle& t = faces[i];
+                    t.idx[0] = newIndex[t.idx[0]];
+                    t.idx[1] = newIndex[t.idx[1]];
+                    t.idx[2] = newIndex[t.idx[2]];
+                }
+            });
+        }
+
+        void InitialiseQuadrics()
+        {
+            const size_t verticesCount = positions.size();
+            std::vector<Quadric> facesQuadrics(faces.size());
+            For(faces.size(), [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Triangle& t = faces[i];
+                    const Vec3d& p0 = positions[t.idx[0]];
+                    Vec3d n = CrossProduct(positions[t.idx[1]] - p0, positions[t.idx[2]] - p0);
+                    const double length = Length(n);
+                    if (length > 0.0)
+                    {
+                        n = n * (1.0 / length);
+                    }
+                    // area weighted, so small slivers don't dominate the error.
+                    facesQuadrics[i] = PlaneQuadric(n, -DotProduct(n, p0), 0.5 * length);
+                }
+            });
+
+            quadrics.resize(verticesCount);
+            For(verticesCount, [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t v = begin; v < end; ++v)
+                {
+                    Quadric q = {};
+                    for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                    {
+                        AddQuadric(q, facesQuadrics[adjacency.faces[i]]);
+                    }
+                    if (options.preserveBoundary && boundary[v])
+                    {
+                        // planes perpendicular to the faces through their open edges.
+                        for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                        {
+                            const Triangle& t = faces[adjacency.faces[i]];
+                            for (int k = 0; k < 3; ++k)
+                            {
+                                const uint32_t a = t.idx[k];
+                                const uint32_t b = t.idx[(k + 1) % 3];
+                                if ((a != v && b != v) || EdgeFacesCount(faces, adjacency, a, b) != 1)
+                                {
+                                    continue;
+                                }
+                                const Vec3d& p0 = positions[t.idx[0]];
+                                const Vec3d faceNormal = CrossProduct(positions[t.idx[1]] - p0, positions[t.idx[2]] - p0);
+                                const Vec3d edge = positions[b] - positions[a];
+                                Vec3d n = CrossProduct(edge, faceNormal);
+                                const double length = Length(n);
+                                if (length == 0.0)
+                                {
+                                    continue;
+                                }
+                                n = n * (1.0 / length);
+                                Quadric c = PlaneQuadric(n, -DotProduct(n, positions[a]),
+                                                         BOUNDARY_WEIGHT * DotProduct(edge, edge));
+                                // constraints only shape the error, they don't count in the averaging.
+                                c.weight = 0.0;
+                                AddQuadric(q, c);
+                            }
+                        }
+                    }
+                    quadrics[v] = q;
+                }
+            });
+        }
+
+        // best position for collapsing the edge (a, b) and its error.
+        double EvaluateCollapse(uint32_t a, uint32_t b, Vec3d& position) const
+        {
+            Quadric q = quadrics[a];
+            AddQuadric(q, quadrics[b]);
+            if (options.preserveBoundary && boundary[a] != boundary[b])
+            {
+                // keep the boundary where it is.
+                position = boundary[a] ? positions[a] : positions[b];
+                return QuadricError(q, position);
+            }
+            if (QuadricOptimum(q, position))
+            {
+                return QuadricError(q, position);
+            }
+            const Vec3d candidates[3] = { positions[a], positions[b], (positions[a] + positions[b]) * 0.5 };
+            double best = DBL_MAX;
+            for (const Vec3d& c : candidates)
+            {
+                const double e = QuadricError(q, c);
+                if (e < best)
+                {
+                    best = e;
+                    position = c;
+                }
+            }
+            return best;
+        }
+
+        // topology and geometry checks of collapsing (a, b) into position.
+        bool IsCollapseValid(uint32_t a, uint32_t b, const Vec3d& position,
+                             std::vector<uint32_t>& ringA, std::vector<uint32_t>& ringB) const
+        {
+            const size_t edgeFaces = EdgeFacesCount(faces, adjacency, a, b);
+            if (edgeFaces == 0 || edgeFaces > 2)
+            {
+                return false;
+            }
+            if (options.preserveBoundary && edgeFaces == 2 && boundary[a] && boundary[b])
+            {
+                // an interior edge between two boundaries, collapsing it would pinch the surface.
+                return false;
+            }
+
+            // link condition: the only vertices shared by the rings of a and b are the
+            // opposite vertices of the faces on the edge.
+            auto GatherRing = [&](uint32_t v, std::vector<uint32_t>& ring)
+            {
+                ring.clear();
+                for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                {
+                    const Triangle& t = faces[adjacency.faces[i]];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        if (t.idx[k] != v) ring.push_back(t.idx[k]);
+                    }
+                }
+                std::sort(ring.begin(), ring.end());
+                ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+            };
+            GatherRing(a, ringA);
+            GatherRing(b, ringB);
+            size_t shared = 0;
+            for (size_t i = 0, j = 0; i < ringA.size() && j < ringB.size();)
+            {
+                if (ringA[i] < ringB[j]) ++i;
+                else if (ringB[j] < ringA[i]) ++j;
+                else
+                {
+                    shared++;
+                    ++i;
+                    ++j;
+                }
+            }
+            if (shared != edgeFaces)
+            {
+                return false;
+            }
+
+            // reject collapses that flip or fold the surviving faces.
+            for (const uint32_t v : { a, b })
+            {
+                for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+                {
+                    const Triangle& t = faces[adjacency.faces[i]];
+                    if (HasVertex(t, a) && HasVertex(t, b))
+                    {
+                        continue;
+                    }
+                    Vec3d p[3];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        p[k] = t.idx[k] == v ? position : positions[t.idx[k]];
+                    }
+                    const Vec3d& o0 = positions[t.idx[0]];
+                    const Vec3d before = CrossProduct(positions[t.idx[1]] - o0, positions[t.idx[2]] - o0);
+                    const Vec3d after = CrossProduct(p[1] - p[0], p[2] - p[0]);
+                    const double dot = DotProduct(before, after);
+                    const double lengths = DotProduct(before, before) * DotProduct(after, after);
+                    if (lengths == 0.0 || dot <= 0.0 || dot * dot < MIN_NORMAL_COSINE * MIN_NORMAL_COSINE * lengths)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // performs one round of independent collapses, returns the number of removed faces.
+        size_t Round(size_t facesToRemove, bool relaxed)
+        {
+            BuildVertexFaces(faces, positions.size(), adjacency);
+            UpdateBoundary();
+
+            // every edge once: (a, b) with a < b from the faces that contain it, open edges are
+            // only seen in one direction so they are also taken when a > b.
+            std::vector<Collapse> slots(3 * faces.size());
+            std::vector<uint32_t> slotsKeys(3 * faces.size());
+            std::vector<size_t> chunksOffsets((faces.size() + GRAIN_SIZE - 1) / GRAIN_SIZE + 1, 0);
+            const uint32_t invalidKey = FloatKey(FLT_MAX);
+            For(faces.size(), [&](size_t begin, size_t end, size_t)
+            {
+                size_t count = 0;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Triangle& t = faces[i];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const uint32_t a = t.idx[k];
+                        const uint32_t b = t.idx[(k + 1) % 3];
+                        const size_t slot = 3 * i + k;
+                        slots[slot] = Collapse{ a, b };
+                        slotsKeys[slot] = invalidKey;
+                        if (a == b || (a > b && EdgeFacesCount(faces, adjacency, a, b) != 1))
+                        {
+                            continue;
+                        }
+                        Vec3d position;
+                        const double error = sqrt(EvaluateCollapse(a, b, position));
+                        if (error <= options.maxError)
+                        {
+                            slotsKeys[slot] = FloatKey(std::min<double>(error, FLT_MAX / 2));
+                            count++;
+                        }
+                    }
+                }
+                chunksOffsets[begin / GRAIN_SIZE + 1] = count;
+            });
+            for (size_t i = 1; i < chunksOffsets.size(); ++i)
+            {
+                chunksOffsets[i] += chunksOffsets[i - 1];
+            }
+            std::vector<Collapse> candidates(chunksOffsets.back());
+            std::vector<uint32_t> keys(chunksOffsets.back());
+            For(faces.size(), [&](size_t begin, size_t end, size_t)
+            {
+                size_t cursor = chunksOffsets[begin / GRAIN_SIZE];
+                for (size_t slot = 3 * begin; slot < 3 * end; ++slot)
+                {
+                    if (slotsKeys[slot] != invalidKey)
+                    {
+                        candidates[cursor] = slots[slot];
+                        keys[cursor] = slotsKeys[slot];
+                        cursor++;
+                    }
+                }
+            });
+            slots.clear();
+            slots.shrink_to_fit();
+            slotsKeys.clear();
+            slotsKeys.shrink_to_fit();
+
+            std::vector<uint32_t> order;
+            RadixSortIndices(keys, order);
+
+            // greedy independent set: a collapse locks all the vertices of the faces around its
+            // edge, so the selected collapses never touch the same face and can run in parallel,
+            // it also means none of them changes the outcome of the checks of another.
+            // once the cheapest collapses needed to reach the target are seen, the round only
+            // accepts errors up to a bit more than the last of them, the blocked ones get
+            // another chance in the next round.
+            std::vector<uint8_t> locked(positions.size(), 0);
+            std::vector<Collapse> selected;
+            std::vector<uint32_t> ringA, ringB;
+            const size_t goalCount = facesToRemove / 2;
+            size_t seenCount = 0;
+            float errorGoal = FLT_MAX;
+            size_t expectedRemoved = 0;
+            for (size_t i = 0; i < order.size() && expectedRemoved < facesToRemove; ++i)
+            {
+                const uint32_t idx = order[i];
+                float error;
+                memcpy(&error, &keys[idx], sizeof(error));
+                if (error > errorGoal)
+                {
+                    break;
+                }
+                const Collapse c = candidates[idx];
+                const bool blocked = locked[c.a] || locked[c.b];
+                if (!blocked)
+                {
+                    Vec3d position;
+                    EvaluateCollapse(c.a, c.b, position);
+                    if (!IsCollapseValid(c.a, c.b, position, ringA, ringB))
+                    {
+                        continue;
+                    }
+                }
+                if (!relaxed && seenCount++ == goalCount)
+                {
+                    errorGoal = error * float(ROUND_ERROR_SLACK);
+                }
+                if (blocked)
+                {
+                    continue;
+                }
+                for (const uint32_t v : { c.a, c.b })
+                {
+                    for (uint32_t j = adjacency.offsets[v]; j < adjacency.offsets[v + 1]; ++j)
+                    {
+                        const Triangle& t = faces[adjacency.faces[j]];
+                        locked[t.idx[0]] = locked[t.idx[1]] = locked[t.idx[2]] = 1;
+                    }
+                }
+                expectedRemoved += EdgeFacesCount(faces, adjacency, c.a, c.b);
+                selected.push_back(c);
+            }
+
+            std::vector<uint32_t> remap(positions.size());
+            for (size_t i = 0; i < remap.size(); ++i)
+            {
+                remap[i] = i;
+            }
+            std::vector<float> errors(selected.size());
+            For(selected.size(), [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Collapse c = selected[i];
+                    Vec3d position;
+                    const double error = sqrt(EvaluateCollapse(c.a, c.b, position));
+                    positions[c.a] = position;
+                    AddQuadric(quadrics[c.a], quadrics[c.b]);
+                    remap[c.b] = c.a;
+                    errors[i] = error;
+                }
+            });
+            for (const float e : errors)
+            {
+                maxError = std::max<double>(maxError, e);
+            }
+
+            For(faces.size(), [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    Triangle& t = faces[i];
+                    t.idx[0] = remap[t.idx[0]];
+                    t.idx[1] = remap[t.idx[1]];
+                    t.idx[2] = remap[t.idx[2]];
+                }
+            });
+            const size_t before = faces.size();
+            faces.erase(std::remove_if(faces.begin(), faces.end(), [](const Triangle& t)
+            {
+                return t.idx[0] == t.idx[1] || t.idx[1] == t.idx[2] || t.idx[2] == t.idx[0];
+            }), faces.end());
+            CompactVertices();
+            return before - faces.size();
+        }
+    };
+} // namespace
+
+SurfaceMesh DecimateMesh(const SurfaceMesh& mesh, const DecimationOptions& options, double* error)
+{
+    Decimator decimator(options);
+    decimator.positions = mesh.vertices;
+    decimator.faces = mesh.faces;
+
+    BuildVertexFaces(decimator.faces, decimator.positions.size(), decimator.adjacency);
+    decimator.UpdateBoundary();
+    decimator.InitialiseQuadrics();
+
+    bool relaxed = false;
+    while (decimator.faces.size() > options.targetFacesCount)
+    {
+        if (options.cancel && options.cancel->load(std::memory_order_relaxed))
+        {
+            break;
+        }
+        const size_t removed = decimator.Round(decimator.faces.size() - options.targetFacesCount, relaxed);
+        if (removed == 0)
+        {
+            if (relaxed)
+            {
+                break;
+            }
+            // the cheap collapses are all rejected, allow any error up to options.maxError for one round.
+            relaxed = true;
+        }
+        else
+        {
+            // the stall is cleared, the next rounds take the cheapest collapses first again.
+            relaxed = false;
+        }
+    }
+
+    decimator.CompactVertices();
+    SurfaceMesh result;
+    result.vertices = std::move(decimator.positions);
+    result.faces = std::move(decimator.faces);
+    result.name = mesh.name;
+    result.color = mesh.color;
+    result.visible = mesh.visible;
+    result.id = GenerateUUID();
+    if (error)
+    {
+        *error = decimator.maxError;
+    }
+    return result;
+}
+
+std::vector<MeshLod> GenerateMeshLods(const SurfaceMesh& mesh, size_t maxLevelsCount, size_t minFacesCount,
+                                      const std::atomic<bool>* cancel)
+{
+    std::vector<MeshLod> result;
+    const SurfaceMesh* previous = &mesh;
+    double previousError = 0.0;
+    while (result.size() < maxLevelsCount && previous->faces.size() / 4 >= minFacesCount)
+    {
+        // every level is built from the previous one, the errors add up.
+        DecimationOptions options;
+        options.targetFacesCount = previous->faces.size() / 4;
+        options.cancel = cancel;
+        double error = 0.0;
+        MeshLod lod;
+        lod.mesh = DecimateMesh(*previous, options, &error);
+        if (cancel && cancel->load(std::memory_order_relaxed))
+        {
+            return {};
+        }
+        if (lod.mesh.faces.size() >= previous->faces.size())
+        {
+            break;
+        }
+        lod.error = previousError + error;
+        OptimiseMeshForRendering(lod.mesh);
+        lod.normals = CalculateVertexNormals(lod.mesh, BuildVertexRings(lod.mesh));
+        previousError = lod.error;
+        result.push_back(std::move(lod));
+        previous = &result.back().mesh;
+    }
+    return result;
+}
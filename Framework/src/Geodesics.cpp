@@ -0,0 +1,297 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 16 * 1024;
+    // sqrt(t) the conjugate gradient fallback uses, as a fraction of the mesh diagonal.
+    constexpr double CONJUGATE_GRADIENT_DECAY = 20.0;
+
+    struct Corner
+    {
+        Vec3d pq; // from the vertex to the next one of the face.
+        Vec3d pr; // from the vertex to the previous one.
+        uint32_t q;
+        uint32_t r;
+        double cotQ; // cotangent of the angle at q.
+        double cotR;
+    };
+
+    // false for degenerate faces.
+    bool GetCorner(const SurfaceMesh& mesh, uint32_t face, uint32_t v, Corner& corner)
+    {
+        const Triangle& t = mesh.faces[face];
+        const int i = t.idx[0] == v ? 0 : (t.idx[1] == v ? 1 : 2);
+        corner.q = t.idx[(i + 1) % 3];
+        corner.r = t.idx[(i + 2) % 3];
+        corner.pq = mesh.vertices[corner.q] - mesh.vertices[v];
+        corner.pr = mesh.vertices[corner.r] - mesh.vertices[v];
+        const Vec3d qr = corner.pr - corner.pq;
+        const double doubleArea = Length(CrossProduct(corner.pq, corner.pr));
+        if (doubleArea == 0.0)
+        {
+            return false;
+        }
+        corner.cotQ = -DotProduct(corner.pq, qr) / doubleArea;
+        corner.cotR = DotProduct(corner.pr, qr) / doubleArea;
+        return true;
+    }
+
+    // position of column in the sorted row.
+    size_t FindEntry(const SparseMatrix& matrix, uint32_t row, uint32_t column)
+    {
+        const auto begin = matrix.columns.begin() + matrix.offsets[row];
+        const auto end = matrix.columns.begin() + matrix.offsets[row + 1];
+        return std::lower_bound(begin, end, column) - matrix.columns.begin();
+    }
+
+    // M + t L, unused vertices get 1 on the diagonal.
+    SparseMatrix BuildHeatOperator(const SparseMatrix& laplacian, const std::vector<double>& masses, double timeStep)
+    {
+        SparseMatrix result = laplacian;
+        ParallelFor(laplacian.rowsCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t v = begin; v < end; ++v)
+            {
+                for (size_t p = laplacian.offsets[v]; p < laplacian.offsets[v + 1]; ++p)
+                {
+                    double& value = result.values[p];
+                    value *= timeStep;
+                    if (laplacian.columns[p] == v)
+                    {
+                        value += masses[v];
+                        if (value == 0.0)
+                        {
+                            value = 1.0;
+                        }
+                    }
+                }
+            }
+        });
+        return result;
+    }
+
+    void Solve(const SparseMatrix& matrix, const CholeskyFactor& factor, bool factorised,
+               const std::vector<double>& b, std::vector<double>& x)
+    {
+        if (factorised)
+        {
+            SolveCholesky(factor, b, x);
+        }
+        else
+        {
+            x.assign(matrix.rowsCount, 0.0);
+            SolveConjugateGradient(matrix, b, x);
+        }
+    }
+}
+
+HeatGeodesics PrepareHeatGeodesics(const SurfaceMesh& mesh, size_t maxFactorEntriesCount)
+{
+    HeatGeodesics result;
+    const size_t verticesCount = mesh.vertices.size();
+    const VertexRings rings = BuildVertexRings(mesh);
+
+    // every component has its smallest vertex pinned in the Poisson problem, an unused vertex
+    // is a component of its own.
+    const MeshComponents components = LabelMeshComponents(mesh);
+    result.components.resize(verticesCount);
+    std::vector<bool>& pinned = result.pinned;
+    pinned.assign(verticesCount, false);
+    std::vector<bool> seen(components.facesCounts.size(), false);
+    for (size_t v = 0; v < verticesCount; ++v)
+    {
+        if (rings.faceOffsets[v] == rings.faceOffsets[v + 1])
+        {
+            result.components[v] = UINT32_MAX;
+            pinned[v] = true;
+            continue;
+        }
+        const uint32_t component = components.faceComponents[rings.faces[rings.faceOffsets[v]]];
+        result.components[v] = component;
+        pinned[v] = !seen[component];
+        seen[component] = true;
+    }
+
+    // cotangent Laplacian and lumped masses, a row holds the vertex and its neighbours.
+    SparseMatrix laplacian;
+    laplacian.rowsCount = verticesCount;
+    laplacian.columnsCount = verticesCount;
+    laplacian.offsets.resize(verticesCount + 1);
+    for (size_t v = 0; v <= verticesCount; ++v)
+    {
+        laplacian.offsets[v] = rings.vertexOffsets[v] + v;
+    }
+    laplacian.columns.resize(laplacian.offsets[verticesCount]);
+    laplacian.values.assign(laplacian.offsets[verticesCount], 0.0);
+    std::vector<double> masses(verticesCount, 0.0);
+    const size_t chunksCount = (verticesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<double> edgesLengths(chunksCount, 0.0);
+    std::vector<size_t> edgesCounts(chunksCount, 0);
+    ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        const size_t chunk = begin / GRAIN_SIZE;
+        for (size_t v = begin; v < end; ++v)
+        {
+            const auto neighboursBegin = rings.vertices.begin() + rings.vertexOffsets[v];
+            const auto neighboursEnd = rings.vertices.begin() + rings.vertexOffsets[v + 1];
+            const auto split = std::lower_bound(neighboursBegin, neighboursEnd, uint32_t(v));
+            auto out = laplacian.columns.begin() + laplacian.offsets[v];
+            out = std::copy(neighboursBegin, split, out);
+            *out++ = uint32_t(v);
+            std::copy(split, neighboursEnd, out);
+            for (uint32_t n = rings.vertexOffsets[v]; n < rings.vertexOffsets[v + 1]; ++n)
+            {
+                edgesLengths[chunk] += Length(mesh.vertices[rings.vertices[n]] - mesh.vertices[v]);
+            }
+            edgesCounts[chunk] += rings.vertexOffsets[v + 1] - rings.vertexOffsets[v];
+
+            const size_t diagonal = FindEntry(laplacian, uint32_t(v), uint32_t(v));
+            for (uint32_t i = rings.faceOffsets[v]; i < rings.faceOffsets[v + 1]; ++i)
+            {
+                Corner c;
+                if (!GetCorner(mesh, rings.faces[i], uint32_t(v), c))
+                {
+                    continue;
+                }
+                laplacian.values[FindEntry(laplacian, uint32_t(v), c.q)] -= 0.5 * c.cotR;
+                laplacian.values[FindEntry(laplacian, uint32_t(v), c.r)] -= 0.5 * c.cotQ;
+                laplacian.values[diagonal] += 0.5 * (c.cotQ + c.cotR);
+                masses[v] += Length(CrossProduct(c.pq, c.pr)) / 6.0;
+            }
+        }
+    });
+    double edgesLength = 0.0;
+    size_t edgesCount = 0;
+    for (size_t i = 0; i < chunksCount; ++i)
+    {
+        edgesLength += edgesLengths[i];
+        edgesCount += edgesCounts[i];
+    }
+    const double meanEdgeLength = edgesCount > 0 ? edgesLength / edgesCount : 0.0;
+    result.timeStep = meanEdgeLength * meanEdgeLength;
+
+    result.heatOperator = BuildHeatOperator(laplacian, masses, result.timeStep);
+    result.poissonOperator = laplacian;
+    ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            for (size_t p = laplacian.offsets[v]; p < laplacian.offsets[v + 1]; ++p)
+            {
+                const uint32_t column = laplacian.columns[p];
+                if (pinned[v] || pinned[column])
+                {
+                    result.poissonOperator.values[p] = column == v ? 1.0 : 0.0;
+                }
+            }
+        }
+    });
+
+    result.factorised = FactoriseCholesky(result.heatOperator, result.heatFactor, maxFactorEntriesCount / 2) &&
+                        FactoriseCholesky(result.poissonOperator, result.poissonFactor, maxFactorEntriesCount / 2);
+    if (!result.factorised)
+    {
+        result.heatFactor = CholeskyFactor();
+        result.poissonFactor = CholeskyFactor();
+        // the heat decays like exp(-distance / sqrt(t)) and the conjugate gradient only resolves it
+        // down to its tolerance, the time step has to let it reach across the whole mesh.
+        const BBox box = CalculateBoundingBox(mesh);
+        const double diagonal = Length(box.max - box.min);
+        const double timeStep = diagonal * diagonal / (CONJUGATE_GRADIENT_DECAY * CONJUGATE_GRADIENT_DECAY);
+        if (timeStep > result.timeStep)
+        {
+            result.timeStep = timeStep;
+            result.heatOperator = BuildHeatOperator(laplacian, masses, result.timeStep);
+        }
+    }
+    return result;
+}
+
+std::vector<double> CalculateGeodesicDistances(const SurfaceMesh& mesh, const HeatGeodesics& heat,
+                                               const std::vector<uint32_t>& seeds)
+{
+    const size_t verticesCount = mesh.vertices.size();
+    std::vector<double> result(verticesCount, DBL_MAX);
+    if (seeds.empty())
+    {
+        return result;
+    }
+
+    // heat diffused from the seeds for one time step.
+    std::vector<double> b(verticesCount, 0.0);
+    for (uint32_t seed : seeds)
+    {
+        b[seed] = 1.0;
+    }
+    std::vector<double> u;
+    Solve(heat.heatOperator, heat.heatFactor, heat.factorised, b, u);
+
+    // normalised gradient pointing away from the seeds on every face.
+    std::vector<Vec3d> field(mesh.faces.size());
+    ParallelFor(mesh.faces.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            const Vec3d normal = CrossProduct(mesh.vertices[t.idx[1]] - mesh.vertices[t.idx[0]],
+                                              mesh.vertices[t.idx[2]] - mesh.vertices[t.idx[0]]);
+            Vec3d gradient{ 0.0, 0.0, 0.0 };
+            for (int c = 0; c < 3; ++c)
+            {
+                const Vec3d opposite = mesh.vertices[t.idx[(c + 2) % 3]] - mesh.vertices[t.idx[(c + 1) % 3]];
+                gradient = gradient + CrossProduct(normal, opposite) * u[t.idx[c]];
+            }
+            const double length = Length(gradient);
+            field[i] = length > 0.0 ? gradient * (-1.0 / length) : Vec3d{ 0.0, 0.0, 0.0 };
+        }
+    });
+
+    // integrated divergence of the field around every vertex, the pinned vertices keep 0.
+    const VertexRings rings = BuildVertexRings(mesh);
+    std::fill(b.begin(), b.end(), 0.0);
+    ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            if (heat.pinned[v] || rings.faceOffsets[v] == rings.faceOffsets[v + 1])
+            {
+                continue;
+            }
+            double divergence = 0.0;
+            for (uint32_t i = rings.faceOffsets[v]; i < rings.faceOffsets[v + 1]; ++i)
+            {
+                Corner c;
+                if (GetCorner(mesh, rings.faces[i], uint32_t(v), c))
+                {
+                    const Vec3d& x = field[rings.faces[i]];
+                    divergence += 0.5 * (c.cotR * DotProduct(c.pq, x) + c.cotQ * DotProduct(c.pr, x));
+                }
+            }
+            b[v] = -divergence;
+        }
+    });
+    std::vector<double> phi;
+    Solve(heat.poissonOperator, heat.poissonFactor, heat.factorised, b, phi);
+
+    // the distances are shifted so the closest seed of every component is at 0.
+    std::vector<double> offsets(verticesCount, DBL_MAX);
+    for (uint32_t seed : seeds)
+    {
+        const uint32_t component = heat.components[seed];
+        const uint32_t slot = component == UINT32_MAX ? seed : component;
+        offsets[slot] = std::min(offsets[slot], phi[seed]);
+    }
+    for (size_t v = 0; v < verticesCount; ++v)
+    {
+        const uint32_t slot = heat.components[v] == UINT32_MAX ? uint32_t(v) : heat.components[v];
+        if (offsets[slot] != DBL_MAX)
+        {
+            result[v] = phi[v] - offsets[slot];
+        }
+    }
+    return result;
+}
@@ -1,29 +1,73 @@
 #include "Resha.h"
 #include <float.h>
 
-std::vector<Vec3d> CalculateFacesNormals(const SurfaceMesh& mesh)
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+    constexpr size_t CONVERSION_GRAIN_SIZE = 64 * 1024;
+
+    template <typename To, typename From>
+    BasicSurfaceMesh<To> ConvertMesh(const BasicSurfaceMesh<From>& mesh)
+    {
+        BasicSurfaceMesh<To> result;
+        result.vertices.resize(mesh.vertices.size());
+        ParallelFor(mesh.vertices.size(), CONVERSION_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const From& v = mesh.vertices[i];
+                To& converted = result.vertices[i];
+                converted.x = v.x;
+                converted.y = v.y;
+                converted.z = v.z;
+            }
+        });
+        result.faces = mesh.faces;
+        result.name = mesh.name;
+        result.color = mesh.color;
+        result.id = mesh.id;
+        result.visible = mesh.visible;
+        return result;
+    }
+}
+
+SurfaceMesh WidenMesh(const SurfaceMeshF& mesh)
+{
+    return ConvertMesh<Vec3d>(mesh);
+}
+
+SurfaceMeshF NarrowMesh(const SurfaceMesh& mesh)
+{
+    return ConvertMesh<Vec3f>(mesh);
+}
+
+template <typename Vec>
+std::vector<Vec> CalculateFacesNormals(const BasicSurfaceMesh<Vec>& mesh)
 {
-    std::vector<Vec3d> faceNormals;
+    std::vector<Vec> faceNormals;
     faceNormals.reserve(mesh.faces.size());
     for (const Triangle& t : mesh.faces)
     {
-        const Vec3d v0 = mesh.vertices[t.idx[0]];
-        const Vec3d v1 = mesh.vertices[t.idx[1]];
-        const Vec3d v2 = mesh.vertices[t.idx[2]];
+        const Vec v0 = mesh.vertices[t.idx[0]];
+        const Vec v1 = mesh.vertices[t.idx[1]];
+        const Vec v2 = mesh.vertices[t.idx[2]];
         faceNormals.push_back(Normalised(CrossProduct(v1 - v0, v2 - v0)));
     }
     return faceNormals;
 }
 
-std::vector<Vec3d> CalculateVertexNormals(const SurfaceMesh& mesh,
-                                          const Connectivity& connectivity)
+template <typename Vec>
+std::vector<Vec> CalculateVertexNormals(const BasicSurfaceMesh<Vec>& mesh,
+                                        const Connectivity& connectivity)
 {
-    const std::vector<Vec3d> faceNormals = CalculateFacesNormals(mesh);
+    const std::vector<Vec> faceNormals = CalculateFacesNormals(mesh);
     const size_t verticesCount = mesh.vertices.size();
-    std::vector<Vec3d> normals(verticesCount);
+    std::vector<Vec> normals(verticesCount);
     for (size_t i = 0; i < verticesCount; ++i)
     {
-        normals[i] = Vec3d{ 0.0, 0.0, 0.0 };
+        normals[i] = Vec{ 0, 0, 0 };
         for (const size_t faceIdx : connectivity.pointCells[i].adjacentFaces)
         {
             normals[i] = normals[i] + faceNormals[faceIdx];
@@ -35,22 +79,24 @@ std::vector<Vec3d> CalculateVertexNormals(const SurfaceMesh& mesh,
     return normals;
 }
 
-BBox CalculateBoundingBox(const SurfaceMesh& mesh)
+template <typename Vec>
+BBox CalculateBoundingBox(const BasicSurfaceMesh<Vec>& mesh)
 {
     BBox result;
-    for (const Vec3d& v : mesh.vertices)
-    {
-        result.min.x = std::min(v.x, result.min.x);
-        result.min.y = std::min(v.y, result.min.y);
-        result.min.z = std::min(v.z, result.min.z);
-        result.max.x = std::max(v.x, result.max.x);
-        result.max.y = std::max(v.y, result.max.y);
-        result.max.z = std::max(v.z, result.max.z);
+    for (const Vec& v : mesh.vertices)
+    {
+        result.min.x = std::min<double>(v.x, result.min.x);
+        result.min.y = std::min<double>(v.y, result.min.y);
+        result.min.z = std::min<double>(v.z, result.min.z);
+        result.max.x = std::max<double>(v.x, result.max.x);
+        result.max.y = std::max<double>(v.y, result.max.y);
+        result.max.z = std::max<double>(v.z, result.max.z);
     }
     return result;
 }
 
-Connectivity BuildConnectivity(const SurfaceMesh& mesh)
+template <typename Vec>
+Connectivity BuildConnectivity(const BasicSurfaceMesh<Vec>& mesh)
 {
     Connectivity c;
     const size_t pointsCount = mesh.vertices.size();
@@ -69,3 +115,248 @@ Connectivity BuildConnectivity(const SurfaceMesh& mesh)
     }
     return c;
 }
+
+template std::vector<Vec3d> CalculateFacesNormals(const SurfaceMesh& mesh);
+template std::vector<Vec3f> CalculateFacesNormals(const SurfaceMeshF& mesh);
+template std::vector<Vec3d> CalculateVertexNormals(const SurfaceMesh& mesh, const Connectivity& connectivity);
+template std::vector<Vec3f> CalculateVertexNormals(const SurfaceMeshF& mesh, const Connectivity& connectivity);
+template BBox CalculateBoundingBox(const SurfaceMesh& mesh);
+template BBox CalculateBoundingBox(const SurfaceMeshF& mesh);
+template Connectivity BuildConnectivity(const SurfaceMesh& mesh);
+template Connectivity BuildConnectivity(const SurfaceMeshF& mesh);
+
+namespace
+{
+    constexpr size_t MORTON_GRAIN_SIZE = 64 * 1024;
+    constexpr double MORTON_MAX_CELL = (1 << 21) - 1;
+
+    // spreads the 21 low bits of v so there are two zero bits between each of them.
+    uint64_t SpreadBits(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffff;
+        v = (v | v << 16) & 0x1f0000ff0000ff;
+        v = (v | v << 8) & 0x100f00f00f00f00f;
+        v = (v | v << 4) & 0x10c30c30c30c30c3;
+        v = (v | v << 2) & 0x1249249249249249;
+        return v;
+    }
+
+    struct MortonQuantiser
+    {
+        Vec3d origin;
+        Vec3d scale;
+
+        explicit MortonQuantiser(const BBox& box)
+        {
+            origin = box.min;
+            for (int i = 0; i < 3; i++)
+            {
+                const double extent = box.max.data[i] - box.min.data[i];
+                scale.data[i] = extent > 0.0 ? MORTON_MAX_CELL / extent : 0.0;
+            }
+        }
+
+        template <typename Vec>
+        uint64_t Code(const Vec& p) const
+        {
+            uint64_t cells[3];
+            for (int i = 0; i < 3; i++)
+            {
+                const double c = (p.data[i] - origin.data[i]) * scale.data[i];
+                cells[i] = uint64_t(std::min(std::max(c, 0.0), MORTON_MAX_CELL));
+            }
+            return SpreadBits(cells[0]) | SpreadBits(cells[1]) << 1 | SpreadBits(cells[2]) << 2;
+        }
+    };
+}
+
+template <typename Vec>
+std::vector<uint64_t> CalculateMortonCodes(const std::vector<Vec>& points, const BBox& box)
+{
+    const MortonQuantiser quantiser(box);
+    std::vector<uint64_t> codes(points.size());
+    ParallelFor(points.size(), MORTON_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            codes[i] = quantiser.Code(points[i]);
+        }
+    });
+    return codes;
+}
+
+template <typename Vec>
+void SortMeshSpatially(BasicSurfaceMesh<Vec>& mesh)
+{
+    const BBox box = CalculateBoundingBox(mesh);
+    std::vector<uint32_t> order;
+    RadixSortIndices(CalculateMortonCodes(mesh.vertices, box), order);
+
+    std::vector<Vec> vertices(mesh.vertices.size());
+    std::vector<uint32_t> remap(mesh.vertices.size());
+    ParallelFor(order.size(), MORTON_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            vertices[i] = mesh.vertices[order[i]];
+            remap[order[i]] = uint32_t(i);
+        }
+    });
+    mesh.vertices = std::move(vertices);
+
+    const MortonQuantiser quantiser(box);
+    std::vector<uint64_t> facesCodes(mesh.faces.size());
+    ParallelFor(mesh.faces.size(), MORTON_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            Triangle& t = mesh.faces[i];
+            t.idx[0] = remap[t.idx[0]];
+            t.idx[1] = remap[t.idx[1]];
+            t.idx[2] = remap[t.idx[2]];
+            const Vec centroid = (mesh.vertices[t.idx[0]] + mesh.vertices[t.idx[1]] + mesh.vertices[t.idx[2]]) * (1.0 / 3.0);
+            facesCodes[i] = quantiser.Code(centroid);
+        }
+    });
+    RadixSortIndices(facesCodes, order);
+
+    std::vector<Triangle> faces(mesh.faces.size());
+    ParallelFor(order.size(), MORTON_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            faces[i] = mesh.faces[order[i]];
+        }
+    });
+    mesh.faces = std::move(faces);
+}
+
+template std::vector<uint64_t> CalculateMortonCodes(const std::vector<Vec3d>& points, const BBox& box);
+template std::vector<uint64_t> CalculateMortonCodes(const std::vector<Vec3f>& points, const BBox& box);
+template void SortMeshSpatially(SurfaceMesh& mesh);
+template void SortMeshSpatially(SurfaceMeshF& mesh);
+
+namespace
+{
+    constexpr size_t RINGS_GRAIN_SIZE = 64 * 1024;
+}
+
+template <typename Vec>
+VertexRings BuildVertexRings(const BasicSurfaceMesh<Vec>& mesh)
+{
+    VertexRings result;
+    const size_t verticesCount = mesh.vertices.size();
+    const size_t facesCount = mesh.faces.size();
+    std::vector<std::atomic<uint32_t>> cursors(verticesCount);
+    ParallelFor(facesCount, RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (uint32_t v : mesh.faces[i].idx)
+            {
+                cursors[v].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+    result.faceOffsets.resize(verticesCount + 1);
+    result.faceOffsets[0] = 0;
+    for (size_t i = 0; i < verticesCount; ++i)
+    {
+        result.faceOffsets[i + 1] = result.faceOffsets[i] + cursors[i].load(std::memory_order_relaxed);
+        cursors[i].store(result.faceOffsets[i], std::memory_order_relaxed);
+    }
+    result.faces.resize(result.faceOffsets[verticesCount]);
+    ParallelFor(facesCount, RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (uint32_t v : mesh.faces[i].idx)
+            {
+                result.faces[cursors[v].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+            }
+        }
+    });
+    cursors = std::vector<std::atomic<uint32_t>>();
+
+    // the rings are sorted so they don't depend on the threads, the neighbours are counted
+    // first and written in a second pass.
+    std::vector<uint32_t> neighboursCounts(verticesCount);
+    auto collectNeighbours = [&](size_t v, std::vector<uint32_t>& neighbours)
+    {
+        neighbours.clear();
+        for (uint32_t i = result.faceOffsets[v]; i < result.faceOffsets[v + 1]; ++i)
+        {
+            for (uint32_t n : mesh.faces[result.faces[i]].idx)
+            {
+                if (n != v)
+                {
+                    neighbours.push_back(n);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+    ParallelFor(verticesCount, RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t> neighbours;
+        for (size_t v = begin; v < end; ++v)
+        {
+            std::sort(result.faces.begin() + result.faceOffsets[v], result.faces.begin() + result.faceOffsets[v + 1]);
+            collectNeighbours(v, neighbours);
+            neighboursCounts[v] = uint32_t(neighbours.size());
+        }
+    });
+    result.vertexOffsets.resize(verticesCount + 1);
+    result.vertexOffsets[0] = 0;
+    for (size_t i = 0; i < verticesCount; ++i)
+    {
+        result.vertexOffsets[i + 1] = result.vertexOffsets[i] + neighboursCounts[i];
+    }
+    result.vertices.resize(result.vertexOffsets[verticesCount]);
+    ParallelFor(verticesCount, RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t> neighbours;
+        for (size_t v = begin; v < end; ++v)
+        {
+            collectNeighbours(v, neighbours);
+            std::copy(neighbours.begin(), neighbours.end(), result.vertices.begin() + result.vertexOffsets[v]);
+        }
+    });
+    return result;
+}
+
+template <typename Vec>
+std::vector<Vec> CalculateVertexNormals(const BasicSurfaceMesh<Vec>& mesh, const VertexRings& rings)
+{
+    std::vector<Vec> faceNormals(mesh.faces.size());
+    ParallelFor(mesh.faces.size(), RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            const Vec& v0 = mesh.vertices[t.idx[0]];
+            faceNormals[i] = Normalised(CrossProduct(mesh.vertices[t.idx[1]] - v0, mesh.vertices[t.idx[2]] - v0));
+        }
+    });
+    std::vector<Vec> normals(mesh.vertices.size());
+    ParallelFor(mesh.vertices.size(), RINGS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            Vec normal{ 0, 0, 0 };
+            for (uint32_t i = rings.faceOffsets[v]; i < rings.faceOffsets[v + 1]; ++i)
+            {
+                normal = normal + faceNormals[rings.faces[i]];
+            }
+            normals[v] = Normalised(normal);
+        }
+    });
+    return normals;
+}
+
+template VertexRings BuildVertexRings(const SurfaceMesh& mesh);
+template VertexRings BuildVertexRings(const SurfaceMeshF& mesh);
+template std::vector<Vec3d> CalculateVertexNormals(const SurfaceMesh& mesh, const VertexRings& rings);
+template std::vector<Vec3f> CalculateVertexNormals(const SurfaceMeshF& mesh, const VertexRings& rings);
@@ -1,5 +1,8 @@
 #include "Resha.h"
 #include <assert.h>
+#include <math.h>
+
+#include <algorithm>
 
 #include <GL/gl3w.h>
 
@@ -134,57 +137,266 @@ void UpdateTexture(uint32_t textureId, size_t width, size_t height, Color* rgbaD
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgbaData);
 }
 
+namespace
+{
+struct VertexInfo
+{
+    Vec3f position;
+    Vec3f normal;
+};
+
+template <typename Vec>
+std::vector<VertexInfo> PackVertices(const BasicSurfaceMesh<Vec>& mesh, const std::vector<Vec>& vertexNormals,
+                                     size_t begin, size_t end)
+{
+    std::vector<VertexInfo> vertices(end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+        VertexInfo& vertex = vertices[i - begin];
+        vertex.position.x = mesh.vertices[i].x;
+        vertex.normal.x = vertexNormals[i].x;
+        vertex.position.y = mesh.vertices[i].y;
+        vertex.normal.y = vertexNormals[i].y;
+        vertex.position.z = mesh.vertices[i].z;
+        vertex.normal.z = vertexNormals[i].z;
+    }
+    return vertices;
+}
+
+template <typename Vec>
+void UploadSurfaceMesh(const BasicSurfaceMesh<Vec>& mesh, const std::vector<Vec>& vertexNormals,
+                       uint32_t& vertexBufferObject, uint32_t& vertexBufferId, uint32_t& elementBufferId)
+{
+    const size_t verticesCount = mesh.vertices.size();
+    const std::vector<VertexInfo> vertices = PackVertices(mesh, vertexNormals, 0, verticesCount);
+
+    const uint32_t* indicies = (const uint32_t*)(mesh.faces.data());
+
+    glGenVertexArrays(1, &vertexBufferObject);
+    glBindVertexArray(vertexBufferObject);
+    glGenBuffers(1, &vertexBufferId);
+    glGenBuffers(1, &elementBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+    glBufferData(GL_ARRAY_BUFFER, verticesCount * sizeof(VertexInfo), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo), (void*)offsetof(VertexInfo, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo), (void*)offsetof(VertexInfo, normal));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferId);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.faces.size() * sizeof(Triangle), indicies, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+double DistanceToBBox(const Vec3d& p, const BBox& box)
+{
+    double squaredDistance = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+        const double d = std::max(std::max(box.min.data[i] - p.data[i], p.data[i] - box.max.data[i]), 0.0);
+        squaredDistance += d * d;
+    }
+    return sqrt(squaredDistance);
+}
+
+void DestroySurfaceMeshRenderLods(MeshRenderInfo& info)
+{
+    for (MeshRenderLod& lod : info.lods)
+    {
+        glDeleteBuffers(1, &lod.vertexBufferId);
+        glDeleteBuffers(1, &lod.elementBufferId);
+        glDeleteVertexArrays(1, &lod.vertexBufferObject);
+    }
+    info.lods.clear();
+}
+
+void FitCamera(Camera& c, const Vec3d& center, double lengthScale)
+{
+    c.center = center;
+    c.lengthScale = lengthScale;
+
+    const Mat4 Tobj = Translate(Identity(), c.center * -1.0);
+    const Mat4 Tcam = Translate(Identity(), Vec3d{ 0.0, 0.0f, -1.5 * c.lengthScale });
+
+    c.viewMatrix = Tcam * Tobj;
+    c.fov = Camera::DEFAULT_FOV;
+    c.nearClipRatio = Camera::DEFAULT_NEAR_CLIP;
+    c.farClipRatio = Camera::DEFAULT_FAR_CLIP;
+}
+}
+
 MeshRenderInfo CreateSurfaceMeshRenderInfo(SurfaceMesh& mesh)
 {
     MeshRenderInfo result;
 
-    const std::vector<Vec3d> vertexNormals = CalculateVertexNormals(mesh, BuildConnectivity(mesh));
+    result.box = CalculateBoundingBox(mesh);
+    result.orientedBox = CalculateOrientedBoundingBox(mesh.vertices);
+    result.verticesCount = mesh.vertices.size();
+    result.facesCount = mesh.faces.size();
+    result.id = mesh.id;
+    result.meshlets = BuildMeshlets(mesh);
+    OptimiseMeshletsForRendering(mesh, result.meshlets);
+    result.cacheStatistics = CalculateVertexCacheStatistics(mesh);
+
+    const std::vector<Vec3d> vertexNormals = CalculateVertexNormals(mesh, BuildVertexRings(mesh));
+
+    UploadSurfaceMesh(mesh, vertexNormals, result.vertexBufferObject, result.vertexBufferId, result.elementBufferId);
+    return result;
+}
+
+MeshRenderInfo CreateSurfaceMeshRenderInfo(SurfaceMeshF& mesh)
+{
+    MeshRenderInfo result;
 
     result.box = CalculateBoundingBox(mesh);
+    result.orientedBox = CalculateOrientedBoundingBox(mesh.vertices);
     result.verticesCount = mesh.vertices.size();
     result.facesCount = mesh.faces.size();
     result.id = mesh.id;
+    result.meshlets = BuildMeshlets(mesh);
+    OptimiseMeshletsForRendering(mesh, result.meshlets);
+    result.cacheStatistics = CalculateVertexCacheStatistics(mesh);
+
+    const std::vector<Vec3f> vertexNormals = CalculateVertexNormals(mesh, BuildVertexRings(mesh));
+
+    UploadSurfaceMesh(mesh, vertexNormals, result.vertexBufferObject, result.vertexBufferId, result.elementBufferId);
+    return result;
+}
 
-    struct VertexInfo
+void DestroySurfaceMeshRenderInfo(MeshRenderInfo& info)
+{
+    DestroySurfaceMeshRenderLods(info);
+    ClearSurfaceMeshScalars(info);
+    glDeleteBuffers(1, &info.vertexBufferId);
+    glDeleteBuffers(1, &info.elementBufferId);
+    glDeleteVertexArrays(1, &info.vertexBufferObject);
+    info.facesCount = 0;
+    info.verticesCount = 0;
+}
+
+void UpdateSurfaceMeshRenderInfo(MeshRenderInfo& info, const SurfaceMesh& mesh, const std::vector<Vec3d>& vertexNormals,
+                                 size_t begin, size_t end)
+{
+    end = std::min(end, mesh.vertices.size());
+    DestroySurfaceMeshRenderLods(info);
+    info.box = CalculateBoundingBox(mesh);
+    info.orientedBox = CalculateOrientedBoundingBox(mesh.vertices);
+    CalculateMeshletsBounds(mesh, info.meshlets);
+    if (begin >= end)
     {
-        Vec3f position;
-        Vec3f normal;
-    };
-    std::vector<VertexInfo> vertices(result.verticesCount);
-    for (size_t i = 0; i < result.verticesCount; i++)
+        return;
+    }
+    const std::vector<VertexInfo> vertices = PackVertices(mesh, vertexNormals, begin, end);
+    glBindBuffer(GL_ARRAY_BUFFER, info.vertexBufferId);
+    glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(VertexInfo), vertices.size() * sizeof(VertexInfo), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SetSurfaceMeshScalars(MeshRenderInfo& info, const std::vector<double>& values, double min, double max)
+{
+    const double scale = max > min ? 1.0 / (max - min) : 0.0;
+    std::vector<float> data(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        data[i] = float(std::min(std::max((values[i] - min) * scale, 0.0), 1.0));
+    }
+    glBindVertexArray(info.vertexBufferObject);
+    if (info.scalarBufferId == 0)
     {
-        vertices[i].position.x = mesh.vertices[i].x;
-        vertices[i].normal.x = vertexNormals[i].x;
-        vertices[i].position.y = mesh.vertices[i].y;
-        vertices[i].normal.y = vertexNormals[i].y;
-        vertices[i].position.z = mesh.vertices[i].z;
-        vertices[i].normal.z = vertexNormals[i].z;
+        glGenBuffers(1, &info.scalarBufferId);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, info.scalarBufferId);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+}
 
-    const uint32_t* indicies = (const uint32_t*)(mesh.faces.data());
+void ClearSurfaceMeshScalars(MeshRenderInfo& info)
+{
+    if (info.scalarBufferId == 0)
+    {
+        return;
+    }
+    glBindVertexArray(info.vertexBufferObject);
+    glDisableVertexAttribArray(2);
+    glBindVertexArray(0);
+    glDeleteBuffers(1, &info.scalarBufferId);
+    info.scalarBufferId = 0;
+}
+
+LinesRenderInfo CreateLinesRenderInfo(const std::vector<Vec3d>& segments)
+{
+    LinesRenderInfo result;
+    std::vector<Vec3f> vertices(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        vertices[i] = Vec3f{ float(segments[i].x), float(segments[i].y), float(segments[i].z) };
+    }
+    result.verticesCount = vertices.size();
 
     glGenVertexArrays(1, &result.vertexBufferObject);
     glBindVertexArray(result.vertexBufferObject);
     glGenBuffers(1, &result.vertexBufferId);
-    glGenBuffers(1, &result.elementBufferId);
     glBindBuffer(GL_ARRAY_BUFFER, result.vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, result.verticesCount * sizeof(VertexInfo), vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo), (void*)offsetof(VertexInfo, position));
+    glBufferData(GL_ARRAY_BUFFER, result.verticesCount * sizeof(Vec3f), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), (void*)0);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexInfo), (void*)offsetof(VertexInfo, normal));
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.elementBufferId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, result.facesCount * sizeof(Triangle), indicies, GL_STATIC_DRAW);
     glBindVertexArray(0);
     return result;
 }
 
+LinesRenderInfo CreateContoursRenderInfo(const std::vector<SliceLayer>& layers)
+{
+    std::vector<Vec3d> segments;
+    for (const SliceLayer& layer : layers)
+    {
+        for (const Polyline& contour : layer.contours)
+        {
+            const size_t count = contour.points.size();
+            const size_t segmentsCount = contour.closed ? count : count - 1;
+            for (size_t i = 0; i < segmentsCount && count > 1; ++i)
+            {
+                segments.push_back(contour.points[i]);
+                segments.push_back(contour.points[(i + 1) % count]);
+            }
+        }
+    }
+    return CreateLinesRenderInfo(segments);
+}
+
+void DestroyLinesRenderInfo(LinesRenderInfo& info)
+{
+    glDeleteBuffers(1, &info.vertexBufferId);
+    glDeleteVertexArrays(1, &info.vertexBufferObject);
+    info.verticesCount = 0;
+}
+
+void AddSurfaceMeshRenderLod(MeshRenderInfo& info, const MeshLod& lod)
+{
+    MeshRenderLod result;
+    result.facesCount = lod.mesh.faces.size();
+    result.error = lod.error;
+    UploadSurfaceMesh(lod.mesh, lod.normals, result.vertexBufferObject, result.vertexBufferId, result.elementBufferId);
+    info.lods.push_back(result);
+}
 
 Mat4 CameraGetViewMatrix(const Camera& c)
 {
     return c.viewMatrix;
 }
 
+Vec3d CameraGetPosition(const Camera& c)
+{
+    // the view matrix is a rigid transform, the eye is at -R^T * t
+    const auto& m = c.viewMatrix.elements;
+    Vec3d result;
+    for (int i = 0; i < 3; i++)
+    {
+        result.data[i] = -(m[i][0] * m[3][0] + m[i][1] * m[3][1] + m[i][2] * m[3][2]);
+    }
+    return result;
+}
+
 Mat4 CameraGetProjectionMatrix(const Camera& c, size_t width, size_t height)
 {
     const double farClip = c.farClipRatio * c.lengthScale;
@@ -196,16 +408,35 @@ Mat4 CameraGetProjectionMatrix(const Camera& c, size_t width, size_t height)
 
 void CameraFitBBox(Camera& c, const BBox& box)
 {
-    c.center = CalculateBBoxCenter(box);
-    c.lengthScale = Length(box.max - box.min);
+    FitCamera(c, CalculateBBoxCenter(box), Length(box.max - box.min));
+}
 
-    const Mat4 Tobj = Translate(Identity(), c.center * -1.0);
-    const Mat4 Tcam = Translate(Identity(), Vec3d{ 0.0, 0.0f, -1.5 * c.lengthScale });
+void CameraFitOBB(Camera& c, const OBB& box)
+{
+    FitCamera(c, box.center, 2.0 * Length(box.halfExtents));
+}
 
-    c.viewMatrix = Tcam * Tobj;
-    c.fov = Camera::DEFAULT_FOV;
-    c.nearClipRatio = Camera::DEFAULT_NEAR_CLIP;
-    c.farClipRatio = Camera::DEFAULT_FAR_CLIP;
+Frustum CameraGetFrustum(const Camera& c, size_t width, size_t height)
+{
+    Vec3d look, up, right;
+    CameraGetFrame(c, look, up, right);
+    const Vec3d eye = CameraGetPosition(c);
+    const double tanY = tan(Deg2Rad(c.fov) / 2.0);
+    const double tanX = tanY * width / (double)height;
+    Frustum result;
+    result.normals[0] = look;
+    result.normals[1] = look * -1.0;
+    result.normals[2] = Normalised(look * tanX + right);
+    result.normals[3] = Normalised(look * tanX - right);
+    result.normals[4] = Normalised(look * tanY + up);
+    result.normals[5] = Normalised(look * tanY - up);
+    for (int p = 0; p < 6; ++p)
+    {
+        result.offsets[p] = -DotProduct(result.normals[p], eye);
+    }
+    result.offsets[0] -= c.nearClipRatio * c.lengthScale;
+    result.offsets[1] += c.farClipRatio * c.lengthScale;
+    return result;
 }
 
 void CameraGetFrame(const Camera& c, Vec3d& look, Vec3d& up, Vec3d& right)
@@ -223,6 +454,17 @@ void CameraGetFrame(const Camera& c, Vec3d& look, Vec3d& up, Vec3d& right)
     right = r * Vec3d{ 1.0, 0.0, 0.0 };
 }
 
+void CameraGetRay(const Camera& c, size_t width, size_t height, Vec2d pixel, Vec3d& origin, Vec3d& direction)
+{
+    Vec3d look, up, right;
+    CameraGetFrame(c, look, up, right);
+    const double tanHalfFov = tan(Deg2Rad(c.fov) / 2.0);
+    const double x = (2.0 * pixel.x / width - 1.0) * tanHalfFov * width / (double)height;
+    const double y = (1.0 - 2.0 * pixel.y / height) * tanHalfFov;
+    origin = CameraGetPosition(c);
+    direction = Normalised(look + right * x + up * y);
+}
+
 void CameraProcessZoom(Camera& c, double amount)
 {
     if (amount == 0.0)
@@ -273,17 +515,86 @@ void CameraProcessTranslate(Camera& c, Vec2d delta)
     c.viewMatrix = camSpaceT * c.viewMatrix;
 }
 
-void RenderMesh(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info)
+size_t SelectMeshLod(const MeshRenderInfo& info, const Camera& c, size_t viewportHeight, double maxPixelError)
+{
+    const double distance = DistanceToBBox(CameraGetPosition(c), info.box);
+    if (info.lods.empty() || distance <= 0.0 || viewportHeight == 0)
+    {
+        return 0;
+    }
+    const double pixelsPerUnit = viewportHeight / (2.0 * distance * tan(0.5 * Deg2Rad(c.fov)));
+    size_t result = 0;
+    while (result < info.lods.size() && info.lods[result].error * pixelsPerUnit <= maxPixelError)
+    {
+        result++;
+    }
+    return result;
+}
+
+void RenderMesh(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info, size_t lod)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, buffer.frameBufferId);
     glUseProgram(program.id);
-    glBindVertexArray(info.vertexBufferObject);
-    const size_t dataSize = 3 * info.facesCount;
+    const bool simplified = lod > 0 && lod <= info.lods.size();
+    glBindVertexArray(simplified ? info.lods[lod - 1].vertexBufferObject : info.vertexBufferObject);
+    const size_t dataSize = 3 * (simplified ? info.lods[lod - 1].facesCount : info.facesCount);
     glDrawElements(GL_TRIANGLES, dataSize, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void RenderMeshlets(const RenderBuffer& buffer, const Program& program, const MeshRenderInfo& info,
+                    const Frustum& frustum, const Vec3d& eye)
+{
+    bool eyeInBox = true;
+    for (int i = 0; i < 3; i++)
+    {
+        eyeInBox = eyeInBox && eye.data[i] >= info.box.min.data[i] && eye.data[i] <= info.box.max.data[i];
+    }
+    const bool cullBackFacing = info.cullBackFacing && !eyeInBox;
+    // the visible meshlets following each other are drawn as one range.
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    size_t rangeEnd = SIZE_MAX;
+    for (const Meshlet& meshlet : info.meshlets)
+    {
+        if (!IsMeshletInFrustum(frustum, meshlet) || (cullBackFacing && IsMeshletBackFacing(meshlet, eye)))
+        {
+            continue;
+        }
+        if (meshlet.faceOffset == rangeEnd)
+        {
+            counts.back() += GLsizei(3 * meshlet.facesCount);
+        }
+        else
+        {
+            counts.push_back(GLsizei(3 * meshlet.facesCount));
+            offsets.push_back((const void*)(meshlet.faceOffset * sizeof(Triangle)));
+        }
+        rangeEnd = meshlet.faceOffset + meshlet.facesCount;
+    }
+    if (counts.empty())
+    {
+        return;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, buffer.frameBufferId);
+    glUseProgram(program.id);
+    glBindVertexArray(info.vertexBufferObject);
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), GLsizei(counts.size()));
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderLines(const RenderBuffer& buffer, const Program& program, const LinesRenderInfo& info)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, buffer.frameBufferId);
+    glUseProgram(program.id);
+    glBindVertexArray(info.vertexBufferObject);
+    glDrawArrays(GL_LINES, 0, info.verticesCount);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 RenderBuffer CreateRenderBuffer(size_t width, size_t height)
 {
     RenderBuffer result;
@@ -340,6 +651,13 @@ void ClearRenderBuffer(const RenderBuffer& buffer, Color c)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void SetProgramUniform1i(const Program& program, const char* name, int value)
+{
+    glUseProgram(program.id);
+    glUniform1i(glGetUniformLocation(program.id, name), value);
+    glUseProgram(0);
+}
+
 void SetProgramUniformV3f(const Program& program, const char* name, const float data[3])
 {
     glUseProgram(program.id);
@@ -0,0 +1,530 @@
+#include "Resha.h"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t BLOCKS_GRAIN_SIZE = 4;
+    // blocks of 8 x 8 x 8 nodes, the same as the voxel blocks.
+    constexpr uint32_t BLOCK_SIZE = 8;
+    constexpr uint32_t SAMPLES_SIZE = BLOCK_SIZE + 1;
+    constexpr uint32_t BLOCK_EDGES_COUNT = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE * 3;
+    constexpr uint32_t NO_VERTEX = UINT32_MAX;
+    // the vertices stay this fraction of an edge away from its nodes, a node equal to the iso value
+    // would give all its crossed edges the same vertex position and zero area faces around it.
+    constexpr double MIN_EDGE_FRACTION = 1e-3;
+
+    // corner c of a cell is at offset (c & 1, (c >> 1) & 1, c >> 2) from its lowest node, edge
+    // 4a + p goes along axis a from the corner whose other two coordinates are p & 1 along
+    // (a + 1) % 3 and p >> 1 along (a + 2) % 3.
+    int EdgeBetween(int c0, int c1)
+    {
+        const int corner = c0 & c1;
+        const int axis = (c0 ^ c1) == 1 ? 0 : ((c0 ^ c1) == 2 ? 1 : 2);
+        const int u = (axis + 1) % 3;
+        const int w = (axis + 2) % 3;
+        return axis * 4 + ((corner >> u) & 1) + 2 * ((corner >> w) & 1);
+    }
+
+    int EdgeStartCorner(int edge)
+    {
+        const int axis = edge / 4;
+        const int u = (axis + 1) % 3;
+        const int w = (axis + 2) % 3;
+        return ((edge & 1) << u) | (((edge >> 1) & 1) << w);
+    }
+
+    // whether two edges of a cell are on one of its faces.
+    bool ShareFace(int e0, int e1)
+    {
+        const int c0 = EdgeStartCorner(e0);
+        const int c1 = EdgeStartCorner(e1);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (axis != e0 / 4 && axis != e1 / 4 && ((c0 >> axis) & 1) == ((c1 >> axis) & 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a fan from loop[start] whose diagonals don't lie on a face of the cell, those would overlap
+    // the triangles of the neighbouring cell.
+    bool CanFanFrom(const int* loop, int length, int start)
+    {
+        for (int i = 2; i + 1 < length; ++i)
+        {
+            if (ShareFace(loop[start], loop[(start + i) % length]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // triangles of a cell by the set of its corners inside, as edges of the cell.
+    struct MarchingCase
+    {
+        uint8_t trianglesCount = 0;
+        uint8_t edges[12 * 3];
+    };
+
+    struct MarchingCases
+    {
+        MarchingCase cases[256];
+    };
+
+    // the table is built from the cube faces rather than written out: on every face the inside
+    // corners are cut off by segments from the edge the face boundary enters them through to the
+    // edge it leaves them through, going counter clockwise seen from outside. the two inside
+    // corners of an ambiguous face are always cut off separately, so neighbouring cells make the
+    // same choice on the face they share. the segments of a cell chain into loops, each one is
+    // triangulated as a fan.
+    MarchingCases BuildMarchingCases()
+    {
+        MarchingCases table;
+        for (int c = 0; c < 256; ++c)
+        {
+            int next[12];
+            std::fill(next, next + 12, -1);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const int u = (axis + 1) % 3;
+                const int w = (axis + 2) % 3;
+                for (int side = 0; side < 2; ++side)
+                {
+                    // counter clockwise around the outward normal, the sign of the axis for side 1.
+                    static const int SQUARE[2][4][2] =
+                    {
+                        { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } }, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } }
+                    };
+                    int corners[4];
+                    bool inside[4];
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        corners[k] = (side << axis) | (SQUARE[side][k][0] << u) | (SQUARE[side][k][1] << w);
+                        inside[k] = (c >> corners[k]) & 1;
+                    }
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        if (!inside[k] || inside[(k + 1) % 4])
+                        {
+                            continue;
+                        }
+                        int first = k;
+                        while (inside[(first + 3) % 4])
+                        {
+                            first = (first + 3) % 4;
+                        }
+                        next[EdgeBetween(corners[(first + 3) % 4], corners[first])] = EdgeBetween(corners[k], corners[(k + 1) % 4]);
+                    }
+                }
+            }
+            MarchingCase& result = table.cases[c];
+            bool visited[12] = {};
+            for (int e = 0; e < 12; ++e)
+            {
+                if (next[e] < 0 || visited[e])
+                {
+                    continue;
+                }
+                int loop[12];
+                int length = 0;
+                for (int edge = e; !visited[edge]; edge = next[edge])
+                {
+                    visited[edge] = true;
+                    loop[length++] = edge;
+                }
+                int start = 0;
+                while (start < length && !CanFanFrom(loop, length, start))
+                {
+                    ++start;
+                }
+                for (int i = 1; i + 1 < length; ++i)
+                {
+                    uint8_t* triangle = result.edges + result.trianglesCount * 3;
+                    triangle[0] = uint8_t(loop[start]);
+                    triangle[1] = uint8_t(loop[(start + i) % length]);
+                    triangle[2] = uint8_t(loop[(start + i + 1) % length]);
+                    result.trianglesCount++;
+                }
+            }
+        }
+        return table;
+    }
+
+    const MarchingCases& GetMarchingCases()
+    {
+        static const MarchingCases table = BuildMarchingCases();
+        return table;
+    }
+
+    // what the first pass leaves for the second one.
+    struct BlockVertices
+    {
+        // vertex of every edge the block owns (those starting at one of its nodes), in the order of
+        // the block. empty when the block has none.
+        std::vector<uint32_t> edgeVertices;
+        std::vector<Vec3d> positions;
+        size_t facesCount = 0;
+        size_t firstVertex = 0;
+        size_t firstFace = 0;
+        size_t neighbours[8]; // blocks at offsets (n & 1, (n >> 1) & 1, n >> 2), SIZE_MAX when absent.
+    };
+
+    // values of the nodes [first, first + SAMPLES_SIZE) of a block, those past the grid are unused.
+    struct BlockSamples
+    {
+        uint32_t first[3];
+        uint32_t count[3]; // nodes inside the grid.
+        double values[SAMPLES_SIZE][SAMPLES_SIZE][SAMPLES_SIZE]; // [z][y][x].
+    };
+
+    // marching cubes over the blocks of the nodes grid with the given keys (x + X * (y + Y * z)
+    // in blocks), sorted. sample(block, samples) fills the values of a block. the vertices of an
+    // edge belong to the block of its first node, the cells find those of their neighbours
+    // through their edge tables so the output comes out welded.
+    template <typename Sampler>
+    SurfaceMesh MarchBlocks(const uint32_t dimensions[3], const Vec3d& origin, double spacing,
+                            const std::vector<uint64_t>& keys, double isoValue, Sampler sample)
+    {
+        SurfaceMesh result;
+        const MarchingCases& table = GetMarchingCases();
+        uint32_t blocksCount[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            blocksCount[axis] = (dimensions[axis] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+        auto fillSamples = [&](uint64_t key, BlockSamples& samples)
+        {
+            const uint32_t block[3] =
+            {
+                uint32_t(key % blocksCount[0]), uint32_t(key / blocksCount[0] % blocksCount[1]),
+                uint32_t(key / blocksCount[0] / blocksCount[1])
+            };
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                samples.first[axis] = block[axis] * BLOCK_SIZE;
+                samples.count[axis] = std::min(SAMPLES_SIZE, dimensions[axis] - samples.first[axis]);
+            }
+            sample(block, samples);
+        };
+        auto cellCase = [&](const BlockSamples& samples, uint32_t x, uint32_t y, uint32_t z)
+        {
+            int c = 0;
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                if (samples.values[z + (corner >> 2)][y + ((corner >> 1) & 1)][x + (corner & 1)] < isoValue)
+                {
+                    c |= 1 << corner;
+                }
+            }
+            return c;
+        };
+        // most blocks are away from the surface, with all their nodes on the same side.
+        auto isCrossed = [&](const BlockSamples& samples)
+        {
+            const bool below = samples.values[0][0][0] < isoValue;
+            for (uint32_t z = 0; z < samples.count[2]; ++z)
+            {
+                for (uint32_t y = 0; y < samples.count[1]; ++y)
+                {
+                    for (uint32_t x = 0; x < samples.count[0]; ++x)
+                    {
+                        if ((samples.values[z][y][x] < isoValue) != below)
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        };
+        // cells of the block, those whose lowest node is in it and whose highest one is in the grid.
+        auto cellsCount = [&](const BlockSamples& samples, int axis)
+        {
+            return std::min(BLOCK_SIZE, samples.count[axis] - 1);
+        };
+
+        // first pass: the vertices on the edges each block owns and the number of faces.
+        std::vector<BlockVertices> blocks(keys.size());
+        ParallelFor(keys.size(), BLOCKS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            BlockSamples samples;
+            for (size_t b = begin; b < end; ++b)
+            {
+                BlockVertices& block = blocks[b];
+                fillSamples(keys[b], samples);
+                if (!isCrossed(samples))
+                {
+                    continue;
+                }
+                const uint32_t nodes[3] =
+                {
+                    std::min(BLOCK_SIZE, samples.count[0]), std::min(BLOCK_SIZE, samples.count[1]),
+                    std::min(BLOCK_SIZE, samples.count[2])
+                };
+                for (uint32_t z = 0; z < nodes[2]; ++z)
+                {
+                    for (uint32_t y = 0; y < nodes[1]; ++y)
+                    {
+                        for (uint32_t x = 0; x < nodes[0]; ++x)
+                        {
+                            const uint32_t node[3] = { x, y, z };
+                            const double v0 = samples.values[z][y][x];
+                            for (int axis = 0; axis < 3; ++axis)
+                            {
+                                if (node[axis] + 1 >= samples.count[axis])
+                                {
+                                    continue;
+                                }
+                                const double v1 = samples.values[z + (axis == 2)][y + (axis == 1)][x + (axis == 0)];
+                                if ((v0 < isoValue) == (v1 < isoValue))
+                                {
+                                    continue;
+                                }
+                                if (block.edgeVertices.empty())
+                                {
+                                    block.edgeVertices.assign(BLOCK_EDGES_COUNT, NO_VERTEX);
+                                }
+                                block.edgeVertices[((z * BLOCK_SIZE + y) * BLOCK_SIZE + x) * 3 + axis] = uint32_t(block.positions.size());
+                                const double t = std::min(std::max((isoValue - v0) / (v1 - v0), MIN_EDGE_FRACTION),
+                                                          1.0 - MIN_EDGE_FRACTION);
+                                Vec3d p{ double(samples.first[0] + x), double(samples.first[1] + y), double(samples.first[2] + z) };
+                                p.data[axis] += t;
+                                block.positions.push_back(Vec3d{ origin.x + p.x * spacing, origin.y + p.y * spacing,
+                                                                 origin.z + p.z * spacing });
+                            }
+                        }
+                    }
+                }
+                for (uint32_t z = 0; z < cellsCount(samples, 2); ++z)
+                {
+                    for (uint32_t y = 0; y < cellsCount(samples, 1); ++y)
+                    {
+                        for (uint32_t x = 0; x < cellsCount(samples, 0); ++x)
+                        {
+                            block.facesCount += table.cases[cellCase(samples, x, y, z)].trianglesCount;
+                        }
+                    }
+                }
+            }
+        });
+
+        // the blocks are laid out in key order whatever the threads.
+        size_t verticesCount = 0;
+        size_t facesCount = 0;
+        for (size_t b = 0; b < keys.size(); ++b)
+        {
+            BlockVertices& block = blocks[b];
+            block.firstVertex = verticesCount;
+            block.firstFace = facesCount;
+            verticesCount += block.positions.size();
+            facesCount += block.facesCount;
+            const uint32_t bx = uint32_t(keys[b] % blocksCount[0]);
+            const uint32_t by = uint32_t(keys[b] / blocksCount[0] % blocksCount[1]);
+            for (int n = 0; n < 8; ++n)
+            {
+                const uint32_t offset[3] = { uint32_t(n & 1), uint32_t((n >> 1) & 1), uint32_t(n >> 2) };
+                const uint64_t key = keys[b] + offset[0] + (offset[1] + uint64_t(offset[2]) * blocksCount[1]) * blocksCount[0];
+                const bool inGrid = bx + offset[0] < blocksCount[0] && by + offset[1] < blocksCount[1];
+                const auto it = std::lower_bound(keys.begin(), keys.end(), key);
+                block.neighbours[n] = inGrid && it != keys.end() && *it == key ? size_t(it - keys.begin()) : SIZE_MAX;
+            }
+        }
+        result.vertices.resize(verticesCount);
+        result.faces.resize(facesCount);
+
+        // second pass: the faces, their vertices are found in the tables of the blocks owning them.
+        ParallelFor(keys.size(), BLOCKS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            BlockSamples samples;
+            for (size_t b = begin; b < end; ++b)
+            {
+                const BlockVertices& block = blocks[b];
+                std::copy(block.positions.begin(), block.positions.end(), result.vertices.begin() + block.firstVertex);
+                if (block.facesCount == 0)
+                {
+                    continue;
+                }
+                fillSamples(keys[b], samples);
+                Triangle* face = result.faces.data() + block.firstFace;
+                for (uint32_t z = 0; z < cellsCount(samples, 2); ++z)
+                {
+                    for (uint32_t y = 0; y < cellsCount(samples, 1); ++y)
+                    {
+                        for (uint32_t x = 0; x < cellsCount(samples, 0); ++x)
+                        {
+                            const MarchingCase& cell = table.cases[cellCase(samples, x, y, z)];
+                            for (int i = 0; i < cell.trianglesCount * 3; ++i)
+                            {
+                                const int edge = cell.edges[i];
+                                const int corner = EdgeStartCorner(edge);
+                                uint32_t node[3] = { x + (corner & 1), y + ((corner >> 1) & 1), z + (corner >> 2) };
+                                int neighbour = 0;
+                                for (int axis = 0; axis < 3; ++axis)
+                                {
+                                    if (node[axis] == BLOCK_SIZE)
+                                    {
+                                        node[axis] = 0;
+                                        neighbour |= 1 << axis;
+                                    }
+                                }
+                                const BlockVertices& owner = blocks[block.neighbours[neighbour]];
+                                const uint32_t vertex = owner.edgeVertices[((node[2] * BLOCK_SIZE + node[1]) * BLOCK_SIZE + node[0]) * 3 + edge / 4];
+                                face[i / 3].idx[i % 3] = uint32_t(owner.firstVertex + vertex);
+                            }
+                            face += cell.trianglesCount;
+                        }
+                    }
+                }
+            }
+        });
+        return result;
+    }
+}
+
+SurfaceMesh ExtractIsosurface(const ScalarGrid& grid, double isoValue)
+{
+    const size_t nodesCount = size_t(grid.dimensions[0]) * grid.dimensions[1] * grid.dimensions[2];
+    if (nodesCount == 0 || grid.values.size() != nodesCount)
+    {
+        return SurfaceMesh();
+    }
+    uint64_t blocksCount = 1;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        blocksCount *= (grid.dimensions[axis] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    std::vector<uint64_t> keys(blocksCount);
+    for (uint64_t b = 0; b < blocksCount; ++b)
+    {
+        keys[b] = b;
+    }
+    SurfaceMesh result = MarchBlocks(grid.dimensions, grid.origin, grid.spacing, keys, isoValue,
+        [&](const uint32_t[3], BlockSamples& samples)
+        {
+            for (uint32_t z = 0; z < samples.count[2]; ++z)
+            {
+                for (uint32_t y = 0; y < samples.count[1]; ++y)
+                {
+                    const float* row = grid.values.data() +
+                        ((size_t(samples.first[2] + z) * grid.dimensions[1] + samples.first[1] + y) * grid.dimensions[0] + samples.first[0]);
+                    for (uint32_t x = 0; x < samples.count[0]; ++x)
+                    {
+                        samples.values[z][y][x] = row[x];
+                    }
+                }
+            }
+        });
+    result.color = GenerateColor();
+    result.id = GenerateUUID();
+    return result;
+}
+
+SurfaceMesh ExtractIsosurface(const VoxelGrid& grid)
+{
+    if (grid.blockKeys.empty())
+    {
+        return SurfaceMesh();
+    }
+    // node n is the centre of voxel n - 1, the grid gets a layer of empty nodes all around so the
+    // surface stays closed where the voxels reach its side.
+    const uint32_t voxelBlocks[3] =
+    {
+        (grid.dimensions[0] + BLOCK_SIZE - 1) / BLOCK_SIZE, (grid.dimensions[1] + BLOCK_SIZE - 1) / BLOCK_SIZE,
+        (grid.dimensions[2] + BLOCK_SIZE - 1) / BLOCK_SIZE
+    };
+    const uint32_t dimensions[3] = { grid.dimensions[0] + 2, grid.dimensions[1] + 2, grid.dimensions[2] + 2 };
+    const uint32_t nodeBlocks[3] =
+    {
+        (dimensions[0] + BLOCK_SIZE - 1) / BLOCK_SIZE, (dimensions[1] + BLOCK_SIZE - 1) / BLOCK_SIZE,
+        (dimensions[2] + BLOCK_SIZE - 1) / BLOCK_SIZE
+    };
+    // the nodes of voxel block b are in the node blocks b and b + 1, the cells reaching into
+    // those start from b - 1 to b + 1.
+    std::vector<uint64_t> keys;
+    keys.reserve(grid.blockKeys.size() * 27);
+    for (uint64_t key : grid.blockKeys)
+    {
+        const int64_t block[3] =
+        {
+            int64_t(key % voxelBlocks[0]), int64_t(key / voxelBlocks[0] % voxelBlocks[1]),
+            int64_t(key / voxelBlocks[0] / voxelBlocks[1])
+        };
+        for (int64_t z = block[2] - 1; z <= block[2] + 1; ++z)
+        {
+            for (int64_t y = block[1] - 1; y <= block[1] + 1; ++y)
+            {
+                for (int64_t x = block[0] - 1; x <= block[0] + 1; ++x)
+                {
+                    if (x >= 0 && y >= 0 && z >= 0 && x < nodeBlocks[0] && y < nodeBlocks[1] && z < nodeBlocks[2])
+                    {
+                        keys.push_back((uint64_t(z) * nodeBlocks[1] + uint64_t(y)) * nodeBlocks[0] + uint64_t(x));
+                    }
+                }
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // the voxel centres are the nodes, 0 inside and 1 outside.
+    const Vec3d origin = grid.origin - Vec3d{ 0.5, 0.5, 0.5 } * grid.voxelSize;
+    SurfaceMesh result = MarchBlocks(dimensions, origin, grid.voxelSize, keys, 0.5,
+        [&](const uint32_t block[3], BlockSamples& samples)
+        {
+            // the samples of node block b are the voxels 8b - 1 to 8b + 7, the last one of voxel
+            // block b - 1 and then those of b. part[axis][s] is 0 or 1 for either, 2 past the grid.
+            uint8_t part[3][SAMPLES_SIZE];
+            uint32_t voxel[3][SAMPLES_SIZE];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t s = 0; s < samples.count[axis]; ++s)
+                {
+                    const int64_t v = int64_t(samples.first[axis]) + s - 1;
+                    part[axis][s] = v < 0 || v >= grid.dimensions[axis] ? 2 : uint8_t(v >= int64_t(block[axis]) * BLOCK_SIZE);
+                    voxel[axis][s] = uint32_t(v) % BLOCK_SIZE;
+                }
+            }
+            const VoxelBlock* voxels[8];
+            for (int n = 0; n < 8; ++n)
+            {
+                const int64_t b[3] =
+                {
+                    int64_t(block[0]) - 1 + (n & 1), int64_t(block[1]) - 1 + ((n >> 1) & 1), int64_t(block[2]) - 1 + (n >> 2)
+                };
+                voxels[n] = nullptr;
+                if (b[0] < 0 || b[1] < 0 || b[2] < 0 || b[0] >= voxelBlocks[0] || b[1] >= voxelBlocks[1] || b[2] >= voxelBlocks[2])
+                {
+                    continue;
+                }
+                const uint64_t key = (uint64_t(b[2]) * voxelBlocks[1] + uint64_t(b[1])) * voxelBlocks[0] + uint64_t(b[0]);
+                const auto it = std::lower_bound(grid.blockKeys.begin(), grid.blockKeys.end(), key);
+                if (it != grid.blockKeys.end() && *it == key)
+                {
+                    voxels[n] = &grid.blocks[it - grid.blockKeys.begin()];
+                }
+            }
+            for (uint32_t z = 0; z < samples.count[2]; ++z)
+            {
+                for (uint32_t y = 0; y < samples.count[1]; ++y)
+                {
+                    for (uint32_t x = 0; x < samples.count[0]; ++x)
+                    {
+                        bool set = false;
+                        if (part[0][x] < 2 && part[1][y] < 2 && part[2][z] < 2)
+                        {
+                            const VoxelBlock* bits = voxels[part[0][x] | (part[1][y] << 1) | (part[2][z] << 2)];
+                            set = bits && ((bits->bits[voxel[2][z]] >> (voxel[0][x] + voxel[1][y] * BLOCK_SIZE)) & 1);
+                        }
+                        samples.values[z][y][x] = set ? 0.0 : 1.0;
+                    }
+                }
+            }
+        });
+    result.color = GenerateColor();
+    result.id = GenerateUUID();
+    return result;
+}
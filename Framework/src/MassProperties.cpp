@@ -0,0 +1,146 @@
+#include "Resha.h"
+
+#include <math.h>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    // area followed by the integrals of 1, x, y, z, x^2, y^2, z^2, xy, yz and zx over the volume.
+    constexpr size_t SUMS_COUNT = 11;
+
+    // Kahan summation, the compensation keeps the low bits the running sum drops.
+    struct CompensatedSum
+    {
+        double sum = 0.0;
+        double compensation = 0.0;
+
+        void Add(double value)
+        {
+            const double y = value - compensation;
+            const double t = sum + y;
+            compensation = (t - sum) - y;
+            sum = t;
+        }
+    };
+
+    void Subexpressions(double w0, double w1, double w2, double& f1, double& f2, double& f3,
+                        double& g0, double& g1, double& g2)
+    {
+        const double temp0 = w0 + w1;
+        const double temp1 = w0 * w0;
+        const double temp2 = temp1 + w1 * temp0;
+        f1 = temp0 + w2;
+        f2 = temp2 + w2 * f1;
+        f3 = w0 * temp1 + w1 * temp2 + w2 * f2;
+        g0 = f2 + w0 * (f1 + w0);
+        g1 = f2 + w1 * (f1 + w1);
+        g2 = f2 + w2 * (f1 + w2);
+    }
+
+    // contribution of a face to the sums (Eberly, Polyhedral Mass Properties), the vertices are
+    // relative to the mesh box centre so the products don't lose the small coordinates.
+    void FaceIntegrals(const Vec3d& a, const Vec3d& b, const Vec3d& c, double values[SUMS_COUNT])
+    {
+        const double e1x = b.x - a.x, e1y = b.y - a.y, e1z = b.z - a.z;
+        const double e2x = c.x - a.x, e2y = c.y - a.y, e2z = c.z - a.z;
+        const double d0 = e1y * e2z - e1z * e2y;
+        const double d1 = e1z * e2x - e1x * e2z;
+        const double d2 = e1x * e2y - e1y * e2x;
+        double f1x, f2x, f3x, g0x, g1x, g2x;
+        double f1y, f2y, f3y, g0y, g1y, g2y;
+        double f1z, f2z, f3z, g0z, g1z, g2z;
+        Subexpressions(a.x, b.x, c.x, f1x, f2x, f3x, g0x, g1x, g2x);
+        Subexpressions(a.y, b.y, c.y, f1y, f2y, f3y, g0y, g1y, g2y);
+        Subexpressions(a.z, b.z, c.z, f1z, f2z, f3z, g0z, g1z, g2z);
+        values[0] = 0.5 * sqrt(d0 * d0 + d1 * d1 + d2 * d2);
+        values[1] = d0 * f1x;
+        values[2] = d0 * f2x;
+        values[3] = d1 * f2y;
+        values[4] = d2 * f2z;
+        values[5] = d0 * f3x;
+        values[6] = d1 * f3y;
+        values[7] = d2 * f3z;
+        values[8] = d0 * (a.y * g0x + b.y * g1x + c.y * g2x);
+        values[9] = d1 * (a.z * g0y + b.z * g1y + c.z * g2y);
+        values[10] = d2 * (a.x * g0z + b.x * g1z + c.x * g2z);
+    }
+}
+
+template <typename Vec>
+MassProperties CalculateMassProperties(const BasicSurfaceMesh<Vec>& mesh)
+{
+    MassProperties result;
+    const size_t facesCount = mesh.faces.size();
+    if (facesCount == 0)
+    {
+        return result;
+    }
+    const Vec3d origin = CalculateBBoxCenter(CalculateBoundingBox(mesh));
+
+    // every chunk of faces sums its own values, the chunks are fixed so the partial sums and
+    // the order they are combined in don't depend on the threads.
+    const size_t chunksCount = (facesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<CompensatedSum> partials(chunksCount * SUMS_COUNT);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        CompensatedSum* sums = partials.data() + (begin / GRAIN_SIZE) * SUMS_COUNT;
+        double values[SUMS_COUNT];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            FaceIntegrals(privWiden(mesh.vertices[t.idx[0]]) - origin, privWiden(mesh.vertices[t.idx[1]]) - origin,
+                          privWiden(mesh.vertices[t.idx[2]]) - origin, values);
+            for (size_t k = 0; k < SUMS_COUNT; ++k)
+            {
+                sums[k].Add(values[k]);
+            }
+        }
+    });
+    CompensatedSum totals[SUMS_COUNT];
+    for (size_t c = 0; c < chunksCount; ++c)
+    {
+        for (size_t k = 0; k < SUMS_COUNT; ++k)
+        {
+            totals[k].Add(partials[c * SUMS_COUNT + k].sum);
+            totals[k].Add(-partials[c * SUMS_COUNT + k].compensation);
+        }
+    }
+    static const double MULTIPLIERS[SUMS_COUNT] =
+    {
+        1.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 24.0, 1.0 / 24.0, 1.0 / 60.0, 1.0 / 60.0, 1.0 / 60.0,
+        1.0 / 120.0, 1.0 / 120.0, 1.0 / 120.0
+    };
+    double integrals[SUMS_COUNT];
+    for (size_t k = 0; k < SUMS_COUNT; ++k)
+    {
+        integrals[k] = totals[k].sum * MULTIPLIERS[k];
+    }
+
+    result.area = integrals[0];
+    result.volume = integrals[1];
+    if (result.volume == 0.0)
+    {
+        result.centroid = origin;
+        return result;
+    }
+    const Vec3d c{ integrals[2] / result.volume, integrals[3] / result.volume, integrals[4] / result.volume };
+    result.centroid = c + origin;
+    // the inertia doesn't depend on the origin once it is moved to the centroid.
+    const double xx = integrals[5] - result.volume * c.x * c.x;
+    const double yy = integrals[6] - result.volume * c.y * c.y;
+    const double zz = integrals[7] - result.volume * c.z * c.z;
+    const double xy = integrals[8] - result.volume * c.x * c.y;
+    const double yz = integrals[9] - result.volume * c.y * c.z;
+    const double zx = integrals[10] - result.volume * c.z * c.x;
+    Mat3& inertia = result.inertia;
+    inertia.elements[0][0] = yy + zz;
+    inertia.elements[1][1] = zz + xx;
+    inertia.elements[2][2] = xx + yy;
+    inertia.elements[0][1] = inertia.elements[1][0] = -xy;
+    inertia.elements[1][2] = inertia.elements[2][1] = -yz;
+    inertia.elements[0][2] = inertia.elements[2][0] = -zx;
+    return result;
+}
+
+template MassProperties CalculateMassProperties(const SurfaceMesh& mesh);
+template MassProperties CalculateMassProperties(const SurfaceMeshF& mesh);
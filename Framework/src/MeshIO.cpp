@@ -59,88 +59,118 @@ namespace
             return hash(v.x) ^ hash(v.y) ^ hash(v.z);
         }
     };
-} // namespace
 
-bool WriteStl(const SurfaceMesh& mesh, const char* fileName)
-{
-    std::vector<uint8_t>data;
-    data.resize(80);
-
-    const uint32_t facesCount = mesh.faces.size();
-    AppendData(facesCount, data);
-    for (size_t i = 0; i < facesCount; ++i)
+    template <typename Vec>
+    bool WriteStlMesh(const BasicSurfaceMesh<Vec>& mesh, const char* fileName)
     {
-        const Vec3d& v0 = mesh.vertices[mesh.faces[i].idx[0]];
-        const Vec3d& v1 = mesh.vertices[mesh.faces[i].idx[1]];
-        const Vec3d& v2 = mesh.vertices[mesh.faces[i].idx[2]];
-        assert(!(isnan(v0.x) || isnan(v0.y) || isnan(v0.z)));
-        assert(!(isnan(v1.x) || isnan(v1.y) || isnan(v1.z)));
-        assert(!(isnan(v2.x) || isnan(v2.y) || isnan(v2.z)));
-
-        const Vec3d dir0 = v1 - v0;
-        const Vec3d dir1 = v2 - v0;
-        Vec3d n = CrossProduct(dir0, dir1);
-        Normalise(n);
-        assert(!(isnan(n.x) || isnan(n.y) || isnan(n.z)));
-
-        AppendData<float>(n.x, data);
-        AppendData<float>(n.y, data);
-        AppendData<float>(n.z, data);
-        AppendData<float>(v0.x, data);
-        AppendData<float>(v0.y, data);
-        AppendData<float>(v0.z, data);
-        AppendData<float>(v1.x, data);
-        AppendData<float>(v1.y, data);
-        AppendData<float>(v1.z, data);
-        AppendData<float>(v2.x, data);
-        AppendData<float>(v2.y, data);
-        AppendData<float>(v2.z, data);
-        AppendData(uint16_t(0), data);
-    }
-    return WriteFile(fileName, data.data(), data.size());
-}
+        std::vector<uint8_t>data;
+        data.resize(80);
 
-IOStatus ReadMesh(const char* fileName, SurfaceMesh& result)
-{
-    std::vector<uint8_t> data;
-    if (!ReadFile(fileName, data))
-    {
-        return IOStatus::FILE_DOESNT_EXIST;
+        const uint32_t facesCount = mesh.faces.size();
+        AppendData(facesCount, data);
+        for (size_t i = 0; i < facesCount; ++i)
+        {
+            const Vec& v0 = mesh.vertices[mesh.faces[i].idx[0]];
+            const Vec& v1 = mesh.vertices[mesh.faces[i].idx[1]];
+            const Vec& v2 = mesh.vertices[mesh.faces[i].idx[2]];
+            assert(!(isnan(v0.x) || isnan(v0.y) || isnan(v0.z)));
+            assert(!(isnan(v1.x) || isnan(v1.y) || isnan(v1.z)));
+            assert(!(isnan(v2.x) || isnan(v2.y) || isnan(v2.z)));
+
+            const Vec dir0 = v1 - v0;
+            const Vec dir1 = v2 - v0;
+            Vec n = CrossProduct(dir0, dir1);
+            Normalise(n);
+            assert(!(isnan(n.x) || isnan(n.y) || isnan(n.z)));
+
+            AppendData<float>(n.x, data);
+            AppendData<float>(n.y, data);
+            AppendData<float>(n.z, data);
+            AppendData<float>(v0.x, data);
+            AppendData<float>(v0.y, data);
+            AppendData<float>(v0.z, data);
+            AppendData<float>(v1.x, data);
+            AppendData<float>(v1.y, data);
+            AppendData<float>(v1.z, data);
+            AppendData<float>(v2.x, data);
+            AppendData<float>(v2.y, data);
+            AppendData<float>(v2.z, data);
+            AppendData(uint16_t(0), data);
+        }
+        return WriteFile(fileName, data.data(), data.size());
     }
-    robin_hood::unordered_map<Vec3f, uint32_t, Vec3fHash> pointsMap;
-    auto InsertVertex = [&](const Vec3f& p)
+
+    template <typename Vec>
+    IOStatus ReadStlMesh(const char* fileName, BasicSurfaceMesh<Vec>& result, const ReadMeshOptions& options)
     {
-        const auto itr = pointsMap.find(p);
-        if (itr != pointsMap.end())
+        std::vector<uint8_t> data;
+        if (!ReadFile(fileName, data))
         {
-            return itr->second;
+            return IOStatus::FILE_DOESNT_EXIST;
         }
-        const uint32_t idx = result.vertices.size();
-        result.vertices.push_back(Vec3d{ p.x, p.y, p.z });
-        pointsMap[p] = idx;
-        return idx;
-    };
-    Buffer buffer;
-    buffer.data = data.data();
-    buffer.size = data.size();
-    buffer.cursor = 80; // header size
+        robin_hood::unordered_map<Vec3f, uint32_t, Vec3fHash> pointsMap;
+        auto InsertVertex = [&](const Vec3f& p)
+        {
+            const auto itr = pointsMap.find(p);
+            if (itr != pointsMap.end())
+            {
+                return itr->second;
+            }
+            const uint32_t idx = result.vertices.size();
+            Vec v;
+            v.x = p.x;
+            v.y = p.y;
+            v.z = p.z;
+            result.vertices.push_back(v);
+            pointsMap[p] = idx;
+            return idx;
+        };
+        Buffer buffer;
+        buffer.data = data.data();
+        buffer.size = data.size();
+        buffer.cursor = 80; // header size
 
-    uint32_t facesCount;
-    ReadFromBuffer(buffer, facesCount);
+        uint32_t facesCount;
+        ReadFromBuffer(buffer, facesCount);
 
-    result.faces.reserve(facesCount);
-    FaceInfo info;
-    for (size_t i = 0; i < facesCount; ++i)
-    {
-        ReadFromBuffer(buffer, info);
-        Triangle t;
-        t.idx[0] = InsertVertex(info.points[0]);
-        t.idx[1] = InsertVertex(info.points[1]);
-        t.idx[2] = InsertVertex(info.points[2]);
-        result.faces.push_back(t);
+        result.faces.reserve(facesCount);
+        FaceInfo info;
+        for (size_t i = 0; i < facesCount; ++i)
+        {
+            ReadFromBuffer(buffer, info);
+            Triangle t;
+            t.idx[0] = InsertVertex(info.points[0]);
+            t.idx[1] = InsertVertex(info.points[1]);
+            t.idx[2] = InsertVertex(info.points[2]);
+            result.faces.push_back(t);
+        }
+        if (options.spatialSort)
+        {
+            SortMeshSpatially(result);
+        }
+        result.name = ExtractFileName(fileName);
+        result.color = GenerateColor();
+        result.id = GenerateUUID();
+        return IOStatus::OK;
     }
-    result.name = ExtractFileName(fileName);
-    result.color = GenerateColor();
-    result.id = GenerateUUID();
-    return IOStatus::OK;
+} // namespace
+
+bool WriteStl(const SurfaceMesh& mesh, const char* fileName)
+{
+    return WriteStlMesh(mesh, fileName);
+}
+
+bool WriteStl(const SurfaceMeshF& mesh, const char* fileName)
+{
+    return WriteStlMesh(mesh, fileName);
+}
+
+IOStatus ReadMesh(const char* fileName, SurfaceMesh& result, const ReadMeshOptions& options)
+{
+    return ReadStlMesh(fileName, result, options);
+}
+
+IOStatus ReadMesh(const char* fileName, SurfaceMeshF& result, const ReadMeshOptions& options)
+{
+    return ReadStlMesh(fileName, result, options);
 }
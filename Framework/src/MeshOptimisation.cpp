@@ -0,0 +1,444 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t MESHLETS_GRAIN_SIZE = 256;
+
+    // Vertex -> faces adjacency as offsets + faces.
+    struct VertexTriangles
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> faces;
+    };
+
+    VertexTriangles BuildVertexTriangles(const std::vector<Triangle>& faces, size_t verticesCount)
+    {
+        VertexTriangles result;
+        result.offsets.assign(verticesCount + 1, 0);
+        for (const Triangle& t : faces)
+        {
+            result.offsets[t.idx[0] + 1]++;
+            result.offsets[t.idx[1] + 1]++;
+            result.offsets[t.idx[2] + 1]++;
+        }
+        for (size_t i = 0; i < verticesCount; i++)
+        {
+            result.offsets[i + 1] += result.offsets[i];
+        }
+        result.faces.resize(result.offsets[verticesCount]);
+        std::vector<uint32_t> cursor(result.offsets.begin(), result.offsets.end() - 1);
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            for (uint32_t v : faces[i].idx)
+            {
+                result.faces[cursor[v]++] = uint32_t(i);
+            }
+        }
+        return result;
+    }
+
+    // FIFO cache simulation, a vertex is in the cache while less than cacheSize misses happened since it was loaded.
+    struct VertexCache
+    {
+        std::vector<uint32_t> loadTime;
+        uint32_t time;
+        uint32_t size;
+
+        VertexCache(size_t verticesCount, size_t cacheSize)
+            : loadTime(verticesCount, 0), time(uint32_t(cacheSize) + 1), size(uint32_t(cacheSize))
+        {
+        }
+
+        // returns true on a cache miss.
+        bool Access(uint32_t v)
+        {
+            if (time - loadTime[v] > size)
+            {
+                loadTime[v] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        void Reset()
+        {
+            time += size + 1;
+        }
+    };
+
+    uint32_t SkipDeadEnd(std::vector<uint32_t>& deadEnds, const std::vector<uint32_t>& liveFaces,
+                         uint32_t& cursor)
+    {
+        while (!deadEnds.empty())
+        {
+            const uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveFaces[v] > 0)
+            {
+                return v;
+            }
+        }
+        while (cursor < liveFaces.size())
+        {
+            if (liveFaces[cursor] > 0)
+            {
+                return cursor;
+            }
+            cursor++;
+        }
+        return UINT32_MAX;
+    }
+
+    // Tipsify (Sander et al. 2007). clusters receives the indices of the faces where the ordering
+    // restarts with a cold cache, the first one is always 0.
+    std::vector<Triangle> Tipsify(const std::vector<Triangle>& faces, size_t verticesCount, size_t cacheSize,
+                                  std::vector<uint32_t>& clusters)
+    {
+        const VertexTriangles adjacency = BuildVertexTriangles(faces, verticesCount);
+        std::vector<uint32_t> liveFaces(verticesCount);
+        for (size_t i = 0; i < verticesCount; i++)
+        {
+            liveFaces[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+        }
+        std::vector<uint32_t> cacheTime(verticesCount, 0);
+        std::vector<bool> emitted(faces.size(), false);
+        std::vector<uint32_t> deadEnds;
+        std::vector<uint32_t> candidates;
+        std::vector<Triangle> result;
+        result.reserve(faces.size());
+        clusters.clear();
+
+        const uint32_t k = uint32_t(cacheSize);
+        uint32_t time = k + 1;
+        uint32_t cursor = 0;
+        uint32_t fan = SkipDeadEnd(deadEnds, liveFaces, cursor);
+        while (fan != UINT32_MAX)
+        {
+            candidates.clear();
+            for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++)
+            {
+                const uint32_t f = adjacency.faces[i];
+                if (emitted[f])
+                {
+                    continue;
+                }
+                emitted[f] = true;
+                result.push_back(faces[f]);
+                for (uint32_t v : faces[f].idx)
+                {
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    liveFaces[v]--;
+                    if (time - cacheTime[v] > k)
+                    {
+                        cacheTime[v] = time++;
+                    }
+                }
+            }
+
+            // pick the candidate that will still be in the cache after its remaining faces are emitted
+            // and has been there for the longest time.
+            uint32_t next = UINT32_MAX;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates)
+            {
+                if (liveFaces[v] == 0)
+                {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveFaces[v] <= k)
+                {
+                    priority = time - cacheTime[v];
+                }
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+            if (next == UINT32_MAX)
+            {
+                next = SkipDeadEnd(deadEnds, liveFaces, cursor);
+                if (next != UINT32_MAX && time - cacheTime[next] > k)
+                {
+                    // the new fan starts with a cold cache.
+                    clusters.push_back(uint32_t(result.size()));
+                }
+            }
+            fan = next;
+        }
+        if (clusters.empty() || clusters.front() != 0)
+        {
+            clusters.insert(clusters.begin(), 0);
+        }
+        return result;
+    }
+
+    // splits the clusters found by Tipsify in smaller ones while their own ACMR stays close to the
+    // one of the cluster they come from, smaller clusters give more freedom to the overdraw sort.
+    std::vector<uint32_t> SplitClusters(const std::vector<Triangle>& faces, size_t verticesCount, size_t cacheSize,
+                                        const std::vector<uint32_t>& hardClusters, double threshold)
+    {
+        std::vector<uint32_t> result;
+        VertexCache cache(verticesCount, cacheSize);
+        for (size_t c = 0; c < hardClusters.size(); c++)
+        {
+            const uint32_t start = hardClusters[c];
+            const uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : uint32_t(faces.size());
+
+            cache.Reset();
+            size_t clusterMisses = 0;
+            for (uint32_t i = start; i < end; i++)
+            {
+                clusterMisses += cache.Access(faces[i].idx[0]) + cache.Access(faces[i].idx[1]) + cache.Access(faces[i].idx[2]);
+            }
+            const double maxAcmr = threshold * clusterMisses / double(end - start);
+
+            // every run starts with a cold cache as the sort can move it anywhere.
+            result.push_back(start);
+            cache.Reset();
+            size_t runMisses = 0;
+            for (uint32_t i = start; i < end; i++)
+            {
+                runMisses += cache.Access(faces[i].idx[0]) + cache.Access(faces[i].idx[1]) + cache.Access(faces[i].idx[2]);
+                const uint32_t runFaces = i - result.back() + 1;
+                if (i + 1 < end && runMisses <= maxAcmr * runFaces)
+                {
+                    result.push_back(i + 1);
+                    cache.Reset();
+                    runMisses = 0;
+                }
+            }
+        }
+        return result;
+    }
+
+    template <typename Vec>
+    Vec3d ToVec3d(const Vec& v)
+    {
+        return Vec3d{ v.x, v.y, v.z };
+    }
+
+    // the order the clusters of faces starting at clusters[c] are drawn in, those facing away from the
+    // centre of the mesh are likely occluders and go first.
+    template <typename Vec>
+    std::vector<uint32_t> SortClustersForOverdraw(const std::vector<Vec>& vertices, const std::vector<Triangle>& faces,
+                                                  const std::vector<uint32_t>& clusters)
+    {
+        std::vector<Vec3d> centroids(clusters.size());
+        std::vector<Vec3d> normals(clusters.size());
+        Vec3d meshCentroid{ 0.0, 0.0, 0.0 };
+        double meshArea = 0.0;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            const uint32_t start = clusters[c];
+            const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(faces.size());
+            Vec3d centroid{ 0.0, 0.0, 0.0 };
+            Vec3d normal{ 0.0, 0.0, 0.0 };
+            double area = 0.0;
+            for (uint32_t i = start; i < end; i++)
+            {
+                const Vec3d a = ToVec3d(vertices[faces[i].idx[0]]);
+                const Vec3d b = ToVec3d(vertices[faces[i].idx[1]]);
+                const Vec3d p = ToVec3d(vertices[faces[i].idx[2]]);
+                const Vec3d n = CrossProduct(b - a, p - a);
+                const double faceArea = Length(n);
+                centroid = centroid + (a + b + p) * (faceArea / 3.0);
+                normal = normal + n;
+                area += faceArea;
+            }
+            meshCentroid = meshCentroid + centroid;
+            meshArea += area;
+            centroids[c] = area > 0.0 ? centroid * (1.0 / area) : ToVec3d(vertices[faces[start].idx[0]]);
+            const double normalLength = Length(normal);
+            normals[c] = normalLength > 0.0 ? normal * (1.0 / normalLength) : normal;
+        }
+        if (meshArea > 0.0)
+        {
+            meshCentroid = meshCentroid * (1.0 / meshArea);
+        }
+
+        std::vector<double> sortKeys(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            sortKeys[c] = DotProduct(centroids[c] - meshCentroid, normals[c]);
+        }
+        std::vector<uint32_t> order(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            order[c] = uint32_t(c);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return sortKeys[a] > sortKeys[b];
+        });
+        return order;
+    }
+
+    template <typename Vec>
+    void RenumberVerticesForFetch(BasicSurfaceMesh<Vec>& mesh)
+    {
+        const size_t verticesCount = mesh.vertices.size();
+        std::vector<uint32_t> remap(verticesCount, UINT32_MAX);
+        std::vector<Vec> vertices(verticesCount);
+        uint32_t next = 0;
+        for (Triangle& t : mesh.faces)
+        {
+            for (uint32_t& v : t.idx)
+            {
+                if (remap[v] == UINT32_MAX)
+                {
+                    remap[v] = next;
+                    vertices[next++] = mesh.vertices[v];
+                }
+                v = remap[v];
+            }
+        }
+        // unreferenced vertices are kept at the end.
+        for (size_t i = 0; i < verticesCount; i++)
+        {
+            if (remap[i] == UINT32_MAX)
+            {
+                vertices[next++] = mesh.vertices[i];
+            }
+        }
+        mesh.vertices = std::move(vertices);
+    }
+}
+
+template <typename Vec>
+VertexCacheStatistics CalculateVertexCacheStatistics(const BasicSurfaceMesh<Vec>& mesh, size_t cacheSize)
+{
+    VertexCacheStatistics result;
+    if (mesh.faces.empty())
+    {
+        return result;
+    }
+    VertexCache cache(mesh.vertices.size(), cacheSize);
+    std::vector<bool> referenced(mesh.vertices.size(), false);
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for (const Triangle& t : mesh.faces)
+    {
+        for (uint32_t v : t.idx)
+        {
+            misses += cache.Access(v);
+            if (!referenced[v])
+            {
+                referenced[v] = true;
+                referencedCount++;
+            }
+        }
+    }
+    result.acmr = misses / double(mesh.faces.size());
+    result.atvr = misses / double(referencedCount);
+    return result;
+}
+
+template VertexCacheStatistics CalculateVertexCacheStatistics(const SurfaceMesh& mesh, size_t cacheSize);
+template VertexCacheStatistics CalculateVertexCacheStatistics(const SurfaceMeshF& mesh, size_t cacheSize);
+
+void OptimiseVertexCache(SurfaceMesh& mesh, size_t cacheSize)
+{
+    std::vector<uint32_t> clusters;
+    mesh.faces = Tipsify(mesh.faces, mesh.vertices.size(), cacheSize, clusters);
+}
+
+void OptimiseOverdraw(SurfaceMesh& mesh, size_t cacheSize, double threshold)
+{
+    if (mesh.faces.empty())
+    {
+        return;
+    }
+    std::vector<uint32_t> hardClusters;
+    const std::vector<Triangle> faces = Tipsify(mesh.faces, mesh.vertices.size(), cacheSize, hardClusters);
+    const std::vector<uint32_t> clusters = SplitClusters(faces, mesh.vertices.size(), cacheSize, hardClusters, threshold);
+
+    size_t position = 0;
+    for (uint32_t c : SortClustersForOverdraw(mesh.vertices, faces, clusters))
+    {
+        const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(faces.size());
+        std::copy(faces.begin() + clusters[c], faces.begin() + end, mesh.faces.begin() + position);
+        position += end - clusters[c];
+    }
+}
+
+void OptimiseVertexFetch(SurfaceMesh& mesh)
+{
+    RenumberVerticesForFetch(mesh);
+}
+
+void OptimiseMeshForRendering(SurfaceMesh& mesh, size_t cacheSize)
+{
+    OptimiseOverdraw(mesh, cacheSize);
+    OptimiseVertexFetch(mesh);
+}
+
+template <typename Vec>
+void OptimiseMeshletsForRendering(BasicSurfaceMesh<Vec>& mesh, std::vector<Meshlet>& meshlets, size_t cacheSize)
+{
+    // each meshlet is ordered on its own vertices numbered from 0, so the adjacency Tipsify builds
+    // stays the size of the meshlet.
+    ParallelFor(meshlets.size(), MESHLETS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t> vertices;
+        std::vector<Triangle> faces;
+        std::vector<uint32_t> clusters;
+        for (size_t m = begin; m < end; ++m)
+        {
+            Triangle* meshletFaces = mesh.faces.data() + meshlets[m].faceOffset;
+            const uint32_t facesCount = meshlets[m].facesCount;
+            vertices.clear();
+            for (uint32_t f = 0; f < facesCount; ++f)
+            {
+                vertices.insert(vertices.end(), meshletFaces[f].idx, meshletFaces[f].idx + 3);
+            }
+            std::sort(vertices.begin(), vertices.end());
+            vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+            faces.assign(meshletFaces, meshletFaces + facesCount);
+            for (Triangle& t : faces)
+            {
+                for (uint32_t& v : t.idx)
+                {
+                    v = uint32_t(std::lower_bound(vertices.begin(), vertices.end(), v) - vertices.begin());
+                }
+            }
+            faces = Tipsify(faces, vertices.size(), cacheSize, clusters);
+            for (uint32_t f = 0; f < facesCount; ++f)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    meshletFaces[f].idx[i] = vertices[faces[f].idx[i]];
+                }
+            }
+        }
+    });
+
+    std::vector<uint32_t> starts(meshlets.size());
+    for (size_t m = 0; m < meshlets.size(); ++m)
+    {
+        starts[m] = meshlets[m].faceOffset;
+    }
+    const std::vector<Triangle> faces = mesh.faces;
+    const std::vector<Meshlet> unsorted = meshlets;
+    uint32_t position = 0;
+    size_t next = 0;
+    for (uint32_t m : SortClustersForOverdraw(mesh.vertices, faces, starts))
+    {
+        const Meshlet& meshlet = unsorted[m];
+        std::copy(faces.begin() + meshlet.faceOffset, faces.begin() + meshlet.faceOffset + meshlet.facesCount,
+                  mesh.faces.begin() + position);
+        meshlets[next] = meshlet;
+        meshlets[next++].faceOffset = position;
+        position += meshlet.facesCount;
+    }
+    RenumberVerticesForFetch(mesh);
+}
+
+template void OptimiseMeshletsForRendering(SurfaceMesh& mesh, std::vector<Meshlet>& meshlets, size_t cacheSize);
+template void OptimiseMeshletsForRendering(SurfaceMeshF& mesh, std::vector<Meshlet>& meshlets, size_t cacheSize);
@@ -0,0 +1,391 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    // the faces are split in chunks of this many faces along the Morton curve of their centroids,
+    // the meshlets are grown in each chunk independently.
+    constexpr size_t CHUNK_SIZE = 64 * 1024;
+    constexpr size_t BOUNDS_GRAIN_SIZE = 1024;
+
+    template <typename Vec>
+    Vec3d FaceCentroid(const BasicSurfaceMesh<Vec>& mesh, const Triangle& t)
+    {
+        const Vec& a = mesh.vertices[t.idx[0]];
+        const Vec& b = mesh.vertices[t.idx[1]];
+        const Vec& c = mesh.vertices[t.idx[2]];
+        return Vec3d{ (double(a.x) + b.x + c.x) / 3.0, (double(a.y) + b.y + c.y) / 3.0, (double(a.z) + b.z + c.z) / 3.0 };
+    }
+
+    double SquaredDistance(const Vec3d& a, const Vec3d& b)
+    {
+        const double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // the state of the chunks handled by a thread. stamps[v] is the meshlet vertex v was last added
+    // to and live[v] the count of the unassigned faces of the chunk around it.
+    struct GrowthScratch
+    {
+        std::vector<uint32_t> stamps;
+        uint32_t stamp = 0;
+        std::vector<uint32_t> live;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> border;
+    };
+
+    // grows the meshlets of the faces order[begin, end), the faces of a meshlet are appended to
+    // faces and their counts to sizes. a meshlet takes the unassigned face of the chunk sharing the
+    // most vertices with it, among those the one with the fewest unassigned faces around so no small
+    // pieces are left behind, then the closest to its centroid. it is closed when full or when no
+    // face of the chunk touches it.
+    template <typename Vec>
+    void GrowMeshlets(const BasicSurfaceMesh<Vec>& mesh, const VertexRings& rings, const std::vector<Vec3d>& centroids,
+                      const std::vector<uint32_t>& order, const std::vector<uint32_t>& chunks, size_t begin, size_t end,
+                      size_t maxFacesCount, std::vector<uint8_t>& assigned, std::vector<uint8_t>& shared,
+                      GrowthScratch& scratch, std::vector<uint32_t>& faces, std::vector<uint32_t>& sizes)
+    {
+        if (scratch.stamps.empty())
+        {
+            scratch.stamps.assign(mesh.vertices.size(), 0);
+            scratch.live.assign(mesh.vertices.size(), 0);
+        }
+        // all the faces of the chunk get assigned, which brings live back to zero for the next one.
+        std::vector<uint32_t>& live = scratch.live;
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (uint32_t v : mesh.faces[order[i]].idx)
+            {
+                live[v]++;
+            }
+        }
+        auto liveFaces = [&](uint32_t face)
+        {
+            const Triangle& t = mesh.faces[face];
+            return live[t.idx[0]] + live[t.idx[1]] + live[t.idx[2]];
+        };
+
+        const uint32_t chunk = chunks[order[begin]];
+        std::vector<uint32_t>& candidates = scratch.candidates;
+        // the faces around the last meshlet left unassigned, the next one starts from them.
+        std::vector<uint32_t>& border = scratch.border;
+        border.clear();
+        size_t seed = begin;
+        while (true)
+        {
+            // the border face with the fewest unassigned faces around, or else the next one along
+            // the Morton curve.
+            uint32_t face = UINT32_MAX;
+            uint32_t fewestLiveFaces = UINT32_MAX;
+            for (uint32_t candidate : border)
+            {
+                if (liveFaces(candidate) < fewestLiveFaces)
+                {
+                    face = candidate;
+                    fewestLiveFaces = liveFaces(candidate);
+                }
+            }
+            if (face == UINT32_MAX)
+            {
+                while (seed < end && assigned[order[seed]])
+                {
+                    ++seed;
+                }
+                if (seed == end)
+                {
+                    break;
+                }
+                face = order[seed];
+            }
+            const uint32_t stamp = ++scratch.stamp;
+            const size_t first = faces.size();
+            Vec3d centroidsSum{ 0.0, 0.0, 0.0 };
+            while (true)
+            {
+                assigned[face] = 1;
+                faces.push_back(face);
+                centroidsSum = centroidsSum + centroids[face];
+                for (uint32_t v : mesh.faces[face].idx)
+                {
+                    live[v]--;
+                }
+                if (faces.size() - first == maxFacesCount)
+                {
+                    break;
+                }
+                for (uint32_t v : mesh.faces[face].idx)
+                {
+                    if (scratch.stamps[v] == stamp)
+                    {
+                        continue;
+                    }
+                    scratch.stamps[v] = stamp;
+                    for (uint32_t i = rings.faceOffsets[v]; i < rings.faceOffsets[v + 1]; ++i)
+                    {
+                        const uint32_t neighbour = rings.faces[i];
+                        if (chunks[neighbour] != chunk || assigned[neighbour])
+                        {
+                            continue;
+                        }
+                        if (shared[neighbour]++ == 0)
+                        {
+                            candidates.push_back(neighbour);
+                        }
+                    }
+                }
+
+                // the assigned candidates are dropped on the way, the score of the others is only
+                // evaluated as far as needed to rule them out.
+                const Vec3d centroid = centroidsSum * (1.0 / double(faces.size() - first));
+                size_t best = SIZE_MAX;
+                uint8_t bestShared = 0;
+                uint32_t bestLiveFaces = 0;
+                double bestDistance = 0.0;
+                for (size_t i = 0; i < candidates.size();)
+                {
+                    const uint32_t candidate = candidates[i];
+                    if (assigned[candidate])
+                    {
+                        shared[candidate] = 0;
+                        candidates[i] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    ++i;
+                    if (shared[candidate] < bestShared)
+                    {
+                        continue;
+                    }
+                    const uint32_t liveFacesCount = liveFaces(candidate);
+                    if (best != SIZE_MAX && shared[candidate] == bestShared && liveFacesCount > bestLiveFaces)
+                    {
+                        continue;
+                    }
+                    const double distance = SquaredDistance(centroids[candidate], centroid);
+                    if (best == SIZE_MAX || shared[candidate] > bestShared || liveFacesCount < bestLiveFaces ||
+                        distance < bestDistance)
+                    {
+                        best = i - 1;
+                        bestShared = shared[candidate];
+                        bestLiveFaces = liveFacesCount;
+                        bestDistance = distance;
+                    }
+                }
+                if (best == SIZE_MAX)
+                {
+                    break;
+                }
+                face = candidates[best];
+            }
+            border.clear();
+            for (uint32_t candidate : candidates)
+            {
+                shared[candidate] = 0;
+                if (!assigned[candidate])
+                {
+                    border.push_back(candidate);
+                }
+            }
+            candidates.clear();
+            // the faces keep their relative order until OptimiseMeshletsForRendering.
+            std::sort(faces.begin() + first, faces.end());
+            sizes.push_back(uint32_t(faces.size() - first));
+        }
+    }
+
+    template <typename Vec>
+    void CalculateMeshletBounds(const BasicSurfaceMesh<Vec>& mesh, Meshlet& meshlet)
+    {
+        const Triangle* faces = mesh.faces.data() + meshlet.faceOffset;
+        // the sphere is centred on the box of the vertices.
+        BBox box;
+        for (uint32_t f = 0; f < meshlet.facesCount; ++f)
+        {
+            for (uint32_t v : faces[f].idx)
+            {
+                const Vec& p = mesh.vertices[v];
+                for (int i = 0; i < 3; ++i)
+                {
+                    box.min.data[i] = std::min<double>(box.min.data[i], p.data[i]);
+                    box.max.data[i] = std::max<double>(box.max.data[i], p.data[i]);
+                }
+            }
+        }
+        meshlet.center = CalculateBBoxCenter(box);
+        double squaredRadius = 0.0;
+        // the normals of the faces with an area, their normalised sum is the axis of the cone.
+        std::vector<Vec3d> normals;
+        normals.reserve(meshlet.facesCount);
+        Vec3d axis{ 0.0, 0.0, 0.0 };
+        for (uint32_t f = 0; f < meshlet.facesCount; ++f)
+        {
+            Vec3d corners[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const Vec& p = mesh.vertices[faces[f].idx[k]];
+                corners[k] = Vec3d{ p.x, p.y, p.z };
+                squaredRadius = std::max(squaredRadius, SquaredDistance(corners[k], meshlet.center));
+            }
+            const Vec3d normal = CrossProduct(corners[1] - corners[0], corners[2] - corners[0]);
+            const double length = Length(normal);
+            if (length > 0.0)
+            {
+                normals.push_back(normal * (1.0 / length));
+                axis = axis + normals.back();
+            }
+        }
+        meshlet.radius = sqrt(squaredRadius);
+
+        meshlet.coneAxis = Vec3d{ 0.0, 0.0, 1.0 };
+        meshlet.coneCutoff = 1.0;
+        const double axisLength = Length(axis);
+        if (normals.empty() || !(axisLength > 0.0))
+        {
+            return;
+        }
+        axis = axis * (1.0 / axisLength);
+        double minDot = 1.0;
+        for (const Vec3d& normal : normals)
+        {
+            minDot = std::min(minDot, DotProduct(normal, axis));
+        }
+        meshlet.coneAxis = axis;
+        // a cone of 90 degrees or more has a face towards every direction.
+        if (minDot > 0.0)
+        {
+            meshlet.coneCutoff = sqrt(std::max(1.0 - minDot * minDot, 0.0));
+        }
+    }
+}
+
+template <typename Vec>
+std::vector<Meshlet> BuildMeshlets(BasicSurfaceMesh<Vec>& mesh, size_t maxFacesCount)
+{
+    std::vector<Meshlet> result;
+    const size_t facesCount = mesh.faces.size();
+    if (facesCount == 0 || maxFacesCount == 0)
+    {
+        return result;
+    }
+
+    std::vector<Vec3d> centroids(facesCount);
+    ParallelFor(facesCount, CHUNK_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t f = begin; f < end; ++f)
+        {
+            centroids[f] = FaceCentroid(mesh, mesh.faces[f]);
+        }
+    });
+    BBox box;
+    for (const Vec3d& centroid : centroids)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            box.min.data[i] = std::min(box.min.data[i], centroid.data[i]);
+            box.max.data[i] = std::max(box.max.data[i], centroid.data[i]);
+        }
+    }
+    // the top 10 bits per axis are enough to place the chunks and the seeds, and sort in half the
+    // passes.
+    const std::vector<uint64_t> codes = CalculateMortonCodes(centroids, box);
+    std::vector<uint32_t> keys(facesCount);
+    ParallelFor(facesCount, CHUNK_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t f = begin; f < end; ++f)
+        {
+            keys[f] = uint32_t(codes[f] >> 33);
+        }
+    });
+    std::vector<uint32_t> order;
+    RadixSortIndices(keys, order);
+    std::vector<uint32_t> chunks(facesCount);
+    for (size_t i = 0; i < facesCount; ++i)
+    {
+        chunks[order[i]] = uint32_t(i / CHUNK_SIZE);
+    }
+
+    // a chunk only touches the flags of its own faces, and writes its faces at its place in order.
+    const VertexRings rings = BuildVertexRings(mesh);
+    std::vector<uint8_t> assigned(facesCount, 0);
+    std::vector<uint8_t> shared(facesCount, 0);
+    std::vector<GrowthScratch> scratches(GetThreadsCount());
+    std::vector<uint32_t> faces(facesCount);
+    std::vector<std::vector<uint32_t>> chunksSizes((facesCount + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    ParallelFor(facesCount, CHUNK_SIZE, [&](size_t begin, size_t end, size_t thread)
+    {
+        std::vector<uint32_t> chunkFaces;
+        chunkFaces.reserve(end - begin);
+        GrowMeshlets(mesh, rings, centroids, order, chunks, begin, end, maxFacesCount, assigned, shared,
+                     scratches[thread], chunkFaces, chunksSizes[begin / CHUNK_SIZE]);
+        std::copy(chunkFaces.begin(), chunkFaces.end(), faces.begin() + begin);
+    });
+
+    uint32_t offset = 0;
+    for (const std::vector<uint32_t>& sizes : chunksSizes)
+    {
+        for (uint32_t size : sizes)
+        {
+            Meshlet meshlet;
+            meshlet.faceOffset = offset;
+            meshlet.facesCount = size;
+            result.push_back(meshlet);
+            offset += size;
+        }
+    }
+    std::vector<Triangle> reordered(facesCount);
+    ParallelFor(facesCount, CHUNK_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            reordered[i] = mesh.faces[faces[i]];
+        }
+    });
+    mesh.faces = std::move(reordered);
+    CalculateMeshletsBounds(mesh, result);
+    return result;
+}
+
+template <typename Vec>
+void CalculateMeshletsBounds(const BasicSurfaceMesh<Vec>& mesh, std::vector<Meshlet>& meshlets)
+{
+    ParallelFor(meshlets.size(), BOUNDS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            CalculateMeshletBounds(mesh, meshlets[i]);
+        }
+    });
+}
+
+template std::vector<Meshlet> BuildMeshlets(SurfaceMesh& mesh, size_t maxFacesCount);
+template std::vector<Meshlet> BuildMeshlets(SurfaceMeshF& mesh, size_t maxFacesCount);
+template void CalculateMeshletsBounds(const SurfaceMesh& mesh, std::vector<Meshlet>& meshlets);
+template void CalculateMeshletsBounds(const SurfaceMeshF& mesh, std::vector<Meshlet>& meshlets);
+
+bool IsMeshletInFrustum(const Frustum& frustum, const Meshlet& meshlet)
+{
+    for (int p = 0; p < 6; ++p)
+    {
+        if (DotProduct(frustum.normals[p], meshlet.center) + frustum.offsets[p] < -meshlet.radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsMeshletBackFacing(const Meshlet& meshlet, const Vec3d& eye)
+{
+    if (meshlet.coneCutoff >= 1.0)
+    {
+        return false;
+    }
+    // every direction from eye to the sphere is within 90 degrees minus the cone angle of the axis,
+    // so the normals point away from eye. the sine of that margin is the cutoff.
+    const Vec3d direction = meshlet.center - eye;
+    return DotProduct(direction, meshlet.coneAxis) >=
+           meshlet.coneCutoff * Length(direction) + meshlet.radius * (1.0 + meshlet.coneCutoff);
+}
@@ -0,0 +1,503 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <type_traits>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    constexpr int JACOBI_SWEEPS = 16;
+    // passes of the 2D refinement around the three axes, stopped earlier once the volume stalls.
+    constexpr int REFINEMENT_PASSES = 4;
+
+    // sums of the coordinates and of their products, relative to a reference point so the
+    // covariance doesn't lose the digits of far away parts.
+    struct Moments
+    {
+        double count = 0.0;
+        double s[3] = {};
+        double ss[6] = {}; // xx, xy, xz, yy, yz, zz.
+    };
+
+    void AddMoments(Moments& a, const Moments& b)
+    {
+        a.count += b.count;
+        for (int i = 0; i < 3; ++i)
+        {
+            a.s[i] += b.s[i];
+        }
+        for (int i = 0; i < 6; ++i)
+        {
+            a.ss[i] += b.ss[i];
+        }
+    }
+
+    // covariance[i][j] from the moments.
+    void MomentsCovariance(const Moments& m, double covariance[3][3])
+    {
+        const double mean[3] = { m.s[0] / m.count, m.s[1] / m.count, m.s[2] / m.count };
+        static const int PAIRS[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+        for (int k = 0; k < 6; ++k)
+        {
+            const int i = PAIRS[k][0];
+            const int j = PAIRS[k][1];
+            covariance[i][j] = covariance[j][i] = m.ss[k] / m.count - mean[i] * mean[j];
+        }
+    }
+
+    // the chunks accumulate in plain loops over the coordinates and are added in a fixed order,
+    // the result doesn't depend on the threads. float points are summed in double.
+    template <typename Vec>
+    Moments CalculateMoments(const std::vector<Vec>& points, const Vec3d& reference)
+    {
+        std::vector<Moments> chunks((points.size() + GRAIN_SIZE - 1) / GRAIN_SIZE);
+        ParallelFor(points.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            double sx = 0.0, sy = 0.0, sz = 0.0;
+            double sxx = 0.0, sxy = 0.0, sxz = 0.0, syy = 0.0, syz = 0.0, szz = 0.0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const double x = points[i].x - reference.x;
+                const double y = points[i].y - reference.y;
+                const double z = points[i].z - reference.z;
+                sx += x;
+                sy += y;
+                sz += z;
+                sxx += x * x;
+                sxy += x * y;
+                sxz += x * z;
+                syy += y * y;
+                syz += y * z;
+                szz += z * z;
+            }
+            Moments& chunk = chunks[begin / GRAIN_SIZE];
+            chunk.count = double(end - begin);
+            chunk.s[0] = sx;
+            chunk.s[1] = sy;
+            chunk.s[2] = sz;
+            chunk.ss[0] = sxx;
+            chunk.ss[1] = sxy;
+            chunk.ss[2] = sxz;
+            chunk.ss[3] = syy;
+            chunk.ss[4] = syz;
+            chunk.ss[5] = szz;
+        });
+        Moments result;
+        for (const Moments& chunk : chunks)
+        {
+            AddMoments(result, chunk);
+        }
+        return result;
+    }
+
+    // eigenvectors of a symmetric matrix by cyclic Jacobi rotations, as orthonormal axes.
+    void SymmetricEigenvectors(double a[3][3], Vec3d axes[3])
+    {
+        double v[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+        for (int sweep = 0; sweep < JACOBI_SWEEPS; ++sweep)
+        {
+            const double offDiagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+            const double diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+            if (offDiagonal <= 1e-30 * diagonal || offDiagonal == 0.0)
+            {
+                break;
+            }
+            for (int p = 0; p < 2; ++p)
+            {
+                for (int q = p + 1; q < 3; ++q)
+                {
+                    if (a[p][q] == 0.0)
+                    {
+                        continue;
+                    }
+                    const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                    const double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                    const double c = 1.0 / sqrt(t * t + 1.0);
+                    const double s = t * c;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const double akp = a[k][p];
+                        const double akq = a[k][q];
+                        a[k][p] = c * akp - s * akq;
+                        a[k][q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const double apk = a[p][k];
+                        const double aqk = a[q][k];
+                        a[p][k] = c * apk - s * aqk;
+                        a[q][k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const double vkp = v[k][p];
+                        const double vkq = v[k][q];
+                        v[k][p] = c * vkp - s * vkq;
+                        v[k][q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            axes[i] = Vec3d{ v[0][i], v[1][i], v[2][i] };
+        }
+    }
+
+    // right handed and orthonormal, the third axis is rebuilt from the first two.
+    void OrthonormaliseAxes(Vec3d axes[3])
+    {
+        Normalise(axes[0]);
+        const double d = axes[1].x * axes[0].x + axes[1].y * axes[0].y + axes[1].z * axes[0].z;
+        axes[1] = Vec3d{ axes[1].x - d * axes[0].x, axes[1].y - d * axes[0].y, axes[1].z - d * axes[0].z };
+        Normalise(axes[1]);
+        axes[2] = CrossProduct(axes[0], axes[1]);
+    }
+
+    // the box with the given axes around the points, the projections are bounded in parallel.
+    template <typename Vec>
+    OBB FitAxes(const std::vector<Vec>& points, const Vec3d axes[3])
+    {
+        struct Range
+        {
+            double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+            double max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+        };
+        std::vector<Range> chunks((points.size() + GRAIN_SIZE - 1) / GRAIN_SIZE);
+        ParallelFor(points.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            Range& range = chunks[begin / GRAIN_SIZE];
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Vec3d p = privWiden(points[i]);
+                for (int a = 0; a < 3; ++a)
+                {
+                    const double d = p.x * axes[a].x + p.y * axes[a].y + p.z * axes[a].z;
+                    range.min[a] = std::min(range.min[a], d);
+                    range.max[a] = std::max(range.max[a], d);
+                }
+            }
+        });
+        Range range;
+        for (const Range& chunk : chunks)
+        {
+            for (int a = 0; a < 3; ++a)
+            {
+                range.min[a] = std::min(range.min[a], chunk.min[a]);
+                range.max[a] = std::max(range.max[a], chunk.max[a]);
+            }
+        }
+        OBB result;
+        Vec3d center{ 0.0, 0.0, 0.0 };
+        for (int a = 0; a < 3; ++a)
+        {
+            result.axes[a] = axes[a];
+            result.halfExtents.data[a] = 0.5 * (range.max[a] - range.min[a]);
+            const double middle = 0.5 * (range.max[a] + range.min[a]);
+            center = Vec3d{ center.x + middle * axes[a].x, center.y + middle * axes[a].y, center.z + middle * axes[a].z };
+        }
+        result.center = center;
+        return result;
+    }
+
+    double Volume(const OBB& box)
+    {
+        return box.halfExtents.x * box.halfExtents.y * box.halfExtents.z;
+    }
+
+    // covariance of the surface of the hull, every face weighted by its area, so clusters of
+    // points inside or on the hull don't tilt the axes.
+    bool HullAxes(const SurfaceMesh& hull, Vec3d axes[3])
+    {
+        const Vec3d& reference = hull.vertices[0];
+        double area = 0.0;
+        double s[3] = {};
+        double ss[3][3] = {};
+        for (const Triangle& face : hull.faces)
+        {
+            Vec3d p[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                const Vec3d& v = hull.vertices[face.idx[i]];
+                p[i] = Vec3d{ v.x - reference.x, v.y - reference.y, v.z - reference.z };
+            }
+            const double faceArea = 0.5 * Length(CrossProduct(p[1] - p[0], p[2] - p[0]));
+            const Vec3d c{ (p[0].x + p[1].x + p[2].x) / 3.0, (p[0].y + p[1].y + p[2].y) / 3.0,
+                           (p[0].z + p[1].z + p[2].z) / 3.0 };
+            area += faceArea;
+            for (int i = 0; i < 3; ++i)
+            {
+                s[i] += faceArea * c.data[i];
+                for (int j = 0; j < 3; ++j)
+                {
+                    // the second moment of a triangle about the origin.
+                    ss[i][j] += faceArea / 12.0 * (9.0 * c.data[i] * c.data[j] + p[0].data[i] * p[0].data[j] +
+                                                   p[1].data[i] * p[1].data[j] + p[2].data[i] * p[2].data[j]);
+                }
+            }
+        }
+        if (!(area > 0.0))
+        {
+            return false;
+        }
+        double covariance[3][3];
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                covariance[i][j] = ss[i][j] / area - (s[i] / area) * (s[j] / area);
+            }
+        }
+        SymmetricEigenvectors(covariance, axes);
+        return true;
+    }
+
+    double Cross2(const Vec2d& o, const Vec2d& a, const Vec2d& b)
+    {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    // turns axes[1] and axes[2] around axes[0] to the smallest rectangle around the points projected
+    // on their plane: one of its sides is along an edge of their 2D hull.
+    void RefineAroundAxis(const std::vector<Vec3d>& points, Vec3d axes[3])
+    {
+        std::vector<Vec2d> projected(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            projected[i] = Vec2d{ DotProduct(points[i], axes[1]), DotProduct(points[i], axes[2]) };
+        }
+        // monotone chain.
+        std::sort(projected.begin(), projected.end(), [](const Vec2d& a, const Vec2d& b)
+        {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        std::vector<Vec2d> hull(2 * projected.size());
+        size_t count = 0;
+        for (size_t i = 0; i < projected.size(); ++i)
+        {
+            while (count >= 2 && Cross2(hull[count - 2], hull[count - 1], projected[i]) <= 0.0)
+            {
+                --count;
+            }
+            hull[count++] = projected[i];
+        }
+        for (size_t i = projected.size() - 1, lower = count + 1; i-- > 0;)
+        {
+            while (count >= lower && Cross2(hull[count - 2], hull[count - 1], projected[i]) <= 0.0)
+            {
+                --count;
+            }
+            hull[count++] = projected[i];
+        }
+        count = count > 1 ? count - 1 : count;
+        if (count < 3)
+        {
+            return;
+        }
+
+        double bestArea = DBL_MAX;
+        Vec2d bestDirection{ 1.0, 0.0 };
+        for (size_t e = 0; e < count; ++e)
+        {
+            Vec2d u = hull[(e + 1) % count] - hull[e];
+            const double length = Length(u);
+            if (length == 0.0)
+            {
+                continue;
+            }
+            u = u * (1.0 / length);
+            double minU = DBL_MAX, maxU = -DBL_MAX, minV = DBL_MAX, maxV = -DBL_MAX;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const double pu = hull[i].x * u.x + hull[i].y * u.y;
+                const double pv = hull[i].y * u.x - hull[i].x * u.y;
+                minU = std::min(minU, pu);
+                maxU = std::max(maxU, pu);
+                minV = std::min(minV, pv);
+                maxV = std::max(maxV, pv);
+            }
+            const double area = (maxU - minU) * (maxV - minV);
+            if (area < bestArea)
+            {
+                bestArea = area;
+                bestDirection = u;
+            }
+        }
+        const Vec3d a1 = axes[1] * bestDirection.x + axes[2] * bestDirection.y;
+        const Vec3d a2 = axes[2] * bestDirection.x - axes[1] * bestDirection.y;
+        axes[1] = a1;
+        axes[2] = a2;
+    }
+
+    // alternates the 2D refinement around each axis while it shrinks the box.
+    OBB RefineOnHull(const std::vector<Vec3d>& hullPoints, const Vec3d startAxes[3])
+    {
+        Vec3d axes[3] = { startAxes[0], startAxes[1], startAxes[2] };
+        OrthonormaliseAxes(axes);
+        OBB best = FitAxes(hullPoints, axes);
+        for (int pass = 0; pass < REFINEMENT_PASSES; ++pass)
+        {
+            const double volume = Volume(best);
+            for (int a = 0; a < 3; ++a)
+            {
+                Vec3d turned[3] = { axes[a], axes[(a + 1) % 3], axes[(a + 2) % 3] };
+                RefineAroundAxis(hullPoints, turned);
+                Vec3d candidate[3];
+                candidate[a] = turned[0];
+                candidate[(a + 1) % 3] = turned[1];
+                candidate[(a + 2) % 3] = turned[2];
+                OrthonormaliseAxes(candidate);
+                const OBB box = FitAxes(hullPoints, candidate);
+                if (Volume(box) < Volume(best))
+                {
+                    best = box;
+                    std::copy(candidate, candidate + 3, axes);
+                }
+            }
+            if (!(Volume(best) < volume * (1.0 - 1e-9)))
+            {
+                break;
+            }
+        }
+        return best;
+    }
+}
+
+template <typename Vec>
+OBB CalculateOrientedBoundingBox(const std::vector<Vec>& points, bool refineOnHull)
+{
+    if (points.empty())
+    {
+        return OBB();
+    }
+    double covariance[3][3];
+    MomentsCovariance(CalculateMoments(points, privWiden(points[0])), covariance);
+    Vec3d axes[3];
+    SymmetricEigenvectors(covariance, axes);
+    OrthonormaliseAxes(axes);
+    OBB result = FitAxes(points, axes);
+    if (!refineOnHull)
+    {
+        return result;
+    }
+
+    // the hull holds the extremes of every direction, the candidates only need its vertices. it is
+    // built in double, float points are widened for it.
+    SurfaceMesh hull;
+    if constexpr (std::is_same_v<Vec, Vec3d>)
+    {
+        hull = CalculateConvexHull(points);
+    }
+    else
+    {
+        std::vector<Vec3d> widened(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            widened[i] = privWiden(points[i]);
+        }
+        hull = CalculateConvexHull(widened);
+    }
+    if (hull.faces.empty())
+    {
+        return result;
+    }
+    std::vector<Vec3d> candidates[3];
+    candidates[0].assign(axes, axes + 3);
+    Vec3d hullAxes[3];
+    if (HullAxes(hull, hullAxes))
+    {
+        candidates[1].assign(hullAxes, hullAxes + 3);
+    }
+    candidates[2] = { Vec3d{ 1.0, 0.0, 0.0 }, Vec3d{ 0.0, 1.0, 0.0 }, Vec3d{ 0.0, 0.0, 1.0 } };
+    for (const std::vector<Vec3d>& start : candidates)
+    {
+        if (start.empty())
+        {
+            continue;
+        }
+        const OBB box = RefineOnHull(hull.vertices, start.data());
+        if (Volume(box) < Volume(result))
+        {
+            result = box;
+        }
+    }
+    return result;
+}
+
+template OBB CalculateOrientedBoundingBox(const std::vector<Vec3d>& points, bool refineOnHull);
+template OBB CalculateOrientedBoundingBox(const std::vector<Vec3f>& points, bool refineOnHull);
+
+bool IsOBBValid(const OBB& box)
+{
+    return box.halfExtents.x >= 0.0 && box.halfExtents.y >= 0.0 && box.halfExtents.z >= 0.0;
+}
+
+void CalculateOBBCorners(const OBB& box, Vec3d corners[8])
+{
+    for (int c = 0; c < 8; ++c)
+    {
+        Vec3d p = box.center;
+        for (int a = 0; a < 3; ++a)
+        {
+            const double s = ((c >> a) & 1) ? box.halfExtents.data[a] : -box.halfExtents.data[a];
+            p = Vec3d{ p.x + s * box.axes[a].x, p.y + s * box.axes[a].y, p.z + s * box.axes[a].z };
+        }
+        corners[c] = p;
+    }
+}
+
+double IntersectRay(const OBB& box, const Vec3d& origin, const Vec3d& direction)
+{
+    // slabs in the frame of the box.
+    const Vec3d offset = origin - box.center;
+    double entry = 0.0;
+    double exit = DBL_MAX;
+    for (int a = 0; a < 3; ++a)
+    {
+        const double o = DotProduct(offset, box.axes[a]);
+        const double d = DotProduct(direction, box.axes[a]);
+        const double h = box.halfExtents.data[a];
+        if (d == 0.0)
+        {
+            if (o < -h || o > h)
+            {
+                return DBL_MAX;
+            }
+            continue;
+        }
+        double t0 = (-h - o) / d;
+        double t1 = (h - o) / d;
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+        entry = std::max(entry, t0);
+        exit = std::min(exit, t1);
+        if (entry > exit)
+        {
+            return DBL_MAX;
+        }
+    }
+    return entry;
+}
+
+bool IsOBBInFrustum(const Frustum& frustum, const OBB& box)
+{
+    for (int p = 0; p < 6; ++p)
+    {
+        const Vec3d& n = frustum.normals[p];
+        // the projected radius of the box on the normal of the plane.
+        double radius = 0.0;
+        for (int a = 0; a < 3; ++a)
+        {
+            radius += box.halfExtents.data[a] * fabs(DotProduct(n, box.axes[a]));
+        }
+        if (DotProduct(n, box.center) + frustum.offsets[p] < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -1,6 +1,12 @@
 #include "Resha.h"
 #include <assert.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #if defined RESHA_OS_WINDOWS
 #define UNICODE
 #define NOMINMAX
@@ -333,3 +339,225 @@ double ElapsedSeconds(const StopWatch& in)
 }
 #endif
 //----------------------------------------------------------//
+
+//------------------------Threading---------------------------//
+size_t GetThreadsCount()
+{
+    static const size_t count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return count;
+}
+
+namespace
+{
+    // a ParallelFor call, its chunks are handed out dynamically so uneven work is balanced between
+    // the caller (thread 0) and the workers that join it.
+    struct ParallelJob
+    {
+        const std::function<void(size_t, size_t, size_t)>* func = nullptr;
+        size_t count = 0;
+        size_t grainSize = 1;
+        size_t chunksCount = 0;
+        size_t maxWorkersCount = 0;
+        std::atomic<size_t> nextChunk{ 0 };
+        size_t joinedCount = 0; // workers that took a thread index, guarded by the pool mutex.
+        size_t activeCount = 0; // workers still running chunks, guarded by the pool mutex.
+    };
+
+    // the calls made from a chunk run inline rather than waiting for workers busy with the outer call.
+    thread_local bool insideParallelFor = false;
+
+    void RunChunks(ParallelJob& job, size_t threadIndex)
+    {
+        for (size_t chunk = job.nextChunk++; chunk < job.chunksCount; chunk = job.nextChunk++)
+        {
+            const size_t begin = chunk * job.grainSize;
+            (*job.func)(begin, std::min(job.count, begin + job.grainSize), threadIndex);
+        }
+    }
+
+    // GetThreadsCount() - 1 workers started on the first parallel call. the jobs of concurrent
+    // callers (the UI and background jobs) share them, every job has its own thread indices.
+    struct ThreadPool
+    {
+        std::mutex mutex;
+        std::condition_variable jobsChanged;
+        std::condition_variable workerDone;
+        std::vector<ParallelJob*> jobs;
+
+        ThreadPool()
+        {
+            for (size_t i = 1; i < GetThreadsCount(); ++i)
+            {
+                std::thread(&ThreadPool::Work, this).detach();
+            }
+        }
+
+        ParallelJob* FindJob()
+        {
+            for (ParallelJob* job : jobs)
+            {
+                if (job->joinedCount < job->maxWorkersCount && job->nextChunk < job->chunksCount)
+                {
+                    return job;
+                }
+            }
+            return nullptr;
+        }
+
+        void Work()
+        {
+            insideParallelFor = true;
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                ParallelJob* job = nullptr;
+                jobsChanged.wait(lock, [&]() { return (job = FindJob()) != nullptr; });
+                const size_t threadIndex = ++job->joinedCount;
+                job->activeCount++;
+                lock.unlock();
+                RunChunks(*job, threadIndex);
+                lock.lock();
+                if (--job->activeCount == 0)
+                {
+                    workerDone.notify_all();
+                }
+            }
+        }
+
+        void Run(ParallelJob& job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(&job);
+            }
+            jobsChanged.notify_all();
+            insideParallelFor = true;
+            RunChunks(job, 0);
+            insideParallelFor = false;
+            // the job lives on the caller's stack, no worker can join it once it is out of the list.
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+            workerDone.wait(lock, [&]() { return job.activeCount == 0; });
+        }
+    };
+
+    ThreadPool& GetThreadPool()
+    {
+        // never destroyed, the detached workers are still waiting for jobs when the process exits.
+        static ThreadPool* pool = new ThreadPool();
+        return *pool;
+    }
+}
+
+void ParallelFor(size_t count, size_t grainSize,
+                 const std::function<void(size_t, size_t, size_t)>& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    grainSize = std::max<size_t>(1, grainSize);
+    const size_t chunksCount = (count + grainSize - 1) / grainSize;
+    const size_t threadsCount = std::min(GetThreadsCount(), chunksCount);
+    if (threadsCount == 1 || insideParallelFor)
+    {
+        for (size_t begin = 0; begin < count; begin += grainSize)
+        {
+            func(begin, std::min(count, begin + grainSize), 0);
+        }
+        return;
+    }
+
+    ParallelJob job;
+    job.func = &func;
+    job.count = count;
+    job.grainSize = grainSize;
+    job.chunksCount = chunksCount;
+    job.maxWorkersCount = threadsCount - 1;
+    GetThreadPool().Run(job);
+}
+
+namespace
+{
+    template <typename Key>
+    void RadixSortIndicesImpl(const std::vector<Key>& keys, std::vector<uint32_t>& order)
+    {
+        constexpr uint32_t BITS = 8;
+        constexpr uint32_t BUCKETS = 1 << BITS;
+        constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+        const size_t count = keys.size();
+        // fixed chunks, one per thread, so the scatter of a chunk can start at a known offset
+        // in every bucket and the sort stays stable.
+        const size_t chunkSize = std::max(MIN_CHUNK_SIZE, (count + GetThreadsCount() - 1) / GetThreadsCount());
+        const size_t chunksCount = std::max<size_t>(1, (count + chunkSize - 1) / chunkSize);
+
+        std::vector<Key> sortedKeys(keys);
+        std::vector<Key> tempKeys(count);
+        std::vector<uint32_t> tempOrder(count);
+        order.resize(count);
+        ParallelFor(count, chunkSize, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                order[i] = uint32_t(i);
+            }
+        });
+
+        std::vector<size_t> histograms(chunksCount * BUCKETS);
+        for (uint32_t shift = 0; shift < 8 * sizeof(Key); shift += BITS)
+        {
+            ParallelFor(count, chunkSize, [&](size_t begin, size_t end, size_t)
+            {
+                size_t* histogram = histograms.data() + (begin / chunkSize) * BUCKETS;
+                std::fill(histogram, histogram + BUCKETS, 0);
+                for (size_t i = begin; i < end; ++i)
+                {
+                    histogram[(sortedKeys[i] >> shift) & (BUCKETS - 1)]++;
+                }
+            });
+            // bucket major prefix sum, chunks of the same bucket stay in order.
+            size_t sum = 0;
+            bool skip = false;
+            for (uint32_t b = 0; b < BUCKETS; ++b)
+            {
+                size_t bucketCount = 0;
+                for (size_t c = 0; c < chunksCount; ++c)
+                {
+                    const size_t h = histograms[c * BUCKETS + b];
+                    histograms[c * BUCKETS + b] = sum;
+                    sum += h;
+                    bucketCount += h;
+                }
+                skip = skip || bucketCount == count;
+            }
+            if (skip)
+            {
+                // every key has the same digit.
+                continue;
+            }
+            ParallelFor(count, chunkSize, [&](size_t begin, size_t end, size_t)
+            {
+                size_t* offsets = histograms.data() + (begin / chunkSize) * BUCKETS;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const size_t target = offsets[(sortedKeys[i] >> shift) & (BUCKETS - 1)]++;
+                    tempKeys[target] = sortedKeys[i];
+                    tempOrder[target] = order[i];
+                }
+            });
+            sortedKeys.swap(tempKeys);
+            order.swap(tempOrder);
+        }
+    }
+}
+
+void RadixSortIndices(const std::vector<uint32_t>& keys, std::vector<uint32_t>& order)
+{
+    RadixSortIndicesImpl(keys, order);
+}
+
+void RadixSortIndices(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order)
+{
+    RadixSortIndicesImpl(keys, order);
+}
+//----------------------------------------------------------//
@@ -0,0 +1,463 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    constexpr size_t QUERIES_GRAIN_SIZE = 1024;
+
+    struct Cell
+    {
+        int64_t x, y, z;
+    };
+
+    bool operator==(const Cell& a, const Cell& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    int64_t Floor(double v)
+    {
+        // faster than floor() which is a library call without SSE4.1.
+        const int64_t i = int64_t(v);
+        return i - (v < double(i));
+    }
+
+    Cell CellOf(const Vec3d& p, double inverseCellSize)
+    {
+        return Cell{ Floor(p.x * inverseCellSize), Floor(p.y * inverseCellSize), Floor(p.z * inverseCellSize) };
+    }
+
+    // the cells of a block of 4x4x4 get consecutive entries, so the neighbourhood of a cell
+    // is mostly in a few contiguous ranges of the table and of the indices.
+    constexpr uint32_t BLOCK_BITS = 2;
+    constexpr uint32_t BLOCK_MASK = (1 << BLOCK_BITS) - 1;
+    constexpr size_t MIN_TABLE_SIZE = 1 << (3 * BLOCK_BITS);
+    // queries touching up to this many blocks check them for collisions in the table, when there
+    // are none the cells of a row in a block are read as one range without checking the cells.
+    constexpr size_t MAX_CHECKED_BLOCKS = 64;
+
+    uint32_t BlockEntry(int64_t x, int64_t y, int64_t z, uint32_t mask)
+    {
+        const uint32_t block = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u;
+        return (block << (3 * BLOCK_BITS)) & mask;
+    }
+
+    // the first cell of a block, negative blocks can't be shifted.
+    int64_t BlockStart(int64_t block)
+    {
+        return block * (int64_t(1) << BLOCK_BITS);
+    }
+
+    uint32_t LocalEntry(int64_t x, int64_t y, int64_t z)
+    {
+        return uint32_t(x & BLOCK_MASK) | uint32_t(y & BLOCK_MASK) << BLOCK_BITS | uint32_t(z & BLOCK_MASK) << (2 * BLOCK_BITS);
+    }
+
+    uint32_t HashCell(int64_t x, int64_t y, int64_t z, uint32_t mask)
+    {
+        return BlockEntry(x >> BLOCK_BITS, y >> BLOCK_BITS, z >> BLOCK_BITS, mask) | LocalEntry(x, y, z);
+    }
+
+    double SquaredDistance(const Vec3d& a, const Vec3d& b)
+    {
+        const double dx = a.x - b.x;
+        const double dy = a.y - b.y;
+        const double dz = a.z - b.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    size_t TableSize(size_t pointsCount)
+    {
+        // about two points per entry, a power of two so the hash is masked.
+        size_t size = MIN_TABLE_SIZE;
+        while (2 * size < pointsCount)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // as many cells as points in the cube on the longest side of the box, 1 when the points coincide.
+    double DefaultCellSize(const std::vector<Vec3d>& points)
+    {
+        BBox box;
+        for (const Vec3d& p : points)
+        {
+            box.min.x = std::min(box.min.x, p.x);
+            box.min.y = std::min(box.min.y, p.y);
+            box.min.z = std::min(box.min.z, p.z);
+            box.max.x = std::max(box.max.x, p.x);
+            box.max.y = std::max(box.max.y, p.y);
+            box.max.z = std::max(box.max.z, p.z);
+        }
+        const Vec3d size = box.max - box.min;
+        const double side = std::max(size.x, std::max(size.y, size.z));
+        return side > 0.0 ? side / cbrt(double(points.size())) : 1.0;
+    }
+
+    // Visits the points of a cell, entries are shared by colliding cells so the points of the
+    // other cells are skipped.
+    template <typename Func>
+    void VisitCell(const PointGrid& grid, const std::vector<Vec3d>& points, double inverseCellSize,
+                   const Cell& cell, Func&& func)
+    {
+        const uint32_t mask = uint32_t(grid.cellsStart.size() - 2);
+        const uint32_t h = HashCell(cell.x, cell.y, cell.z, mask);
+        for (uint32_t i = grid.cellsStart[h]; i < grid.cellsStart[h + 1]; ++i)
+        {
+            const uint32_t idx = grid.indices[i];
+            if (CellOf(points[idx], inverseCellSize) == cell)
+            {
+                func(idx);
+            }
+        }
+    }
+
+    // queries processed in the order of the entries of their cells share most of the memory
+    // they visit with the previous ones.
+    std::vector<uint32_t> SortQueries(const PointGrid& grid, const std::vector<Vec3d>& queries)
+    {
+        const double inverseCellSize = 1.0 / grid.cellSize;
+        const uint32_t mask = uint32_t(grid.cellsStart.size() - 2);
+        std::vector<uint32_t> keys(queries.size());
+        ParallelFor(queries.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Cell c = CellOf(queries[i], inverseCellSize);
+                keys[i] = HashCell(c.x, c.y, c.z, mask);
+            }
+        });
+        std::vector<uint32_t> order;
+        RadixSortIndices(keys, order);
+        return order;
+    }
+
+    // Calls func(index, squaredDistance) for all the points within radius of p.
+    template <typename Func>
+    void VisitPointsInRadius(const PointGrid& grid, const std::vector<Vec3d>& points,
+                             const Vec3d& p, double radius, Func&& func)
+    {
+        if (grid.indices.empty())
+        {
+            return;
+        }
+        const double inverseCellSize = 1.0 / grid.cellSize;
+        const Cell gridLo = CellOf(grid.box.min, inverseCellSize);
+        const Cell gridHi = CellOf(grid.box.max, inverseCellSize);
+        const Cell lo = CellOf(p - Vec3d{ radius, radius, radius }, inverseCellSize);
+        const Cell hi = CellOf(p + Vec3d{ radius, radius, radius }, inverseCellSize);
+        const Cell min{ std::max(lo.x, gridLo.x), std::max(lo.y, gridLo.y), std::max(lo.z, gridLo.z) };
+        const Cell max{ std::min(hi.x, gridHi.x), std::min(hi.y, gridHi.y), std::min(hi.z, gridHi.z) };
+        if (min.x > max.x || min.y > max.y || min.z > max.z)
+        {
+            return;
+        }
+        const double squaredRadius = radius * radius;
+        auto visit = [&](uint32_t idx)
+        {
+            const double d = SquaredDistance(points[idx], p);
+            if (d <= squaredRadius)
+            {
+                func(idx, d);
+            }
+        };
+
+        const uint32_t mask = uint32_t(grid.cellsStart.size() - 2);
+        const Cell blocksMin{ min.x >> BLOCK_BITS, min.y >> BLOCK_BITS, min.z >> BLOCK_BITS };
+        const Cell blocksMax{ max.x >> BLOCK_BITS, max.y >> BLOCK_BITS, max.z >> BLOCK_BITS };
+        const int64_t blocksCount = (blocksMax.x - blocksMin.x + 1) * (blocksMax.y - blocksMin.y + 1) * (blocksMax.z - blocksMin.z + 1);
+        bool collision = blocksCount > int64_t(MAX_CHECKED_BLOCKS);
+        if (!collision)
+        {
+            uint32_t entries[MAX_CHECKED_BLOCKS];
+            size_t count = 0;
+            for (int64_t bz = blocksMin.z; bz <= blocksMax.z; ++bz)
+            {
+                for (int64_t by = blocksMin.y; by <= blocksMax.y; ++by)
+                {
+                    for (int64_t bx = blocksMin.x; bx <= blocksMax.x; ++bx)
+                    {
+                        entries[count++] = BlockEntry(bx, by, bz, mask);
+                    }
+                }
+            }
+            std::sort(entries, entries + count);
+            collision = std::adjacent_find(entries, entries + count) != entries + count;
+        }
+
+        if (collision)
+        {
+            for (int64_t z = min.z; z <= max.z; ++z)
+            {
+                for (int64_t y = min.y; y <= max.y; ++y)
+                {
+                    for (int64_t x = min.x; x <= max.x; ++x)
+                    {
+                        VisitCell(grid, points, inverseCellSize, Cell{ x, y, z }, visit);
+                    }
+                }
+            }
+            return;
+        }
+
+        for (int64_t bz = blocksMin.z; bz <= blocksMax.z; ++bz)
+        {
+            for (int64_t by = blocksMin.y; by <= blocksMax.y; ++by)
+            {
+                for (int64_t bx = blocksMin.x; bx <= blocksMax.x; ++bx)
+                {
+                    const uint32_t block = BlockEntry(bx, by, bz, mask);
+                    const int64_t x0 = std::max(min.x, BlockStart(bx));
+                    const int64_t x1 = std::min(max.x, BlockStart(bx) + BLOCK_MASK);
+                    for (int64_t z = std::max(min.z, BlockStart(bz)); z <= std::min(max.z, BlockStart(bz) + BLOCK_MASK); ++z)
+                    {
+                        for (int64_t y = std::max(min.y, BlockStart(by)); y <= std::min(max.y, BlockStart(by) + BLOCK_MASK); ++y)
+                        {
+                            const uint32_t begin = grid.cellsStart[block | LocalEntry(x0, y, z)];
+                            const uint32_t end = grid.cellsStart[(block | LocalEntry(x1, y, z)) + 1];
+                            for (uint32_t i = begin; i < end; ++i)
+                            {
+                                visit(grid.indices[i]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // k nearest points as (squared distance, index) from the closest to the farthest, the search
+    // radius doubles until it contains k points.
+    void SearchNearestPoints(const PointGrid& grid, const std::vector<Vec3d>& points, const Vec3d& p,
+                             size_t k, std::vector<std::pair<double, uint32_t>>& candidates)
+    {
+        candidates.clear();
+        if (k == 0 || grid.indices.empty())
+        {
+            return;
+        }
+        // start at the grid for far away queries.
+        double distanceToBox = 0.0;
+        double farthest = 0.0;
+        for (int i = 0; i < 3; i++)
+        {
+            const double d = std::max({ grid.box.min.data[i] - p.data[i], p.data[i] - grid.box.max.data[i], 0.0 });
+            distanceToBox += d * d;
+            const double f = std::max(p.data[i] - grid.box.min.data[i], grid.box.max.data[i] - p.data[i]);
+            farthest += f * f;
+        }
+        farthest = sqrt(farthest);
+        for (double radius = sqrt(distanceToBox) + grid.cellSize;; radius *= 2.0)
+        {
+            candidates.clear();
+            VisitPointsInRadius(grid, points, p, radius, [&](uint32_t idx, double d)
+            {
+                candidates.emplace_back(d, idx);
+            });
+            if (candidates.size() >= k || radius >= farthest)
+            {
+                break;
+            }
+        }
+        const size_t count = std::min(k, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+        candidates.resize(count);
+    }
+}
+
+PointGrid BuildPointGrid(const std::vector<Vec3d>& points, double cellSize)
+{
+    PointGrid grid;
+    // the cell coordinates would be infinite, the size is replaced rather than failing the queries.
+    if (!(cellSize > 0.0 && cellSize < DBL_MAX))
+    {
+        cellSize = DefaultCellSize(points);
+    }
+    grid.cellSize = cellSize;
+    const size_t count = points.size();
+    const size_t tableSize = TableSize(count);
+    const uint32_t mask = uint32_t(tableSize - 1);
+    grid.cellsStart.assign(tableSize + 1, 0);
+    if (count == 0)
+    {
+        return grid;
+    }
+    const double inverseCellSize = 1.0 / cellSize;
+
+    const size_t chunksCount = (count + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<BBox> chunksBoxes(chunksCount);
+    std::vector<uint32_t> hashes(count);
+    ParallelFor(count, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        BBox& box = chunksBoxes[begin / GRAIN_SIZE];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Vec3d& p = points[i];
+            box.min.x = std::min(box.min.x, p.x);
+            box.min.y = std::min(box.min.y, p.y);
+            box.min.z = std::min(box.min.z, p.z);
+            box.max.x = std::max(box.max.x, p.x);
+            box.max.y = std::max(box.max.y, p.y);
+            box.max.z = std::max(box.max.z, p.z);
+            const Cell c = CellOf(p, inverseCellSize);
+            hashes[i] = HashCell(c.x, c.y, c.z, mask);
+        }
+    });
+    for (const BBox& box : chunksBoxes)
+    {
+        grid.box = Merge(grid.box, box);
+    }
+
+    // counting sort of the points by entry.
+    std::unique_ptr<std::atomic<uint32_t>[]> counters(new std::atomic<uint32_t>[tableSize]);
+    ParallelFor(tableSize, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t h = begin; h < end; ++h)
+        {
+            counters[h].store(0, std::memory_order_relaxed);
+        }
+    });
+    ParallelFor(count, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            counters[hashes[i]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    const size_t tableChunksCount = (tableSize + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<uint32_t> chunksOffsets(tableChunksCount + 1, 0);
+    ParallelFor(tableSize, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint32_t sum = 0;
+        for (size_t h = begin; h < end; ++h)
+        {
+            sum += counters[h].load(std::memory_order_relaxed);
+        }
+        chunksOffsets[begin / GRAIN_SIZE + 1] = sum;
+    });
+    for (size_t i = 1; i <= tableChunksCount; ++i)
+    {
+        chunksOffsets[i] += chunksOffsets[i - 1];
+    }
+    ParallelFor(tableSize, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint32_t sum = chunksOffsets[begin / GRAIN_SIZE];
+        for (size_t h = begin; h < end; ++h)
+        {
+            const uint32_t c = counters[h].load(std::memory_order_relaxed);
+            grid.cellsStart[h] = sum;
+            counters[h].store(sum, std::memory_order_relaxed);
+            sum += c;
+        }
+    });
+    grid.cellsStart[tableSize] = uint32_t(count);
+
+    grid.indices.resize(count);
+    ParallelFor(count, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            grid.indices[counters[hashes[i]].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+        }
+    });
+    // the scatter order depends on the threads timing, sorting the entries makes the grid
+    // (and the order of the queries results) deterministic.
+    ParallelFor(tableSize, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t h = begin; h < end; ++h)
+        {
+            std::sort(grid.indices.begin() + grid.cellsStart[h], grid.indices.begin() + grid.cellsStart[h + 1]);
+        }
+    });
+    return grid;
+}
+
+void FindPointsInRadius(const PointGrid& grid, const std::vector<Vec3d>& points,
+                        const Vec3d& p, double radius, std::vector<uint32_t>& result)
+{
+    VisitPointsInRadius(grid, points, p, radius, [&](uint32_t idx, double)
+    {
+        result.push_back(idx);
+    });
+}
+
+NeighboursList FindPointsInRadius(const PointGrid& grid, const std::vector<Vec3d>& points,
+                                  const std::vector<Vec3d>& queries, double radius)
+{
+    NeighboursList result;
+    const size_t count = queries.size();
+    result.offsets.assign(count + 1, 0);
+    const std::vector<uint32_t> order = SortQueries(grid, queries);
+    const size_t chunksCount = (count + QUERIES_GRAIN_SIZE - 1) / QUERIES_GRAIN_SIZE;
+    std::vector<std::vector<uint32_t>> chunksIndices(chunksCount);
+    ParallelFor(count, QUERIES_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t>& indices = chunksIndices[begin / QUERIES_GRAIN_SIZE];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const size_t before = indices.size();
+            FindPointsInRadius(grid, points, queries[order[i]], radius, indices);
+            result.offsets[order[i] + 1] = uint32_t(indices.size() - before);
+        }
+    });
+    for (size_t i = 0; i < count; ++i)
+    {
+        result.offsets[i + 1] += result.offsets[i];
+    }
+    result.indices.resize(result.offsets[count]);
+    ParallelFor(count, QUERIES_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint32_t>& indices = chunksIndices[begin / QUERIES_GRAIN_SIZE];
+        auto cursor = indices.begin();
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t q = order[i];
+            const uint32_t n = result.offsets[q + 1] - result.offsets[q];
+            std::copy(cursor, cursor + n, result.indices.begin() + result.offsets[q]);
+            cursor += n;
+        }
+        indices = std::vector<uint32_t>();
+    });
+    return result;
+}
+
+void FindNearestPoints(const PointGrid& grid, const std::vector<Vec3d>& points,
+                       const Vec3d& p, size_t k, std::vector<uint32_t>& result)
+{
+    std::vector<std::pair<double, uint32_t>> candidates;
+    SearchNearestPoints(grid, points, p, k, candidates);
+    result.clear();
+    for (const auto& candidate : candidates)
+    {
+        result.push_back(candidate.second);
+    }
+}
+
+std::vector<uint32_t> FindNearestPoints(const PointGrid& grid, const std::vector<Vec3d>& points,
+                                        const std::vector<Vec3d>& queries, size_t k)
+{
+    std::vector<uint32_t> result(queries.size() * k, UINT32_MAX);
+    const std::vector<uint32_t> order = SortQueries(grid, queries);
+    ParallelFor(queries.size(), QUERIES_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<std::pair<double, uint32_t>> candidates;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t q = order[i];
+            SearchNearestPoints(grid, points, queries[q], k, candidates);
+            for (size_t j = 0; j < candidates.size(); ++j)
+            {
+                result[k * q + j] = candidates[j].second;
+            }
+        }
+    });
+    return result;
+}
@@ -0,0 +1,254 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    constexpr size_t POINTS_GRAIN_SIZE = 4 * 1024;
+    // the Poisson disk sets are eliminated from this many times more uniform samples.
+    constexpr size_t OVERSAMPLING = 5;
+
+    // SplitMix64, one generator per chunk of samples seeded from the seed and the chunk index.
+    struct Random
+    {
+        uint64_t state = 0;
+    };
+
+    uint64_t NextRandom(Random& random)
+    {
+        uint64_t z = (random.state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, 1).
+    double NextDouble(Random& random)
+    {
+        return double(NextRandom(random) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    Random ChunkRandom(uint64_t seed, size_t chunk)
+    {
+        Random random{ seed };
+        random.state = NextRandom(random) ^ (uint64_t(chunk) * 0xd1b54a32d192ed03ull);
+        return random;
+    }
+
+    // cdf[f] is the area of the faces before f, the last entry the total area. the chunks are summed
+    // in parallel then offset by the totals of the previous ones.
+    std::vector<double> FacesAreasCDF(const SurfaceMesh& mesh)
+    {
+        const size_t facesCount = mesh.faces.size();
+        std::vector<double> cdf(facesCount + 1, 0.0);
+        std::vector<double> chunksAreas((facesCount + GRAIN_SIZE - 1) / GRAIN_SIZE, 0.0);
+        ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            double sum = 0.0;
+            for (size_t f = begin; f < end; ++f)
+            {
+                const Vec3d& a = mesh.vertices[mesh.faces[f].idx[0]];
+                const Vec3d& b = mesh.vertices[mesh.faces[f].idx[1]];
+                const Vec3d& c = mesh.vertices[mesh.faces[f].idx[2]];
+                const double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+                const double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+                const double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+                sum += 0.5 * sqrt(nx * nx + ny * ny + nz * nz);
+                cdf[f + 1] = sum;
+            }
+            chunksAreas[begin / GRAIN_SIZE] = sum;
+        });
+        for (size_t c = 1; c < chunksAreas.size(); ++c)
+        {
+            chunksAreas[c] += chunksAreas[c - 1];
+        }
+        ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            if (begin == 0)
+            {
+                return;
+            }
+            const double offset = chunksAreas[begin / GRAIN_SIZE - 1];
+            for (size_t f = begin; f < end; ++f)
+            {
+                cdf[f + 1] += offset;
+            }
+        });
+        return cdf;
+    }
+
+    // moves the top of a max heap down to its place.
+    void SiftDown(std::vector<std::pair<double, uint32_t>>& heap)
+    {
+        const std::pair<double, uint32_t> item = heap[0];
+        const size_t count = heap.size();
+        size_t position = 0;
+        for (size_t child = 1; child < count; child = 2 * position + 1)
+        {
+            if (child + 1 < count && heap[child] < heap[child + 1])
+            {
+                ++child;
+            }
+            if (!(item < heap[child]))
+            {
+                break;
+            }
+            heap[position] = heap[child];
+            position = child;
+        }
+        heap[position] = item;
+    }
+
+    SurfaceSamples SelectSamples(const SurfaceSamples& samples, const std::vector<bool>& keep)
+    {
+        SurfaceSamples result;
+        for (size_t i = 0; i < keep.size(); ++i)
+        {
+            if (keep[i])
+            {
+                result.positions.push_back(samples.positions[i]);
+                result.normals.push_back(samples.normals[i]);
+                result.faces.push_back(samples.faces[i]);
+            }
+        }
+        return result;
+    }
+
+    SurfaceSamples SampleFaces(const SurfaceMesh& mesh, const std::vector<double>& cdf, size_t count, uint64_t seed)
+    {
+        SurfaceSamples result;
+        const double area = cdf.back();
+        if (count == 0 || !(area > 0.0))
+        {
+            return result;
+        }
+        result.positions.resize(count);
+        result.normals.resize(count);
+        result.faces.resize(count);
+        ParallelFor(count, POINTS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            Random random = ChunkRandom(seed, begin / POINTS_GRAIN_SIZE);
+            const double step = area / double(count);
+            size_t f = size_t(std::upper_bound(cdf.begin() + 1, cdf.end(), double(begin) * step) - cdf.begin()) - 1;
+            for (size_t i = begin; i < end; ++i)
+            {
+                // the targets increase so the faces holding them are found walking forward, those
+                // without area are never picked.
+                const double target = (double(i) + NextDouble(random)) * step;
+                while (f + 1 < mesh.faces.size() && cdf[f + 1] <= target)
+                {
+                    ++f;
+                }
+                const Vec3d& a = mesh.vertices[mesh.faces[f].idx[0]];
+                const Vec3d& b = mesh.vertices[mesh.faces[f].idx[1]];
+                const Vec3d& c = mesh.vertices[mesh.faces[f].idx[2]];
+                // uniform barycentric coordinates.
+                const double r = sqrt(NextDouble(random));
+                const double s = NextDouble(random);
+                const double wa = 1.0 - r;
+                const double wb = r * (1.0 - s);
+                const double wc = r * s;
+                result.positions[i] = Vec3d{ wa * a.x + wb * b.x + wc * c.x, wa * a.y + wb * b.y + wc * c.y,
+                                             wa * a.z + wb * b.z + wc * c.z };
+                const double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+                const double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+                const double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+                const double length = sqrt(nx * nx + ny * ny + nz * nz);
+                result.normals[i] = Vec3d{ nx / length, ny / length, nz / length };
+                result.faces[i] = uint32_t(f);
+            }
+        });
+        return result;
+    }
+}
+
+SurfaceSamples SampleSurfaceUniform(const SurfaceMesh& mesh, size_t count, uint64_t seed)
+{
+    return SampleFaces(mesh, FacesAreasCDF(mesh), count, seed);
+}
+
+SurfaceSamples SampleSurfacePoissonDisk(const SurfaceMesh& mesh, size_t count, uint64_t seed)
+{
+    const std::vector<double> cdf = FacesAreasCDF(mesh);
+    const double area = cdf.back();
+    SurfaceSamples samples = SampleFaces(mesh, cdf, count * OVERSAMPLING, seed);
+    const size_t samplesCount = samples.positions.size();
+    if (samplesCount <= count)
+    {
+        return samples;
+    }
+
+    // sample elimination (Yuksel 2015): the radius of count disks packed hexagonally on the area, the
+    // samples weigh on each other up to twice that distance and the heaviest ones go first.
+    const double maxRadius = sqrt(area / (2.0 * sqrt(3.0) * double(count)));
+    const double range = 2.0 * maxRadius;
+    const double minDistance = range * (1.0 - pow(double(count) / double(samplesCount), 1.5)) * 0.65;
+    auto weight = [&](const Vec3d& a, const Vec3d& b)
+    {
+        const double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        const double distance = std::max(sqrt(dx * dx + dy * dy + dz * dz), minDistance);
+        const double w = 1.0 - distance / range;
+        const double w2 = w * w;
+        const double w4 = w2 * w2;
+        return w4 * w4;
+    };
+    // the neighbours are kept for the elimination, which would otherwise query them again in no
+    // particular order.
+    const PointGrid grid = BuildPointGrid(samples.positions, range);
+    const NeighboursList neighbours = FindPointsInRadius(grid, samples.positions, samples.positions, range);
+    std::vector<double> weights(samplesCount, 0.0);
+    ParallelFor(samplesCount, POINTS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            double sum = 0.0;
+            for (uint32_t k = neighbours.offsets[i]; k < neighbours.offsets[i + 1]; ++k)
+            {
+                const uint32_t n = neighbours.indices[k];
+                if (n != i)
+                {
+                    sum += weight(samples.positions[i], samples.positions[n]);
+                }
+            }
+            weights[i] = sum;
+        }
+    });
+
+    // the weights only decrease, the heap keeps the weight a sample had when it was pushed and a
+    // sample reaching the top with an outdated one is moved down then, rather than at each change.
+    std::vector<std::pair<double, uint32_t>> heap(samplesCount);
+    for (size_t i = 0; i < samplesCount; ++i)
+    {
+        heap[i] = { weights[i], uint32_t(i) };
+    }
+    std::make_heap(heap.begin(), heap.end());
+    std::vector<bool> keep(samplesCount, true);
+    for (size_t left = samplesCount; left > count;)
+    {
+        const uint32_t removed = heap[0].second;
+        if (heap[0].first != weights[removed])
+        {
+            heap[0].first = weights[removed];
+            SiftDown(heap);
+            continue;
+        }
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        keep[removed] = false;
+        --left;
+        for (uint32_t k = neighbours.offsets[removed]; k < neighbours.offsets[removed + 1]; ++k)
+        {
+            const uint32_t n = neighbours.indices[k];
+            if (keep[n] && n != removed)
+            {
+                weights[n] -= weight(samples.positions[removed], samples.positions[n]);
+            }
+        }
+    }
+
+    // the kept samples stay in the order they were drawn in.
+    return SelectSamples(samples, keep);
+}
@@ -0,0 +1,246 @@
+#include "Resha.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <robin_hood.h>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+
+    // a crossing point is identified by the edge it lies on.
+    uint64_t EdgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? uint64_t(a) << 32 | b : uint64_t(b) << 32 | a;
+    }
+
+    // bits of a double that sort like the double.
+    uint64_t SortableKey(double v)
+    {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        return (bits & 0x8000000000000000ull) ? ~bits : bits | 0x8000000000000000ull;
+    }
+
+    struct Segment
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    template <typename Vec>
+    Vec3d EdgePoint(const BasicSurfaceMesh<Vec>& mesh, const std::vector<double>& heights, uint64_t key, double height)
+    {
+        // always interpolated from the same end, so every use of an edge gives the same point.
+        const uint32_t a = uint32_t(key >> 32);
+        const uint32_t b = uint32_t(key);
+        const double t = (height - heights[a]) / (heights[b] - heights[a]);
+        const Vec3d start = privWiden(mesh.vertices[a]);
+        return start + (privWiden(mesh.vertices[b]) - start) * t;
+    }
+
+    void AppendPoint(Polyline& polyline, const Vec3d& p)
+    {
+        // a vertex lying on the plane is the crossing point of all its edges.
+        if (polyline.points.empty() || polyline.points.back() != p)
+        {
+            polyline.points.push_back(p);
+        }
+    }
+
+    // chains the segments of a layer through their shared edges.
+    template <typename Vec>
+    std::vector<Polyline> ChainSegments(const BasicSurfaceMesh<Vec>& mesh, const std::vector<double>& heights,
+                                        const std::vector<Segment>& segments, double height)
+    {
+        robin_hood::unordered_flat_map<uint64_t, uint32_t> starts;
+        robin_hood::unordered_flat_set<uint64_t> ends;
+        starts.reserve(segments.size());
+        ends.reserve(segments.size());
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            starts[segments[i].start] = uint32_t(i);
+            ends.insert(segments[i].end);
+        }
+
+        std::vector<Polyline> result;
+        std::vector<bool> used(segments.size(), false);
+        auto trace = [&](uint32_t first)
+        {
+            Polyline polyline;
+            AppendPoint(polyline, EdgePoint(mesh, heights, segments[first].start, height));
+            uint32_t current = first;
+            while (true)
+            {
+                used[current] = true;
+                const uint64_t end = segments[current].end;
+                AppendPoint(polyline, EdgePoint(mesh, heights, end, height));
+                if (end == segments[first].start)
+                {
+                    polyline.closed = true;
+                    break;
+                }
+                const auto next = starts.find(end);
+                if (next == starts.end() || used[next->second])
+                {
+                    break;
+                }
+                current = next->second;
+            }
+            if (polyline.closed && polyline.points.size() > 1 && polyline.points.front() == polyline.points.back())
+            {
+                polyline.points.pop_back();
+            }
+            result.push_back(std::move(polyline));
+        };
+        // open chains first (holes in the mesh), from the segments nothing leads to.
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            if (!used[i] && ends.find(segments[i].start) == ends.end())
+            {
+                trace(uint32_t(i));
+            }
+        }
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            if (!used[i])
+            {
+                trace(uint32_t(i));
+            }
+        }
+        return result;
+    }
+}
+
+template <typename Vec>
+std::vector<SliceLayer> SliceMesh(const BasicSurfaceMesh<Vec>& mesh, const Vec3d& direction, const std::vector<double>& heights)
+{
+    std::vector<SliceLayer> result(heights.size());
+    for (size_t i = 0; i < heights.size(); ++i)
+    {
+        result[i].height = heights[i];
+    }
+    if (heights.empty() || mesh.faces.empty())
+    {
+        return result;
+    }
+    const Vec3d up = Normalised(direction);
+
+    std::vector<double> verticesHeights(mesh.vertices.size());
+    ParallelFor(mesh.vertices.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            verticesHeights[i] = DotProduct(privWiden(mesh.vertices[i]), up);
+        }
+    });
+
+    // faces sorted by their lowest vertex, the faces crossing a plane are all in the prefix
+    // below it.
+    std::vector<uint64_t> keys(mesh.faces.size());
+    std::vector<double> facesMax(mesh.faces.size());
+    ParallelFor(mesh.faces.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            const double h0 = verticesHeights[t.idx[0]];
+            const double h1 = verticesHeights[t.idx[1]];
+            const double h2 = verticesHeights[t.idx[2]];
+            keys[i] = SortableKey(std::min({ h0, h1, h2 }));
+            facesMax[i] = std::max({ h0, h1, h2 });
+        }
+    });
+    std::vector<uint32_t> order;
+    RadixSortIndices(keys, order);
+    std::vector<double> sortedMin(order.size());
+    std::vector<double> sortedMax(order.size());
+    ParallelFor(order.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[order[i]];
+            sortedMin[i] = std::min({ verticesHeights[t.idx[0]], verticesHeights[t.idx[1]], verticesHeights[t.idx[2]] });
+            sortedMax[i] = facesMax[order[i]];
+        }
+    });
+    facesMax = std::vector<double>();
+
+    std::vector<uint32_t> layers(heights.size());
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        layers[i] = uint32_t(i);
+    }
+    std::sort(layers.begin(), layers.end(), [&](uint32_t a, uint32_t b)
+    {
+        return heights[a] < heights[b];
+    });
+
+    // the layers are split in one group per thread, every group sweeps the sorted faces
+    // up to its highest plane and hands each face to the planes of the group it spans.
+    const size_t groupSize = (layers.size() + GetThreadsCount() - 1) / GetThreadsCount();
+    ParallelFor(layers.size(), groupSize, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<std::vector<Segment>> segments(end - begin);
+        const double low = heights[layers[begin]];
+        const double high = heights[layers[end - 1]];
+        const size_t count = std::upper_bound(sortedMin.begin(), sortedMin.end(), high) - sortedMin.begin();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const double faceMax = sortedMax[i];
+            if (faceMax < low)
+            {
+                continue;
+            }
+            const Triangle& t = mesh.faces[order[i]];
+            const double h[3] = { verticesHeights[t.idx[0]], verticesHeights[t.idx[1]], verticesHeights[t.idx[2]] };
+            // first plane of the group at or above the face lowest vertex.
+            size_t layer = std::lower_bound(layers.begin() + begin, layers.begin() + end, sortedMin[i],
+                                            [&](uint32_t l, double v) { return heights[l] < v; }) - layers.begin();
+            for (; layer < end && heights[layers[layer]] <= faceMax; ++layer)
+            {
+                // a vertex is above the plane when strictly higher, so exactly two edges cross it
+                // or none does, even when vertices lie on the plane.
+                const double z = heights[layers[layer]];
+                uint64_t crossings[2];
+                int crossingsCount = 0;
+                for (int e = 0; e < 3; ++e)
+                {
+                    const int next = (e + 1) % 3;
+                    if ((h[e] > z) != (h[next] > z))
+                    {
+                        crossings[crossingsCount++] = EdgeKey(t.idx[e], t.idx[next]);
+                    }
+                }
+                if (crossingsCount != 2)
+                {
+                    continue;
+                }
+                // the edge going from below to above ends the segment, which makes the contours
+                // counter-clockwise seen from above around the material.
+                int e = 0;
+                while (!((h[e] > z) != (h[(e + 1) % 3] > z)))
+                {
+                    e++;
+                }
+                const bool firstGoesUp = h[(e + 1) % 3] > z;
+                Segment s;
+                s.start = firstGoesUp ? crossings[1] : crossings[0];
+                s.end = firstGoesUp ? crossings[0] : crossings[1];
+                segments[layer - begin].push_back(s);
+            }
+        }
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t l = layers[i];
+            result[l].contours = ChainSegments(mesh, verticesHeights, segments[i - begin], heights[l]);
+        }
+    });
+    return result;
+}
+
+template std::vector<SliceLayer> SliceMesh(const SurfaceMesh& mesh, const Vec3d& direction, const std::vector<double>& heights);
+template std::vector<SliceLayer> SliceMesh(const SurfaceMeshF& mesh, const Vec3d& direction, const std::vector<double>& heights);
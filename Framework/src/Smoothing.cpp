@@ -0,0 +1,106 @@
+#include "Resha.h"
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 16 * 1024;
+
+    bool IsBoundaryVertex(const VertexRings& rings, uint32_t v)
+    {
+        return rings.vertexOffsets[v + 1] - rings.vertexOffsets[v] > rings.faceOffsets[v + 1] - rings.faceOffsets[v];
+    }
+
+    // the vertices smoothing moves, in increasing order.
+    std::vector<uint32_t> CollectMovingVertices(const VertexRings& rings, const SmoothingOptions& options,
+                                                const std::vector<uint32_t>& selection)
+    {
+        std::vector<uint32_t> result;
+        const size_t count = selection.empty() ? rings.faceOffsets.size() - 1 : selection.size();
+        result.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t v = selection.empty() ? uint32_t(i) : selection[i];
+            const bool isolated = rings.vertexOffsets[v] == rings.vertexOffsets[v + 1];
+            if (!isolated && !(options.fixBoundary && IsBoundaryVertex(rings, v)))
+            {
+                result.push_back(v);
+            }
+        }
+        return result;
+    }
+
+    // summed per coordinate, this is the inner loop of every iteration.
+    Vec3d NeighboursAverage(const std::vector<Vec3d>& positions, const VertexRings& rings, uint32_t v)
+    {
+        double x = 0.0, y = 0.0, z = 0.0;
+        for (uint32_t i = rings.vertexOffsets[v]; i < rings.vertexOffsets[v + 1]; ++i)
+        {
+            const Vec3d& p = positions[rings.vertices[i]];
+            x += p.x;
+            y += p.y;
+            z += p.z;
+        }
+        const double scale = 1.0 / (rings.vertexOffsets[v + 1] - rings.vertexOffsets[v]);
+        return Vec3d{ x * scale, y * scale, z * scale };
+    }
+
+    // one umbrella step p + factor * (average - p) of the moving vertices, from source to target.
+    void UmbrellaStep(const std::vector<Vec3d>& source, std::vector<Vec3d>& target, const VertexRings& rings,
+                      const std::vector<uint32_t>& moving, double factor)
+    {
+        ParallelFor(moving.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t v = moving[i];
+                target[v] = source[v] + (NeighboursAverage(source, rings, v) - source[v]) * factor;
+            }
+        });
+    }
+}
+
+void SmoothMesh(SurfaceMesh& mesh, const VertexRings& rings, const SmoothingOptions& options,
+                const std::vector<uint32_t>& selection)
+{
+    const std::vector<uint32_t> moving = CollectMovingVertices(rings, options, selection);
+    // double buffered, the vertices that don't move hold the same position in both buffers.
+    std::vector<Vec3d> current = mesh.vertices;
+    std::vector<Vec3d> next = mesh.vertices;
+    if (options.method == SmoothingMethod::TAUBIN)
+    {
+        for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            UmbrellaStep(current, next, rings, moving, options.lambda);
+            UmbrellaStep(next, current, rings, moving, options.mu);
+        }
+    }
+    else
+    {
+        // HC algorithm (Vollmer et al. 1999): a Laplacian step followed by pushing the vertices back
+        // towards a blend of their original and previous positions. differences stays 0 on the
+        // vertices that don't move.
+        const std::vector<Vec3d>& original = mesh.vertices;
+        std::vector<Vec3d> differences(mesh.vertices.size(), Vec3d{ 0.0, 0.0, 0.0 });
+        for (size_t iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            ParallelFor(moving.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const uint32_t v = moving[i];
+                    next[v] = NeighboursAverage(current, rings, v);
+                    differences[v] = next[v] - (original[v] * options.alpha + current[v] * (1.0 - options.alpha));
+                }
+            });
+            ParallelFor(moving.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const uint32_t v = moving[i];
+                    current[v] = next[v] - (differences[v] * options.beta +
+                                            NeighboursAverage(differences, rings, v) * (1.0 - options.beta));
+                }
+            });
+        }
+    }
+    mesh.vertices = std::move(current);
+}
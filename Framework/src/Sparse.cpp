@@ -0,0 +1,436 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 16 * 1024;
+    // parts of the graph at most this large are not dissected further.
+    constexpr size_t DISSECTION_LEAF_SIZE = 64;
+
+    // the partial sums are taken over fixed chunks and added in order, so the result doesn't
+    // depend on the threads.
+    double ParallelDot(const std::vector<double>& a, const std::vector<double>& b)
+    {
+        const size_t chunksCount = (a.size() + GRAIN_SIZE - 1) / GRAIN_SIZE;
+        std::vector<double> sums(chunksCount, 0.0);
+        ParallelFor(a.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                sum += a[i] * b[i];
+            }
+            sums[begin / GRAIN_SIZE] = sum;
+        });
+        double result = 0.0;
+        for (double sum : sums)
+        {
+            result += sum;
+        }
+        return result;
+    }
+
+    // breadth first levels of the part of the graph marked with part, returns the last vertex reached.
+    uint32_t BreadthFirstLevels(const SparseMatrix& graph, const std::vector<uint32_t>& parts, uint32_t part,
+                                uint32_t start, std::vector<uint32_t>& levels, std::vector<uint32_t>& queue)
+    {
+        queue.clear();
+        queue.push_back(start);
+        levels[start] = 0;
+        for (size_t head = 0; head < queue.size(); ++head)
+        {
+            const uint32_t v = queue[head];
+            for (size_t p = graph.offsets[v]; p < graph.offsets[v + 1]; ++p)
+            {
+                const uint32_t n = graph.columns[p];
+                if (parts[n] == part && levels[n] == UINT32_MAX)
+                {
+                    levels[n] = levels[v] + 1;
+                    queue.push_back(n);
+                }
+            }
+        }
+        return queue.back();
+    }
+
+    // elimination order by recursive bisection with breadth first level separators, every part
+    // is ordered before the separator that split it off.
+    std::vector<uint32_t> NestedDissectionOrder(const SparseMatrix& graph)
+    {
+        const size_t count = graph.rowsCount;
+        std::vector<uint32_t> order(count);
+        std::vector<uint32_t> parts(count, 0);
+        std::vector<uint32_t> levels(count, UINT32_MAX);
+        std::vector<uint32_t> queue;
+        uint32_t partsCount = 1;
+
+        struct Part
+        {
+            std::vector<uint32_t> vertices;
+            size_t position; // first position of the part in order.
+        };
+        std::vector<Part> stack;
+        stack.push_back(Part());
+        stack.back().position = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            stack.back().vertices.push_back(i);
+        }
+        while (!stack.empty())
+        {
+            Part part = std::move(stack.back());
+            stack.pop_back();
+            if (part.vertices.size() <= DISSECTION_LEAF_SIZE)
+            {
+                std::copy(part.vertices.begin(), part.vertices.end(), order.begin() + part.position);
+                continue;
+            }
+            const uint32_t id = parts[part.vertices.front()];
+            // two sweeps find a pseudo-peripheral vertex, the levels from it are long and thin.
+            uint32_t far = BreadthFirstLevels(graph, parts, id, part.vertices.front(), levels, queue);
+            for (uint32_t v : queue)
+            {
+                levels[v] = UINT32_MAX;
+            }
+            BreadthFirstLevels(graph, parts, id, far, levels, queue);
+            const uint32_t depth = levels[queue.back()];
+
+            Part sides[3];
+            std::vector<uint32_t> separator;
+            if (depth < 2)
+            {
+                // too dense to split, keep it whole.
+                separator = queue;
+            }
+            else
+            {
+                // the level where half of the reached vertices come before it.
+                std::vector<size_t> levelCounts(depth + 1, 0);
+                for (uint32_t v : queue)
+                {
+                    levelCounts[levels[v]]++;
+                }
+                uint32_t middle = 1;
+                size_t before = levelCounts[0];
+                while (middle < depth - 1 && before + levelCounts[middle] < queue.size() / 2)
+                {
+                    before += levelCounts[middle++];
+                }
+                for (uint32_t v : queue)
+                {
+                    const uint32_t level = levels[v];
+                    if (level == middle)
+                    {
+                        separator.push_back(v);
+                    }
+                    else
+                    {
+                        sides[level < middle ? 0 : 1].vertices.push_back(v);
+                    }
+                }
+            }
+            for (uint32_t v : queue)
+            {
+                levels[v] = UINT32_MAX;
+            }
+            // the vertices the sweep didn't reach are disconnected from it.
+            if (queue.size() < part.vertices.size())
+            {
+                for (uint32_t v : queue)
+                {
+                    parts[v] = UINT32_MAX;
+                }
+                for (uint32_t v : part.vertices)
+                {
+                    if (parts[v] == id)
+                    {
+                        sides[2].vertices.push_back(v);
+                    }
+                }
+            }
+
+            size_t position = part.position;
+            for (Part& side : sides)
+            {
+                if (side.vertices.empty())
+                {
+                    continue;
+                }
+                for (uint32_t v : side.vertices)
+                {
+                    parts[v] = partsCount;
+                }
+                partsCount++;
+                side.position = position;
+                position += side.vertices.size();
+                stack.push_back(std::move(side));
+            }
+            for (uint32_t v : separator)
+            {
+                parts[v] = UINT32_MAX;
+            }
+            std::copy(separator.begin(), separator.end(), order.begin() + position);
+        }
+        return order;
+    }
+}
+
+SparseMatrix BuildSparseMatrix(size_t rowsCount, size_t columnsCount, const std::vector<MatrixEntry>& entries)
+{
+    SparseMatrix result;
+    result.rowsCount = rowsCount;
+    result.columnsCount = columnsCount;
+    std::vector<uint64_t> keys(entries.size());
+    ParallelFor(entries.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            keys[i] = uint64_t(entries[i].row) << 32 | entries[i].column;
+        }
+    });
+    std::vector<uint32_t> order;
+    RadixSortIndices(keys, order);
+
+    result.offsets.assign(rowsCount + 1, 0);
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const MatrixEntry& e = entries[order[i]];
+        if (i > 0 && keys[order[i]] == keys[order[i - 1]])
+        {
+            result.values.back() += e.value;
+            continue;
+        }
+        result.columns.push_back(e.column);
+        result.values.push_back(e.value);
+        result.offsets[e.row + 1]++;
+    }
+    for (size_t i = 0; i < rowsCount; ++i)
+    {
+        result.offsets[i + 1] += result.offsets[i];
+    }
+    return result;
+}
+
+void Multiply(const SparseMatrix& matrix, const std::vector<double>& x, std::vector<double>& result)
+{
+    result.resize(matrix.rowsCount);
+    ParallelFor(matrix.rowsCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            double sum = 0.0;
+            for (size_t p = matrix.offsets[i]; p < matrix.offsets[i + 1]; ++p)
+            {
+                sum += matrix.values[p] * x[matrix.columns[p]];
+            }
+            result[i] = sum;
+        }
+    });
+}
+
+SolverResult SolveConjugateGradient(const SparseMatrix& matrix, const std::vector<double>& b, std::vector<double>& x,
+                                    double tolerance, size_t maxIterations)
+{
+    SolverResult result;
+    const size_t n = matrix.rowsCount;
+    x.resize(n, 0.0);
+    std::vector<double> inverseDiagonal(n, 1.0);
+    ParallelFor(n, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (size_t p = matrix.offsets[i]; p < matrix.offsets[i + 1]; ++p)
+            {
+                if (matrix.columns[p] == i && matrix.values[p] != 0.0)
+                {
+                    inverseDiagonal[i] = 1.0 / matrix.values[p];
+                }
+            }
+        }
+    });
+
+    std::vector<double> r;
+    Multiply(matrix, x, r);
+    std::vector<double> z(n);
+    std::vector<double> p(n);
+    std::vector<double> q(n);
+    ParallelFor(n, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            r[i] = b[i] - r[i];
+            z[i] = r[i] * inverseDiagonal[i];
+            p[i] = z[i];
+        }
+    });
+    const double bNorm = sqrt(ParallelDot(b, b));
+    const double threshold = tolerance * (bNorm > 0.0 ? bNorm : 1.0);
+    double rz = ParallelDot(r, z);
+    result.residual = sqrt(ParallelDot(r, r));
+    while (result.residual > threshold && result.iterations < maxIterations)
+    {
+        Multiply(matrix, p, q);
+        const double alpha = rz / ParallelDot(p, q);
+        ParallelFor(n, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+                z[i] = r[i] * inverseDiagonal[i];
+            }
+        });
+        const double nextRz = ParallelDot(r, z);
+        const double beta = nextRz / rz;
+        rz = nextRz;
+        ParallelFor(n, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                p[i] = z[i] + beta * p[i];
+            }
+        });
+        result.residual = sqrt(ParallelDot(r, r));
+        result.iterations++;
+    }
+    result.converged = result.residual <= threshold;
+    return result;
+}
+
+// up-looking LDL^T (Davis 2005) on the matrix permuted by nested dissection, the elimination
+// tree gives the pattern of every row of L.
+bool FactoriseCholesky(const SparseMatrix& matrix, CholeskyFactor& factor, size_t maxEntriesCount)
+{
+    const size_t n = matrix.rowsCount;
+    factor.permutation = NestedDissectionOrder(matrix);
+    std::vector<uint32_t> inverse(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        inverse[factor.permutation[k]] = uint32_t(k);
+    }
+
+    std::vector<uint32_t> parents(n);
+    std::vector<uint32_t> flags(n);
+    std::vector<size_t> counts(n, 0);
+    for (size_t k = 0; k < n; ++k)
+    {
+        parents[k] = UINT32_MAX;
+        flags[k] = uint32_t(k);
+        const uint32_t row = factor.permutation[k];
+        for (size_t p = matrix.offsets[row]; p < matrix.offsets[row + 1]; ++p)
+        {
+            for (uint32_t i = inverse[matrix.columns[p]]; i < k && flags[i] != k; i = parents[i])
+            {
+                if (parents[i] == UINT32_MAX)
+                {
+                    parents[i] = uint32_t(k);
+                }
+                counts[i]++;
+                flags[i] = uint32_t(k);
+            }
+        }
+    }
+    factor.offsets.assign(n + 1, 0);
+    for (size_t k = 0; k < n; ++k)
+    {
+        factor.offsets[k + 1] = factor.offsets[k] + counts[k];
+    }
+    if (factor.offsets[n] > maxEntriesCount)
+    {
+        return false;
+    }
+
+    factor.rows.resize(factor.offsets[n]);
+    factor.values.resize(factor.offsets[n]);
+    factor.diagonal.assign(n, 0.0);
+    std::vector<double> y(n, 0.0);
+    std::vector<uint32_t> pattern(n);
+    std::fill(counts.begin(), counts.end(), 0);
+    std::fill(flags.begin(), flags.end(), UINT32_MAX);
+    for (size_t k = 0; k < n; ++k)
+    {
+        // scatter row k of the permuted matrix and find the pattern of row k of L.
+        size_t top = n;
+        flags[k] = uint32_t(k);
+        const uint32_t row = factor.permutation[k];
+        for (size_t p = matrix.offsets[row]; p < matrix.offsets[row + 1]; ++p)
+        {
+            uint32_t i = inverse[matrix.columns[p]];
+            if (i > k)
+            {
+                continue;
+            }
+            y[i] += matrix.values[p];
+            size_t length = 0;
+            for (; flags[i] != k; i = parents[i])
+            {
+                pattern[length++] = i;
+                flags[i] = uint32_t(k);
+            }
+            while (length > 0)
+            {
+                pattern[--top] = pattern[--length];
+            }
+        }
+        double d = y[k];
+        y[k] = 0.0;
+        for (; top < n; ++top)
+        {
+            const uint32_t i = pattern[top];
+            const double yi = y[i];
+            y[i] = 0.0;
+            const size_t end = factor.offsets[i] + counts[i];
+            for (size_t p = factor.offsets[i]; p < end; ++p)
+            {
+                y[factor.rows[p]] -= factor.values[p] * yi;
+            }
+            const double l = yi / factor.diagonal[i];
+            d -= l * yi;
+            factor.rows[end] = uint32_t(k);
+            factor.values[end] = l;
+            counts[i]++;
+        }
+        if (!(d > 0.0))
+        {
+            return false;
+        }
+        factor.diagonal[k] = d;
+    }
+    return true;
+}
+
+void SolveCholesky(const CholeskyFactor& factor, const std::vector<double>& b, std::vector<double>& x)
+{
+    const size_t n = factor.diagonal.size();
+    std::vector<double> y(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        y[k] = b[factor.permutation[k]];
+    }
+    for (size_t j = 0; j < n; ++j)
+    {
+        for (size_t p = factor.offsets[j]; p < factor.offsets[j + 1]; ++p)
+        {
+            y[factor.rows[p]] -= factor.values[p] * y[j];
+        }
+    }
+    for (size_t j = 0; j < n; ++j)
+    {
+        y[j] /= factor.diagonal[j];
+    }
+    for (size_t j = n; j-- > 0;)
+    {
+        for (size_t p = factor.offsets[j]; p < factor.offsets[j + 1]; ++p)
+        {
+            y[j] -= factor.values[p] * y[factor.rows[p]];
+        }
+    }
+    x.resize(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        x[factor.permutation[k]] = y[k];
+    }
+}
@@ -0,0 +1,325 @@
+#include "Resha.h"
+
+#include <math.h>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+
+    struct SubdivisionEdge
+    {
+        uint32_t a;           // a <= b
+        uint32_t b;
+        uint32_t opposite[2]; // third vertex of the first two faces using the edge.
+        uint32_t facesCount;
+    };
+
+    // scratch space of a level, sized once for the finest level and reused by every level.
+    struct EdgeTable
+    {
+        std::vector<uint64_t> keys;          // a << 32 | b of every half-edge.
+        std::vector<uint32_t> order;         // half-edges sorted by key.
+        std::vector<uint32_t> halfEdgeEdges; // edge of every half-edge.
+        std::vector<SubdivisionEdge> edges;  // sorted by (a, b).
+        std::vector<uint32_t> ends;          // b of every edge, then the edges sorted by it.
+        std::vector<uint32_t> endsOrder;
+        std::vector<uint32_t> startOffsets;  // edges[startOffsets[v]] up to startOffsets[v + 1] start at v.
+        std::vector<uint32_t> endOffsets;    // likewise for the edges ending at v, through endsOrder.
+        std::vector<size_t> chunkStarts;
+    };
+
+    // offsets[v] is the first position of values sorted in increasing order that is >= v, for v in
+    // [0, verticesCount], filled in parallel from the positions where the value changes.
+    template <typename Value>
+    void FillOffsets(size_t count, size_t verticesCount, const Value& value, std::vector<uint32_t>& offsets)
+    {
+        offsets.resize(verticesCount + 1);
+        ParallelFor(count + 1, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const size_t previous = i == 0 ? 0 : size_t(value(i - 1)) + 1;
+                const size_t current = i == count ? verticesCount + 1 : size_t(value(i)) + 1;
+                for (size_t v = previous; v < current; ++v)
+                {
+                    offsets[v] = uint32_t(i);
+                }
+            }
+        });
+    }
+
+    // unique edges of the faces through sorted keys, no hashing.
+    void BuildEdgeTable(const std::vector<Triangle>& faces, size_t verticesCount, bool withIncidence, EdgeTable& table)
+    {
+        const size_t halfEdgesCount = faces.size() * 3;
+        table.keys.resize(halfEdgesCount);
+        ParallelFor(faces.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t f = begin; f < end; ++f)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    const uint32_t a = faces[f].idx[e];
+                    const uint32_t b = faces[f].idx[(e + 1) % 3];
+                    table.keys[f * 3 + e] = a < b ? uint64_t(a) << 32 | b : uint64_t(b) << 32 | a;
+                }
+            }
+        });
+        RadixSortIndices(table.keys, table.order);
+
+        // every run of equal keys is an edge, the chunks count theirs first to know where they start.
+        const size_t chunksCount = (halfEdgesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+        auto isRunStart = [&](size_t i)
+        {
+            return i == 0 || table.keys[table.order[i]] != table.keys[table.order[i - 1]];
+        };
+        table.chunkStarts.assign(chunksCount + 1, 0);
+        ParallelFor(halfEdgesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            size_t count = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                count += isRunStart(i);
+            }
+            table.chunkStarts[begin / GRAIN_SIZE + 1] = count;
+        });
+        for (size_t c = 0; c < chunksCount; ++c)
+        {
+            table.chunkStarts[c + 1] += table.chunkStarts[c];
+        }
+        table.halfEdgeEdges.resize(halfEdgesCount);
+        table.edges.resize(table.chunkStarts[chunksCount]);
+        ParallelFor(halfEdgesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            size_t edge = table.chunkStarts[begin / GRAIN_SIZE] - 1;
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (isRunStart(i))
+                {
+                    edge++;
+                    const uint64_t key = table.keys[table.order[i]];
+                    SubdivisionEdge& e = table.edges[edge];
+                    e.a = uint32_t(key >> 32);
+                    e.b = uint32_t(key);
+                    e.opposite[0] = e.opposite[1] = UINT32_MAX;
+                    e.facesCount = 0;
+                    for (size_t j = i; j < halfEdgesCount && table.keys[table.order[j]] == key; ++j)
+                    {
+                        const uint32_t halfEdge = table.order[j];
+                        if (e.facesCount < 2)
+                        {
+                            e.opposite[e.facesCount] = faces[halfEdge / 3].idx[(halfEdge % 3 + 2) % 3];
+                        }
+                        e.facesCount++;
+                    }
+                }
+                table.halfEdgeEdges[table.order[i]] = uint32_t(edge);
+            }
+        });
+        if (!withIncidence)
+        {
+            return;
+        }
+
+        const size_t edgesCount = table.edges.size();
+        FillOffsets(edgesCount, verticesCount, [&](size_t e) { return table.edges[e].a; }, table.startOffsets);
+        table.ends.resize(edgesCount);
+        ParallelFor(edgesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t e = begin; e < end; ++e)
+            {
+                table.ends[e] = table.edges[e].b;
+            }
+        });
+        RadixSortIndices(table.ends, table.endsOrder);
+        FillOffsets(edgesCount, verticesCount, [&](size_t i) { return table.edges[table.endsOrder[i]].b; }, table.endOffsets);
+    }
+
+    // Loop's weight of the neighbours of an interior vertex of the given valence.
+    double LoopBeta(size_t valence)
+    {
+        const double c = 3.0 / 8.0 + cos(2.0 * PI / valence) / 4.0;
+        return (5.0 / 8.0 - c * c) / valence;
+    }
+
+    // an edge not shared by exactly two faces is a crease, it and its vertices follow the curve rules.
+    bool IsCrease(const SubdivisionEdge& e)
+    {
+        return e.facesCount != 2;
+    }
+
+    // table holds the edges of faces, with their incidence for the Loop scheme.
+    void SubdivideLevel(const std::vector<Vec3d>& vertices, const std::vector<Triangle>& faces, SubdivisionScheme scheme,
+                        const EdgeTable& table, std::vector<Vec3d>& outVertices, std::vector<Triangle>& outFaces)
+    {
+        const size_t verticesCount = vertices.size();
+        const bool isLoop = scheme == SubdivisionScheme::LOOP;
+        const size_t edgesCount = table.edges.size();
+        outVertices.resize(verticesCount + edgesCount);
+        outFaces.resize(faces.size() * 4);
+
+        // the original vertices come first, then one vertex per edge.
+        ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t v = begin; v < end; ++v)
+            {
+                if (!isLoop)
+                {
+                    outVertices[v] = vertices[v];
+                    continue;
+                }
+                double sum[3] = { 0.0, 0.0, 0.0 };
+                double creaseSum[3] = { 0.0, 0.0, 0.0 };
+                size_t valence = 0;
+                size_t creasesCount = 0;
+                auto addNeighbour = [&](const SubdivisionEdge& e, uint32_t neighbour)
+                {
+                    const Vec3d& p = vertices[neighbour];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        sum[k] += p.data[k];
+                    }
+                    valence++;
+                    if (IsCrease(e))
+                    {
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            creaseSum[k] += p.data[k];
+                        }
+                        creasesCount++;
+                    }
+                };
+                for (uint32_t i = table.startOffsets[v]; i < table.startOffsets[v + 1]; ++i)
+                {
+                    addNeighbour(table.edges[i], table.edges[i].b);
+                }
+                for (uint32_t i = table.endOffsets[v]; i < table.endOffsets[v + 1]; ++i)
+                {
+                    const SubdivisionEdge& e = table.edges[table.endsOrder[i]];
+                    addNeighbour(e, e.a);
+                }
+                const Vec3d& p = vertices[v];
+                Vec3d& result = outVertices[v];
+                if (creasesCount == 2)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        result.data[k] = 0.75 * p.data[k] + 0.125 * creaseSum[k];
+                    }
+                }
+                else if (creasesCount > 0 || valence == 0)
+                {
+                    // corners of the creases don't move.
+                    result = p;
+                }
+                else
+                {
+                    const double beta = LoopBeta(valence);
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        result.data[k] = (1.0 - valence * beta) * p.data[k] + beta * sum[k];
+                    }
+                }
+            }
+        });
+        ParallelFor(edgesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const SubdivisionEdge& e = table.edges[i];
+                const Vec3d& a = vertices[e.a];
+                const Vec3d& b = vertices[e.b];
+                Vec3d& result = outVertices[verticesCount + i];
+                if (isLoop && !IsCrease(e))
+                {
+                    const Vec3d& c = vertices[e.opposite[0]];
+                    const Vec3d& d = vertices[e.opposite[1]];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        result.data[k] = 0.375 * (a.data[k] + b.data[k]) + 0.125 * (c.data[k] + d.data[k]);
+                    }
+                }
+                else
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        result.data[k] = 0.5 * (a.data[k] + b.data[k]);
+                    }
+                }
+            }
+        });
+
+        // every face is split in three corner faces and a middle one, all with its orientation.
+        ParallelFor(faces.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t f = begin; f < end; ++f)
+            {
+                const uint32_t* v = faces[f].idx;
+                const uint32_t e0 = uint32_t(verticesCount + table.halfEdgeEdges[f * 3]);
+                const uint32_t e1 = uint32_t(verticesCount + table.halfEdgeEdges[f * 3 + 1]);
+                const uint32_t e2 = uint32_t(verticesCount + table.halfEdgeEdges[f * 3 + 2]);
+                outFaces[f * 4] = Triangle{ { v[0], e0, e2 } };
+                outFaces[f * 4 + 1] = Triangle{ { v[1], e1, e0 } };
+                outFaces[f * 4 + 2] = Triangle{ { v[2], e2, e1 } };
+                outFaces[f * 4 + 3] = Triangle{ { e0, e1, e2 } };
+            }
+        });
+    }
+}
+
+SurfaceMesh SubdivideMesh(const SurfaceMesh& mesh, SubdivisionScheme scheme, size_t levels)
+{
+    SurfaceMesh result;
+    result.name = mesh.name;
+    result.color = mesh.color;
+    result.visible = mesh.visible;
+    result.id = GenerateUUID();
+    if (levels == 0 || mesh.faces.empty())
+    {
+        result.vertices = mesh.vertices;
+        result.faces = mesh.faces;
+        return result;
+    }
+
+    // the first edge table gives the size of every level: a level adds a vertex per edge, splits
+    // every edge in two, adds three edges inside every face and splits it in four.
+    const bool withIncidence = scheme == SubdivisionScheme::LOOP;
+    EdgeTable table;
+    BuildEdgeTable(mesh.faces, mesh.vertices.size(), withIncidence, table);
+    size_t verticesCount = mesh.vertices.size();
+    size_t edgesCount = table.edges.size();
+    size_t facesCount = mesh.faces.size();
+    for (size_t level = 0; level + 1 < levels; ++level)
+    {
+        verticesCount += edgesCount;
+        edgesCount = 2 * edgesCount + 3 * facesCount;
+        facesCount *= 4;
+    }
+    table.keys.reserve(facesCount * 3);
+    table.order.reserve(facesCount * 3);
+    table.halfEdgeEdges.reserve(facesCount * 3);
+    table.edges.reserve(edgesCount);
+    table.ends.reserve(edgesCount);
+    table.endsOrder.reserve(edgesCount);
+    table.startOffsets.reserve(verticesCount + 1);
+    table.endOffsets.reserve(verticesCount + 1);
+
+    // the levels alternate between two buffers, the one the last level writes is the result.
+    std::vector<Vec3d> vertices[2];
+    std::vector<Triangle> faces[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        vertices[i].reserve(verticesCount + edgesCount);
+        faces[i].reserve(facesCount * 4);
+    }
+    SubdivideLevel(mesh.vertices, mesh.faces, scheme, table, vertices[0], faces[0]);
+    for (size_t level = 1; level < levels; ++level)
+    {
+        const size_t source = (level - 1) % 2;
+        BuildEdgeTable(faces[source], vertices[source].size(), withIncidence, table);
+        SubdivideLevel(vertices[source], faces[source], scheme, table, vertices[1 - source], faces[1 - source]);
+    }
+    result.vertices = std::move(vertices[(levels - 1) % 2]);
+    result.faces = std::move(faces[(levels - 1) % 2]);
+    return result;
+}
@@ -0,0 +1,510 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RESHA_TRANSFORM_SSE2 1
+#endif
+
+// the AVX kernels are compiled for AVX whatever the flags of the build and only run when the CPU
+// has it.
+#if RESHA_TRANSFORM_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define RESHA_TRANSFORM_AVX 1
+#define RESHA_TARGET_AVX __attribute__((target("avx")))
+#elif RESHA_TRANSFORM_SSE2 && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define RESHA_TRANSFORM_AVX 1
+#define RESHA_TARGET_AVX
+#endif
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+
+    SimdLevel DetectSimdLevel()
+    {
+#if RESHA_TRANSFORM_AVX && (defined(__GNUC__) || defined(__clang__))
+        if (__builtin_cpu_supports("avx"))
+        {
+            return SimdLevel::AVX;
+        }
+#elif RESHA_TRANSFORM_AVX
+        // AVX, and the OS saving the ymm registers.
+        int info[4];
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+        {
+            return SimdLevel::AVX;
+        }
+#endif
+#if RESHA_TRANSFORM_SSE2
+        return SimdLevel::SSE2;
+#else
+        return SimdLevel::SCALAR;
+#endif
+    }
+
+    std::atomic<SimdLevel>& CurrentSimdLevel()
+    {
+        static std::atomic<SimdLevel> level{ DetectSimdLevel() };
+        return level;
+    }
+
+    // the kernels sum the columns weighted by the coefficients in the order of the columns and
+    // without fused multiply adds, so every level rounds the same way.
+    template <typename T>
+    Mat<T, 4> MultiplyScalar(const Mat<T, 4>& left, const Mat<T, 4>& right)
+    {
+        Mat<T, 4> result;
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+            {
+                result.elements[c][r] = left.elements[0][r] * right.elements[c][0] + left.elements[1][r] * right.elements[c][1] +
+                                        left.elements[2][r] * right.elements[c][2] + left.elements[3][r] * right.elements[c][3];
+            }
+        }
+        return result;
+    }
+
+#if RESHA_TRANSFORM_SSE2
+    // the rows 0 and 1 of m * v in low, 2 and 3 in high.
+    void MultiplySse2(const Mat4& m, const double v[4], __m128d& low, __m128d& high)
+    {
+        low = _mm_mul_pd(_mm_loadu_pd(m.elements[0]), _mm_set1_pd(v[0]));
+        high = _mm_mul_pd(_mm_loadu_pd(m.elements[0] + 2), _mm_set1_pd(v[0]));
+        for (int k = 1; k < 4; ++k)
+        {
+            const __m128d weight = _mm_set1_pd(v[k]);
+            low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(m.elements[k]), weight));
+            high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(m.elements[k] + 2), weight));
+        }
+    }
+
+    Mat4 MultiplySse2(const Mat4& left, const Mat4& right)
+    {
+        Mat4 result;
+        for (int c = 0; c < 4; ++c)
+        {
+            __m128d low, high;
+            MultiplySse2(left, right.elements[c], low, high);
+            _mm_storeu_pd(result.elements[c], low);
+            _mm_storeu_pd(result.elements[c] + 2, high);
+        }
+        return result;
+    }
+
+    __m128 MultiplySse(const Mat4f& m, const float v[4])
+    {
+        __m128 result = _mm_mul_ps(_mm_loadu_ps(m.elements[0]), _mm_set1_ps(v[0]));
+        for (int k = 1; k < 4; ++k)
+        {
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(m.elements[k]), _mm_set1_ps(v[k])));
+        }
+        return result;
+    }
+
+    Mat4f MultiplySse(const Mat4f& left, const Mat4f& right)
+    {
+        Mat4f result;
+        for (int c = 0; c < 4; ++c)
+        {
+            _mm_storeu_ps(result.elements[c], MultiplySse(left, right.elements[c]));
+        }
+        return result;
+    }
+#endif
+
+#if RESHA_TRANSFORM_AVX
+    // a whole double column per register.
+    RESHA_TARGET_AVX Mat4 MultiplyAvx(const Mat4& left, const Mat4& right)
+    {
+        const __m256d columns[4] = { _mm256_loadu_pd(left.elements[0]), _mm256_loadu_pd(left.elements[1]),
+                                     _mm256_loadu_pd(left.elements[2]), _mm256_loadu_pd(left.elements[3]) };
+        Mat4 result;
+        for (int c = 0; c < 4; ++c)
+        {
+            __m256d sum = _mm256_mul_pd(columns[0], _mm256_broadcast_sd(right.elements[c]));
+            for (int k = 1; k < 4; ++k)
+            {
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(columns[k], _mm256_broadcast_sd(right.elements[c] + k)));
+            }
+            _mm256_storeu_pd(result.elements[c], sum);
+        }
+        return result;
+    }
+
+    // two float columns of the result per register, the columns of left are repeated in both
+    // halves and each half of right is broadcast within itself.
+    RESHA_TARGET_AVX Mat4f MultiplyAvx(const Mat4f& left, const Mat4f& right)
+    {
+        __m256 columns[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            const __m128 column = _mm_loadu_ps(left.elements[k]);
+            columns[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(column), column, 1);
+        }
+        Mat4f result;
+        for (int c = 0; c < 4; c += 2)
+        {
+            const __m256 weights = _mm256_loadu_ps(right.elements[c]);
+            __m256 sum = _mm256_mul_ps(columns[0], _mm256_permute_ps(weights, _MM_SHUFFLE(0, 0, 0, 0)));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(columns[1], _mm256_permute_ps(weights, _MM_SHUFFLE(1, 1, 1, 1))));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(columns[2], _mm256_permute_ps(weights, _MM_SHUFFLE(2, 2, 2, 2))));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(columns[3], _mm256_permute_ps(weights, _MM_SHUFFLE(3, 3, 3, 3))));
+            _mm256_storeu_ps(result.elements[c], sum);
+        }
+        return result;
+    }
+#endif
+
+    // the affine part of a column major matrix, p' = columns[0] * x + columns[1] * y + columns[2] * z + columns[3].
+    // the fourth rows are 0 so the columns load in whole registers.
+    template <typename T>
+    struct Affine
+    {
+        T columns[4][4] = {};
+    };
+
+    template <typename T>
+    Affine<T> AffineOf(const Mat4& m)
+    {
+        Affine<T> result;
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 3; ++r)
+            {
+                result.columns[c][r] = T(m.elements[c][r]);
+            }
+        }
+        return result;
+    }
+
+    // the inverse transpose of the upper 3x3 up to a positive factor, the cofactors with the sign
+    // of the determinant, which still maps normals to normals when the matrix is singular.
+    template <typename T>
+    Affine<T> NormalsAffine(const Mat4& m, double& determinant)
+    {
+        const auto& e = m.elements;
+        // a[r][c] is the entry of row r and column c.
+        const double a[3][3] =
+        {
+            { e[0][0], e[1][0], e[2][0] }, { e[0][1], e[1][1], e[2][1] }, { e[0][2], e[1][2], e[2][2] }
+        };
+        double cofactors[3][3];
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const int r0 = (r + 1) % 3, r1 = (r + 2) % 3;
+                const int c0 = (c + 1) % 3, c1 = (c + 2) % 3;
+                cofactors[r][c] = a[r0][c0] * a[r1][c1] - a[r0][c1] * a[r1][c0];
+            }
+        }
+        determinant = a[0][0] * cofactors[0][0] + a[0][1] * cofactors[0][1] + a[0][2] * cofactors[0][2];
+        const double sign = determinant < 0.0 ? -1.0 : 1.0;
+        Affine<T> result;
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                result.columns[c][r] = T(sign * cofactors[r][c]);
+            }
+        }
+        return result;
+    }
+
+    // transforms points[0, count) in place and bounds the results in box.
+    template <typename T>
+    void TransformRangeScalar(Vec<T, 3>* points, size_t count, const Affine<T>& t, bool translate, bool normalise, BBox& box)
+    {
+        const T w = translate ? T(1) : T(0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            T* p = points[i].data;
+            const T x = p[0], y = p[1], z = p[2];
+            T r[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                r[k] = (t.columns[0][k] * x + t.columns[1][k] * y) + (t.columns[2][k] * z + t.columns[3][k] * w);
+            }
+            if (normalise)
+            {
+                const T length = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+                if (length > T(0))
+                {
+                    r[0] /= length;
+                    r[1] /= length;
+                    r[2] /= length;
+                }
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = r[k];
+                box.min.data[k] = std::min(box.min.data[k], double(r[k]));
+                box.max.data[k] = std::max(box.max.data[k], double(r[k]));
+            }
+        }
+    }
+
+#if RESHA_TRANSFORM_SSE2
+    // the x and y rows go through one register, z through a scalar one.
+    void TransformRangeSse2(Vec3d* points, size_t count, const Affine<double>& t, bool translate, bool normalise, BBox& box)
+    {
+        const __m128d c0 = _mm_loadu_pd(t.columns[0]);
+        const __m128d c1 = _mm_loadu_pd(t.columns[1]);
+        const __m128d c2 = _mm_loadu_pd(t.columns[2]);
+        const __m128d c3 = translate ? _mm_loadu_pd(t.columns[3]) : _mm_setzero_pd();
+        const double z0 = t.columns[0][2], z1 = t.columns[1][2], z2 = t.columns[2][2];
+        const double z3 = translate ? t.columns[3][2] : 0.0;
+        __m128d minXY = _mm_loadu_pd(box.min.data);
+        __m128d maxXY = _mm_loadu_pd(box.max.data);
+        double minZ = box.min.z, maxZ = box.max.z;
+        for (size_t i = 0; i < count; ++i)
+        {
+            double* p = points[i].data;
+            const double x = p[0], y = p[1], z = p[2];
+            __m128d xy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, _mm_set1_pd(x)), _mm_mul_pd(c1, _mm_set1_pd(y))),
+                                    _mm_add_pd(_mm_mul_pd(c2, _mm_set1_pd(z)), c3));
+            double rz = (z0 * x + z1 * y) + (z2 * z + z3);
+            if (normalise)
+            {
+                const __m128d squares = _mm_mul_pd(xy, xy);
+                const double length = sqrt(_mm_cvtsd_f64(squares) + _mm_cvtsd_f64(_mm_unpackhi_pd(squares, squares)) + rz * rz);
+                if (length > 0.0)
+                {
+                    xy = _mm_div_pd(xy, _mm_set1_pd(length));
+                    rz /= length;
+                }
+            }
+            _mm_storeu_pd(p, xy);
+            p[2] = rz;
+            minXY = _mm_min_pd(minXY, xy);
+            maxXY = _mm_max_pd(maxXY, xy);
+            minZ = std::min(minZ, rz);
+            maxZ = std::max(maxZ, rz);
+        }
+        _mm_storeu_pd(box.min.data, minXY);
+        _mm_storeu_pd(box.max.data, maxXY);
+        box.min.z = minZ;
+        box.max.z = maxZ;
+    }
+
+    // a whole point per register, the fourth lane stays 0.
+    void TransformRangeSse(Vec3f* points, size_t count, const Affine<float>& t, bool translate, bool normalise, BBox& box)
+    {
+        const __m128 c0 = _mm_loadu_ps(t.columns[0]);
+        const __m128 c1 = _mm_loadu_ps(t.columns[1]);
+        const __m128 c2 = _mm_loadu_ps(t.columns[2]);
+        const __m128 c3 = translate ? _mm_loadu_ps(t.columns[3]) : _mm_setzero_ps();
+        __m128 minimum = _mm_set1_ps(FLT_MAX);
+        __m128 maximum = _mm_set1_ps(-FLT_MAX);
+        for (size_t i = 0; i < count; ++i)
+        {
+            float* p = points[i].data;
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1]))),
+                                  _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p[2])), c3));
+            if (normalise)
+            {
+                float squares[4];
+                _mm_storeu_ps(squares, _mm_mul_ps(r, r));
+                const float length = sqrt(squares[0] + squares[1] + squares[2]);
+                if (length > 0.0f)
+                {
+                    r = _mm_div_ps(r, _mm_set1_ps(length));
+                }
+            }
+            _mm_storel_pi(reinterpret_cast<__m64*>(p), r);
+            _mm_store_ss(p + 2, _mm_movehl_ps(r, r));
+            minimum = _mm_min_ps(minimum, r);
+            maximum = _mm_max_ps(maximum, r);
+        }
+        float low[4], high[4];
+        _mm_storeu_ps(low, minimum);
+        _mm_storeu_ps(high, maximum);
+        for (int k = 0; k < 3; ++k)
+        {
+            box.min.data[k] = std::min(box.min.data[k], double(low[k]));
+            box.max.data[k] = std::max(box.max.data[k], double(high[k]));
+        }
+    }
+#endif
+
+#if RESHA_TRANSFORM_AVX
+    // a whole point per register, the fourth lane stays 0. the sums are in the order of the SSE2 kernel.
+    RESHA_TARGET_AVX void TransformRangeAvx(Vec3d* points, size_t count, const Affine<double>& t, bool translate, bool normalise,
+                                            BBox& box)
+    {
+        const __m256d c0 = _mm256_loadu_pd(t.columns[0]);
+        const __m256d c1 = _mm256_loadu_pd(t.columns[1]);
+        const __m256d c2 = _mm256_loadu_pd(t.columns[2]);
+        const __m256d c3 = translate ? _mm256_loadu_pd(t.columns[3]) : _mm256_setzero_pd();
+        __m256d minimum = _mm256_set1_pd(DBL_MAX);
+        __m256d maximum = _mm256_set1_pd(-DBL_MAX);
+        for (size_t i = 0; i < count; ++i)
+        {
+            double* p = points[i].data;
+            __m256d r = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c0, _mm256_broadcast_sd(p)), _mm256_mul_pd(c1, _mm256_broadcast_sd(p + 1))),
+                                      _mm256_add_pd(_mm256_mul_pd(c2, _mm256_broadcast_sd(p + 2)), c3));
+            if (normalise)
+            {
+                const __m256d squares = _mm256_mul_pd(r, r);
+                const __m128d xy = _mm256_castpd256_pd128(squares);
+                const double length = sqrt(_mm_cvtsd_f64(xy) + _mm_cvtsd_f64(_mm_unpackhi_pd(xy, xy)) +
+                                           _mm_cvtsd_f64(_mm256_extractf128_pd(squares, 1)));
+                if (length > 0.0)
+                {
+                    r = _mm256_div_pd(r, _mm256_set1_pd(length));
+                }
+            }
+            _mm_storeu_pd(p, _mm256_castpd256_pd128(r));
+            _mm_store_sd(p + 2, _mm256_extractf128_pd(r, 1));
+            minimum = _mm256_min_pd(minimum, r);
+            maximum = _mm256_max_pd(maximum, r);
+        }
+        double low[4], high[4];
+        _mm256_storeu_pd(low, minimum);
+        _mm256_storeu_pd(high, maximum);
+        for (int k = 0; k < 3; ++k)
+        {
+            box.min.data[k] = std::min(box.min.data[k], low[k]);
+            box.max.data[k] = std::max(box.max.data[k], high[k]);
+        }
+    }
+#endif
+
+    void TransformRange(Vec3d* points, size_t count, const Affine<double>& t, bool translate, bool normalise, BBox& box)
+    {
+        switch (GetSimdLevel())
+        {
+#if RESHA_TRANSFORM_AVX
+        case SimdLevel::AVX:
+            return TransformRangeAvx(points, count, t, translate, normalise, box);
+#endif
+#if RESHA_TRANSFORM_SSE2
+        case SimdLevel::SSE2:
+            return TransformRangeSse2(points, count, t, translate, normalise, box);
+#endif
+        default:
+            return TransformRangeScalar(points, count, t, translate, normalise, box);
+        }
+    }
+
+    // four floats fill an SSE register, the AVX level runs the same kernel.
+    void TransformRange(Vec3f* points, size_t count, const Affine<float>& t, bool translate, bool normalise, BBox& box)
+    {
+#if RESHA_TRANSFORM_SSE2
+        if (GetSimdLevel() != SimdLevel::SCALAR)
+        {
+            return TransformRangeSse(points, count, t, translate, normalise, box);
+        }
+#endif
+        TransformRangeScalar(points, count, t, translate, normalise, box);
+    }
+
+    template <typename T>
+    BBox TransformAll(std::vector<Vec<T, 3>>& points, const Affine<T>& t, bool translate, bool normalise)
+    {
+        std::vector<BBox> boxes((points.size() + GRAIN_SIZE - 1) / GRAIN_SIZE);
+        ParallelFor(points.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            TransformRange(points.data() + begin, end - begin, t, translate, normalise, boxes[begin / GRAIN_SIZE]);
+        });
+        BBox result;
+        for (const BBox& box : boxes)
+        {
+            result = Merge(result, box);
+        }
+        return result;
+    }
+}
+
+SimdLevel GetSimdLevel()
+{
+    return CurrentSimdLevel().load(std::memory_order_relaxed);
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+    CurrentSimdLevel().store(std::min(level, DetectSimdLevel()), std::memory_order_relaxed);
+}
+
+Mat4 operator*(const Mat4& left, const Mat4& right)
+{
+    switch (GetSimdLevel())
+    {
+#if RESHA_TRANSFORM_AVX
+    case SimdLevel::AVX:
+        return MultiplyAvx(left, right);
+#endif
+#if RESHA_TRANSFORM_SSE2
+    case SimdLevel::SSE2:
+        return MultiplySse2(left, right);
+#endif
+    default:
+        return MultiplyScalar(left, right);
+    }
+}
+
+Mat4f operator*(const Mat4f& left, const Mat4f& right)
+{
+    switch (GetSimdLevel())
+    {
+#if RESHA_TRANSFORM_AVX
+    case SimdLevel::AVX:
+        return MultiplyAvx(left, right);
+#endif
+#if RESHA_TRANSFORM_SSE2
+    case SimdLevel::SSE2:
+        return MultiplySse(left, right);
+#endif
+    default:
+        return MultiplyScalar(left, right);
+    }
+}
+
+template <typename Vec>
+BBox TransformPoints(std::vector<Vec>& points, const Mat4& m)
+{
+    using T = decltype(Vec::x);
+    return TransformAll(points, AffineOf<T>(m), true, false);
+}
+
+template <typename Vec>
+void TransformNormals(std::vector<Vec>& normals, const Mat4& m)
+{
+    using T = decltype(Vec::x);
+    double determinant = 0.0;
+    TransformAll(normals, NormalsAffine<T>(m, determinant), false, true);
+}
+
+template <typename Vec>
+BBox TransformMesh(BasicSurfaceMesh<Vec>& mesh, const Mat4& m)
+{
+    double determinant = 0.0;
+    NormalsAffine<double>(m, determinant);
+    if (determinant < 0.0)
+    {
+        ParallelFor(mesh.faces.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t f = begin; f < end; ++f)
+            {
+                std::swap(mesh.faces[f].idx[1], mesh.faces[f].idx[2]);
+            }
+        });
+    }
+    return TransformPoints(mesh.vertices, m);
+}
+
+template BBox TransformPoints(std::vector<Vec3d>& points, const Mat4& m);
+template BBox TransformPoints(std::vector<Vec3f>& points, const Mat4& m);
+template void TransformNormals(std::vector<Vec3d>& normals, const Mat4& m);
+template void TransformNormals(std::vector<Vec3f>& normals, const Mat4& m);
+template BBox TransformMesh(SurfaceMesh& mesh, const Mat4& m);
+template BBox TransformMesh(SurfaceMeshF& mesh, const Mat4& m);
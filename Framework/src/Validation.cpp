@@ -0,0 +1,213 @@
+#include "Resha.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 64 * 1024;
+    // a face is degenerate when its area is below this fraction of its longest edge squared.
+    constexpr double DEGENERATE_EPSILON = 1e-12;
+
+    bool HasRepeatedVertex(const Triangle& t)
+    {
+        return t.idx[0] == t.idx[1] || t.idx[1] == t.idx[2] || t.idx[0] == t.idx[2];
+    }
+
+    uint32_t HalfEdgeFace(uint64_t entry)
+    {
+        return uint32_t(entry) / 3;
+    }
+
+    template <typename Vec>
+    uint32_t HalfEdgeStart(const BasicSurfaceMesh<Vec>& mesh, uint64_t entry)
+    {
+        return mesh.faces[uint32_t(entry) / 3].idx[uint32_t(entry) % 3];
+    }
+
+    // the vertex of a face that isn't on the given edge.
+    uint32_t OppositeVertex(const Triangle& t, const MeshEdge& e)
+    {
+        for (uint32_t v : t.idx)
+        {
+            if (v != e.a && v != e.b)
+            {
+                return v;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    // every face has exactly one edge made of its two smallest vertices, duplicated faces share it.
+    bool IsSmallestEdge(const Triangle& t, const MeshEdge& e)
+    {
+        return OppositeVertex(t, e) == std::max({ t.idx[0], t.idx[1], t.idx[2] });
+    }
+
+    template <typename T>
+    void Append(std::vector<T>& result, const std::vector<std::vector<T>>& chunks)
+    {
+        for (const std::vector<T>& chunk : chunks)
+        {
+            result.insert(result.end(), chunk.begin(), chunk.end());
+        }
+    }
+}
+
+template <typename Vec>
+MeshValidation ValidateMesh(const BasicSurfaceMesh<Vec>& mesh)
+{
+    MeshValidation result;
+    const size_t facesCount = mesh.faces.size();
+    const size_t chunksCount = (facesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+
+    // faces with a repeated vertex are only degenerate, their edges are left out.
+    std::vector<std::vector<uint32_t>> degenerateFaces(chunksCount);
+    std::vector<double> volumes(chunksCount, 0.0);
+    std::vector<std::atomic<uint32_t>> bucketSizes(mesh.vertices.size() + 1);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        const size_t chunk = begin / GRAIN_SIZE;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            const bool hasRepeatedVertex = HasRepeatedVertex(t);
+            if (!hasRepeatedVertex)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    bucketSizes[std::min(t.idx[e], t.idx[(e + 1) % 3]) + 1].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            const Vec3d a = privWiden(mesh.vertices[t.idx[0]]);
+            const Vec3d b = privWiden(mesh.vertices[t.idx[1]]);
+            const Vec3d c = privWiden(mesh.vertices[t.idx[2]]);
+            const Vec3d n = CrossProduct(b - a, c - a);
+            const double longestEdgeSquared = std::max({ DotProduct(b - a, b - a), DotProduct(c - b, c - b), DotProduct(a - c, a - c) });
+            if (hasRepeatedVertex || Length(n) <= DEGENERATE_EPSILON * longestEdgeSquared)
+            {
+                degenerateFaces[chunk].push_back(uint32_t(i));
+            }
+            volumes[chunk] += DotProduct(a, n);
+        }
+    });
+    Append(result.degenerateFaces, degenerateFaces);
+    double volume = 0.0;
+    for (double v : volumes)
+    {
+        volume += v;
+    }
+
+    // the half-edges are bucketed by their smallest vertex, every entry holds the other vertex
+    // in the high bits and the half-edge in the low bits.
+    const size_t verticesCount = mesh.vertices.size();
+    std::vector<size_t> offsets(verticesCount + 1, 0);
+    for (size_t v = 0; v < verticesCount; ++v)
+    {
+        offsets[v + 1] = offsets[v] + bucketSizes[v + 1].load(std::memory_order_relaxed);
+        bucketSizes[v + 1].store(0, std::memory_order_relaxed);
+    }
+    std::vector<uint64_t> halfEdges(offsets[verticesCount]);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Triangle& t = mesh.faces[i];
+            if (HasRepeatedVertex(t))
+            {
+                continue;
+            }
+            for (int e = 0; e < 3; ++e)
+            {
+                const uint32_t a = std::min(t.idx[e], t.idx[(e + 1) % 3]);
+                const uint32_t b = std::max(t.idx[e], t.idx[(e + 1) % 3]);
+                const size_t slot = offsets[a] + bucketSizes[a + 1].fetch_add(1, std::memory_order_relaxed);
+                halfEdges[slot] = uint64_t(b) << 32 | (i * 3 + e);
+            }
+        }
+    });
+    bucketSizes = std::vector<std::atomic<uint32_t>>();
+
+    // every chunk of vertices sweeps the edges of its buckets, sorting a bucket puts the
+    // half-edges of an edge next to each other in face order whatever the threads did.
+    const size_t vertexChunksCount = (verticesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<std::vector<MeshEdge>> boundaryEdges(vertexChunksCount);
+    std::vector<std::vector<MeshEdge>> nonManifoldEdges(vertexChunksCount);
+    std::vector<std::vector<MeshEdge>> misorientedEdges(vertexChunksCount);
+    std::vector<std::vector<uint32_t>> duplicateFaces(vertexChunksCount);
+    ParallelFor(verticesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        const size_t chunk = begin / GRAIN_SIZE;
+        for (size_t v = begin; v < end; ++v)
+        {
+            const auto first = halfEdges.begin() + offsets[v];
+            const auto last = halfEdges.begin() + offsets[v + 1];
+            std::sort(first, last);
+            for (size_t i = offsets[v]; i < offsets[v + 1];)
+            {
+                const uint32_t other = uint32_t(halfEdges[i] >> 32);
+                size_t runEnd = i + 1;
+                while (runEnd < offsets[v + 1] && uint32_t(halfEdges[runEnd] >> 32) == other)
+                {
+                    runEnd++;
+                }
+                const MeshEdge edge{ uint32_t(v), other };
+                const size_t count = runEnd - i;
+                if (count == 1)
+                {
+                    boundaryEdges[chunk].push_back(edge);
+                }
+                else if (count > 2)
+                {
+                    nonManifoldEdges[chunk].push_back(edge);
+                }
+                else if (HalfEdgeStart(mesh, halfEdges[i]) == HalfEdgeStart(mesh, halfEdges[i + 1]))
+                {
+                    // a consistently oriented pair of faces walks a shared edge in opposite directions.
+                    misorientedEdges[chunk].push_back(edge);
+                }
+                for (size_t j = i + 1; j < runEnd; ++j)
+                {
+                    const Triangle& t = mesh.faces[HalfEdgeFace(halfEdges[j])];
+                    if (!IsSmallestEdge(t, edge))
+                    {
+                        continue;
+                    }
+                    const uint32_t opposite = OppositeVertex(t, edge);
+                    for (size_t k = i; k < j; ++k)
+                    {
+                        const Triangle& previous = mesh.faces[HalfEdgeFace(halfEdges[k])];
+                        if (IsSmallestEdge(previous, edge) && OppositeVertex(previous, edge) == opposite)
+                        {
+                            duplicateFaces[chunk].push_back(HalfEdgeFace(halfEdges[j]));
+                            break;
+                        }
+                    }
+                }
+                i = runEnd;
+            }
+        }
+    });
+    Append(result.boundaryEdges, boundaryEdges);
+    Append(result.nonManifoldEdges, nonManifoldEdges);
+    Append(result.misorientedEdges, misorientedEdges);
+    Append(result.duplicateFaces, duplicateFaces);
+    std::sort(result.duplicateFaces.begin(), result.duplicateFaces.end());
+
+    result.insideOut = IsWatertight(result) && result.misorientedEdges.empty() && volume < 0.0;
+    return result;
+}
+
+template MeshValidation ValidateMesh(const SurfaceMesh& mesh);
+template MeshValidation ValidateMesh(const SurfaceMeshF& mesh);
+
+bool IsWatertight(const MeshValidation& validation)
+{
+    return validation.boundaryEdges.empty() && validation.nonManifoldEdges.empty();
+}
+
+bool IsValid(const MeshValidation& validation)
+{
+    return IsWatertight(validation) && validation.misorientedEdges.empty() && validation.degenerateFaces.empty() &&
+           validation.duplicateFaces.empty() && !validation.insideOut;
+}
@@ -0,0 +1,500 @@
+#include "Resha.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+    constexpr size_t GRAIN_SIZE = 4 * 1024;
+    constexpr size_t ROWS_GRAIN_SIZE = 16;
+    constexpr uint32_t BLOCK_SIZE = 8;
+
+    struct Crossing
+    {
+        uint64_t row; // block row * 64 + position of the row in its block.
+        double x;
+    };
+
+    uint32_t BlocksCount(uint32_t voxelsCount)
+    {
+        return (voxelsCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    uint64_t BlockKey(const VoxelGrid& grid, uint32_t bx, uint32_t by, uint32_t bz)
+    {
+        return (uint64_t(bz) * BlocksCount(grid.dimensions[1]) + by) * BlocksCount(grid.dimensions[0]) + bx;
+    }
+
+    // index of the block in grid.blocks, SIZE_MAX when it isn't stored.
+    size_t FindBlock(const VoxelGrid& grid, uint64_t key)
+    {
+        const auto it = std::lower_bound(grid.blockKeys.begin(), grid.blockKeys.end(), key);
+        return it != grid.blockKeys.end() && *it == key ? size_t(it - grid.blockKeys.begin()) : SIZE_MAX;
+    }
+
+    size_t CountBits(uint64_t x)
+    {
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return size_t((x * 0x0101010101010101ull) >> 56);
+    }
+
+    // face in voxel units, voxel (i, j, k) spans [i, i + 1] x [j, j + 1] x [k, k + 1].
+    template <typename Vec>
+    void FaceInVoxels(const VoxelGrid& grid, const BasicSurfaceMesh<Vec>& mesh, const Triangle& t, Vec3d v[3])
+    {
+        const double scale = 1.0 / grid.voxelSize;
+        for (int i = 0; i < 3; ++i)
+        {
+            const Vec3d p = privWiden(mesh.vertices[t.idx[i]]);
+            v[i] = Vec3d{ (p.x - grid.origin.x) * scale, (p.y - grid.origin.y) * scale, (p.z - grid.origin.z) * scale };
+        }
+    }
+
+    // clamps the voxels [first, last] along an axis to the grid, false when none is left.
+    bool ClampRange(double first, double last, uint32_t voxelsCount, uint32_t& clampedFirst, uint32_t& clampedLast)
+    {
+        if (last < 0.0 || first >= double(voxelsCount) || first > last)
+        {
+            return false;
+        }
+        clampedFirst = uint32_t(std::max(first, 0.0));
+        clampedLast = uint32_t(std::min(last, double(voxelsCount - 1)));
+        return true;
+    }
+
+    // calls func(i, j, k) for every voxel the face overlaps, with the plane and projections tests of
+    // Schwarz and Seidel (Fast Parallel Surface and Solid Voxelization on GPUs, 2010). the voxels
+    // are walked along the dominant axis of the normal from every column the face covers, so the
+    // cost follows the area of the face rather than its box.
+    template <typename F>
+    void ForEachSurfaceVoxel(const Vec3d v[3], const uint32_t dimensions[3], F func)
+    {
+        uint32_t first[3], last[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double min = std::min(v[0].data[axis], std::min(v[1].data[axis], v[2].data[axis]));
+            const double max = std::max(v[0].data[axis], std::max(v[1].data[axis], v[2].data[axis]));
+            // the voxels whose closed box touches [min, max].
+            if (!ClampRange(ceil(min) - 1.0, floor(max), dimensions[axis], first[axis], last[axis]))
+            {
+                return;
+            }
+        }
+        // most faces of a fine mesh are inside a single voxel.
+        if (first[0] == last[0] && first[1] == last[1] && first[2] == last[2])
+        {
+            func(first[0], first[1], first[2]);
+            return;
+        }
+
+        // written per coordinate, the setup is most of the work for small faces.
+        double e[3][3];
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                e[i][axis] = v[(i + 1) % 3].data[axis] - v[i].data[axis];
+            }
+        }
+        const double n[3] =
+        {
+            e[0][1] * e[1][2] - e[0][2] * e[1][1],
+            e[0][2] * e[1][0] - e[0][0] * e[1][2],
+            e[0][0] * e[1][1] - e[0][1] * e[1][0]
+        };
+        if (n[0] == 0.0 && n[1] == 0.0 && n[2] == 0.0)
+        {
+            return;
+        }
+        // the voxel at p overlaps the plane when its critical corners are on both sides.
+        double d1 = 0.0, d2 = 0.0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double critical = n[axis] > 0.0 ? 1.0 : 0.0;
+            d1 += n[axis] * (critical - v[0].data[axis]);
+            d2 += n[axis] * (1.0 - critical - v[0].data[axis]);
+        }
+        // projection along axis a on the coordinates ((a + 1) % 3, (a + 2) % 3), the voxel at p is
+        // inside when every edge function is positive.
+        double edgeNormals[3][3][2];
+        double edgeOffsets[3][3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const int u = (axis + 1) % 3;
+            const int w = (axis + 2) % 3;
+            const double sign = n[axis] >= 0.0 ? 1.0 : -1.0;
+            for (int i = 0; i < 3; ++i)
+            {
+                const double nu = -e[i][w] * sign;
+                const double nw = e[i][u] * sign;
+                edgeNormals[axis][i][0] = nu;
+                edgeNormals[axis][i][1] = nw;
+                edgeOffsets[axis][i] = -(nu * v[i].data[u] + nw * v[i].data[w]) + std::max(0.0, nu) + std::max(0.0, nw);
+            }
+        }
+        auto isInProjection = [&](int axis, double pu, double pw)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                if (edgeNormals[axis][i][0] * pu + edgeNormals[axis][i][1] * pw + edgeOffsets[axis][i] < 0.0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        const int d = fabs(n[0]) >= fabs(n[1]) && fabs(n[0]) >= fabs(n[2]) ? 0 : (fabs(n[1]) >= fabs(n[2]) ? 1 : 2);
+        const int u = (d + 1) % 3;
+        const int w = (d + 2) % 3;
+        const double low = std::min(-d1, -d2);
+        const double high = std::max(-d1, -d2);
+        uint32_t p[3];
+        for (p[u] = first[u]; p[u] <= last[u]; ++p[u])
+        {
+            for (p[w] = first[w]; p[w] <= last[w]; ++p[w])
+            {
+                if (!isInProjection(d, p[u], p[w]))
+                {
+                    continue;
+                }
+                // the plane overlaps the voxels of the column whose d coordinate is in [from, to].
+                const double rest = n[u] * p[u] + n[w] * p[w];
+                double from = (low - rest) / n[d];
+                double to = (high - rest) / n[d];
+                if (from > to)
+                {
+                    std::swap(from, to);
+                }
+                const double begin = std::max(ceil(from), double(first[d]));
+                const double end = std::min(floor(to), double(last[d]));
+                for (double pd = begin; pd <= end; pd += 1.0)
+                {
+                    p[d] = uint32_t(pd);
+                    if (isInProjection(u, p[w], p[d]) && isInProjection(w, p[d], p[u]))
+                    {
+                        func(p[0], p[1], p[2]);
+                    }
+                }
+            }
+        }
+    }
+
+    // appends the crossings of the face with the lines along x through the voxel centres. a centre
+    // on an edge belongs to a single one of the faces sharing it, as if the centres were moved by
+    // an infinitesimal (0, e, e^2) offset, so closed meshes always cross the lines an even number
+    // of times.
+    void AppendCrossings(const VoxelGrid& grid, const Vec3d v[3], std::vector<Crossing>& crossings)
+    {
+        uint32_t first[3], last[3];
+        for (int axis = 1; axis < 3; ++axis)
+        {
+            // the voxels whose centre j + 0.5 is in [min, max].
+            const double min = std::min(v[0].data[axis], std::min(v[1].data[axis], v[2].data[axis]));
+            const double max = std::max(v[0].data[axis], std::max(v[1].data[axis], v[2].data[axis]));
+            if (!ClampRange(ceil(min - 0.5), floor(max - 0.5), grid.dimensions[axis], first[axis], last[axis]))
+            {
+                return;
+            }
+        }
+        // the normal, x is also twice the signed area of the face seen along x.
+        const double ax = v[1].x - v[0].x, ay = v[1].y - v[0].y, az = v[1].z - v[0].z;
+        const double bx = v[2].x - v[0].x, by = v[2].y - v[0].y, bz = v[2].z - v[0].z;
+        const Vec3d n{ ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx };
+        if (n.x == 0.0)
+        {
+            return;
+        }
+        // the edges as seen counter clockwise in the (y, z) plane.
+        const double orientation = n.x > 0.0 ? 1.0 : -1.0;
+        bool inclusive[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            const double dy = (v[(i + 1) % 3].y - v[i].y) * orientation;
+            const double dz = (v[(i + 1) % 3].z - v[i].z) * orientation;
+            inclusive[i] = dy > 0.0 || (dy == 0.0 && dz > 0.0);
+        }
+        const uint32_t blocksY = BlocksCount(grid.dimensions[1]);
+        for (uint32_t k = first[2]; k <= last[2]; ++k)
+        {
+            const double z = k + 0.5;
+            for (uint32_t j = first[1]; j <= last[1]; ++j)
+            {
+                const double y = j + 0.5;
+                bool inside = true;
+                for (int i = 0; i < 3 && inside; ++i)
+                {
+                    const Vec3d& a = v[i];
+                    const Vec3d& b = v[(i + 1) % 3];
+                    const double edge = ((b.y - a.y) * (z - a.z) - (b.z - a.z) * (y - a.y)) * orientation;
+                    inside = edge > 0.0 || (edge == 0.0 && inclusive[i]);
+                }
+                if (inside)
+                {
+                    const uint64_t blockRow = uint64_t(k / BLOCK_SIZE) * blocksY + j / BLOCK_SIZE;
+                    const uint64_t row = blockRow * BLOCK_SIZE * BLOCK_SIZE + (k % BLOCK_SIZE) * BLOCK_SIZE + j % BLOCK_SIZE;
+                    const double x = v[0].x - (n.y * (y - v[0].y) + n.z * (z - v[0].z)) / n.x;
+                    crossings.push_back(Crossing{ row, x });
+                }
+            }
+        }
+    }
+
+    // the crossings sorted by row, grouped by block row so that the rows of a group only touch
+    // the blocks of that row.
+    struct SortedCrossings
+    {
+        std::vector<uint64_t> rows;
+        std::vector<double> xs;
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> groupStarts; // and the crossings count at the end.
+    };
+
+    // calls func(j, k, begin, end) for every run of voxels [begin, end) of a row in the group
+    // between a crossing and the next one.
+    template <typename F>
+    void ForEachInteriorSpan(const VoxelGrid& grid, const SortedCrossings& crossings, size_t group,
+                             std::vector<double>& xs, F func)
+    {
+        const uint32_t blocksY = BlocksCount(grid.dimensions[1]);
+        for (uint32_t i = crossings.groupStarts[group]; i < crossings.groupStarts[group + 1];)
+        {
+            const uint64_t row = crossings.rows[crossings.order[i]];
+            xs.clear();
+            for (; i < crossings.groupStarts[group + 1] && crossings.rows[crossings.order[i]] == row; ++i)
+            {
+                xs.push_back(crossings.xs[crossings.order[i]]);
+            }
+            std::sort(xs.begin(), xs.end());
+            const uint64_t blockRow = row / (BLOCK_SIZE * BLOCK_SIZE);
+            const uint32_t j = uint32_t(blockRow % blocksY) * BLOCK_SIZE + uint32_t(row % BLOCK_SIZE);
+            const uint32_t k = uint32_t(blockRow / blocksY) * BLOCK_SIZE + uint32_t(row / BLOCK_SIZE % BLOCK_SIZE);
+            // an open mesh can leave an odd crossing, it is ignored.
+            for (size_t c = 0; c + 1 < xs.size(); c += 2)
+            {
+                // the voxels whose centre i + 0.5 is in [xs[c], xs[c + 1]).
+                const double begin = std::max(ceil(xs[c] - 0.5), 0.0);
+                const double end = std::min(ceil(xs[c + 1] - 0.5), double(grid.dimensions[0]));
+                if (begin < end)
+                {
+                    func(j, k, uint32_t(begin), uint32_t(end));
+                }
+            }
+        }
+    }
+}
+
+template <typename Vec>
+VoxelGrid VoxeliseMesh(const BasicSurfaceMesh<Vec>& mesh, uint32_t resolution)
+{
+    VoxelGrid grid;
+    const BBox box = CalculateBoundingBox(mesh);
+    if (!IsBBoxValid(box) || mesh.faces.empty() || resolution == 0)
+    {
+        return grid;
+    }
+    const Vec3d size = box.max - box.min;
+    const double extent = std::max(size.x, std::max(size.y, size.z));
+    if (extent <= 0.0)
+    {
+        return grid;
+    }
+    grid.voxelSize = extent / resolution;
+    grid.origin = box.min - Vec3d{ grid.voxelSize, grid.voxelSize, grid.voxelSize };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        grid.dimensions[axis] = uint32_t(ceil(size.data[axis] / grid.voxelSize)) + 2;
+    }
+
+    // first pass over the faces: the blocks they touch and their crossings with the voxel rows.
+    const size_t facesCount = mesh.faces.size();
+    const size_t chunksCount = (facesCount + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    std::vector<std::vector<uint64_t>> chunkBlocks(chunksCount);
+    std::vector<std::vector<Crossing>> chunkCrossings(chunksCount);
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<uint64_t>& blocks = chunkBlocks[begin / GRAIN_SIZE];
+        std::vector<Crossing>& crossings = chunkCrossings[begin / GRAIN_SIZE];
+        Vec3d v[3];
+        for (size_t i = begin; i < end; ++i)
+        {
+            FaceInVoxels(grid, mesh, mesh.faces[i], v);
+            ForEachSurfaceVoxel(v, grid.dimensions, [&](uint32_t x, uint32_t y, uint32_t z)
+            {
+                const uint64_t key = BlockKey(grid, x / BLOCK_SIZE, y / BLOCK_SIZE, z / BLOCK_SIZE);
+                if (blocks.empty() || blocks.back() != key)
+                {
+                    blocks.push_back(key);
+                }
+            });
+            AppendCrossings(grid, v, crossings);
+        }
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    });
+
+    SortedCrossings crossings;
+    for (const std::vector<Crossing>& chunk : chunkCrossings)
+    {
+        for (const Crossing& crossing : chunk)
+        {
+            crossings.rows.push_back(crossing.row);
+            crossings.xs.push_back(crossing.x);
+        }
+    }
+    chunkCrossings = std::vector<std::vector<Crossing>>();
+    RadixSortIndices(crossings.rows, crossings.order);
+    for (uint32_t i = 0; i < crossings.order.size(); ++i)
+    {
+        const uint64_t blockRow = crossings.rows[crossings.order[i]] / (BLOCK_SIZE * BLOCK_SIZE);
+        if (i == 0 || blockRow != crossings.rows[crossings.order[i - 1]] / (BLOCK_SIZE * BLOCK_SIZE))
+        {
+            crossings.groupStarts.push_back(i);
+        }
+    }
+    const size_t groupsCount = crossings.groupStarts.size();
+    crossings.groupStarts.push_back(uint32_t(crossings.order.size()));
+
+    // the blocks inside, then all of them in key order. the spans of a block row are accumulated
+    // as +1 / -1 at their ends so the blocks they cover are found in one sweep.
+    const uint32_t blocksX = BlocksCount(grid.dimensions[0]);
+    std::vector<std::vector<uint64_t>> groupBlocks(groupsCount);
+    ParallelFor(groupsCount, ROWS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        std::vector<double> xs;
+        std::vector<int32_t> changes(blocksX + 1, 0);
+        for (size_t g = begin; g < end; ++g)
+        {
+            uint32_t by = 0, bz = 0;
+            ForEachInteriorSpan(grid, crossings, g, xs, [&](uint32_t j, uint32_t k, uint32_t first, uint32_t last)
+            {
+                by = j / BLOCK_SIZE;
+                bz = k / BLOCK_SIZE;
+                changes[first / BLOCK_SIZE]++;
+                changes[(last - 1) / BLOCK_SIZE + 1]--;
+            });
+            int32_t spans = 0;
+            for (uint32_t bx = 0; bx < blocksX; ++bx)
+            {
+                spans += changes[bx];
+                changes[bx] = 0;
+                if (spans > 0)
+                {
+                    groupBlocks[g].push_back(BlockKey(grid, bx, by, bz));
+                }
+            }
+            changes[blocksX] = 0;
+        }
+    });
+    for (const std::vector<uint64_t>& blocks : chunkBlocks)
+    {
+        grid.blockKeys.insert(grid.blockKeys.end(), blocks.begin(), blocks.end());
+    }
+    for (const std::vector<uint64_t>& blocks : groupBlocks)
+    {
+        grid.blockKeys.insert(grid.blockKeys.end(), blocks.begin(), blocks.end());
+    }
+    chunkBlocks = std::vector<std::vector<uint64_t>>();
+    groupBlocks = std::vector<std::vector<uint64_t>>();
+    std::sort(grid.blockKeys.begin(), grid.blockKeys.end());
+    grid.blockKeys.erase(std::unique(grid.blockKeys.begin(), grid.blockKeys.end()), grid.blockKeys.end());
+
+    // second pass: the voxels, faces sharing a block set its bits concurrently while a block row
+    // belongs to a single thread when filling the inside.
+    std::vector<std::atomic<uint64_t>> bits(grid.blockKeys.size() * BLOCK_SIZE);
+    auto findWord = [&](uint32_t bx, uint32_t y, uint32_t z, uint64_t& lastKey, size_t& lastBlock)
+    {
+        const uint64_t key = BlockKey(grid, bx, y / BLOCK_SIZE, z / BLOCK_SIZE);
+        if (key != lastKey)
+        {
+            // the spans walk the blocks of a row in order.
+            const bool isNext = key == lastKey + 1 && lastBlock + 1 < grid.blockKeys.size() &&
+                                grid.blockKeys[lastBlock + 1] == key;
+            lastBlock = isNext ? lastBlock + 1 : FindBlock(grid, key);
+            lastKey = key;
+        }
+        return lastBlock * BLOCK_SIZE + z % BLOCK_SIZE;
+    };
+    ParallelFor(facesCount, GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint64_t lastKey = UINT64_MAX;
+        size_t lastBlock = 0;
+        Vec3d v[3];
+        for (size_t i = begin; i < end; ++i)
+        {
+            FaceInVoxels(grid, mesh, mesh.faces[i], v);
+            ForEachSurfaceVoxel(v, grid.dimensions, [&](uint32_t x, uint32_t y, uint32_t z)
+            {
+                const uint64_t mask = uint64_t(1) << (x % BLOCK_SIZE + y % BLOCK_SIZE * BLOCK_SIZE);
+                bits[findWord(x / BLOCK_SIZE, y, z, lastKey, lastBlock)].fetch_or(mask, std::memory_order_relaxed);
+            });
+        }
+    });
+    ParallelFor(groupsCount, ROWS_GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        uint64_t lastKey = UINT64_MAX;
+        size_t lastBlock = 0;
+        std::vector<double> xs;
+        for (size_t g = begin; g < end; ++g)
+        {
+            ForEachInteriorSpan(grid, crossings, g, xs, [&](uint32_t j, uint32_t k, uint32_t first, uint32_t last)
+            {
+                for (uint32_t bx = first / BLOCK_SIZE; bx <= (last - 1) / BLOCK_SIZE; ++bx)
+                {
+                    // the voxels of [first, last) in this block.
+                    const uint32_t from = std::max(first, bx * BLOCK_SIZE) - bx * BLOCK_SIZE;
+                    const uint32_t to = std::min(last, (bx + 1) * BLOCK_SIZE) - bx * BLOCK_SIZE;
+                    const uint64_t mask = (((uint64_t(1) << to) - 1) & ~((uint64_t(1) << from) - 1)) << (j % BLOCK_SIZE * BLOCK_SIZE);
+                    std::atomic<uint64_t>& word = bits[findWord(bx, j, k, lastKey, lastBlock)];
+                    word.store(word.load(std::memory_order_relaxed) | mask, std::memory_order_relaxed);
+                }
+            });
+        }
+    });
+    grid.blocks.resize(grid.blockKeys.size());
+    ParallelFor(grid.blocks.size(), GRAIN_SIZE, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t b = begin; b < end; ++b)
+        {
+            for (uint32_t z = 0; z < BLOCK_SIZE; ++z)
+            {
+                grid.blocks[b].bits[z] = bits[b * BLOCK_SIZE + z].load(std::memory_order_relaxed);
+            }
+        }
+    });
+    return grid;
+}
+
+template VoxelGrid VoxeliseMesh(const SurfaceMesh& mesh, uint32_t resolution);
+template VoxelGrid VoxeliseMesh(const SurfaceMeshF& mesh, uint32_t resolution);
+
+bool IsVoxelSet(const VoxelGrid& grid, uint32_t x, uint32_t y, uint32_t z)
+{
+    if (x >= grid.dimensions[0] || y >= grid.dimensions[1] || z >= grid.dimensions[2])
+    {
+        return false;
+    }
+    const size_t block = FindBlock(grid, BlockKey(grid, x / BLOCK_SIZE, y / BLOCK_SIZE, z / BLOCK_SIZE));
+    if (block == SIZE_MAX)
+    {
+        return false;
+    }
+    return (grid.blocks[block].bits[z % BLOCK_SIZE] >> (x % BLOCK_SIZE + y % BLOCK_SIZE * BLOCK_SIZE)) & 1;
+}
+
+size_t CountSetVoxels(const VoxelGrid& grid)
+{
+    size_t count = 0;
+    for (const VoxelBlock& block : grid.blocks)
+    {
+        for (uint64_t bits : block.bits)
+        {
+            count += CountBits(bits);
+        }
+    }
+    return count;
+}
@@ -3,6 +3,10 @@
 #include "Resha.h"
 #include <imgui.h>
 
+#include <future>
+#include <memory>
+#include <optional>
+
 namespace Resha
 {
     struct View3DState
@@ -14,23 +18,93 @@ namespace Resha
         RenderBuffer buffer = CreateRenderBuffer(width, height);
         Color backgroundColor = Color{ 125, 125, 125, 255 };
         Program program;
+        Program linesProgram;
         bool redraw = true;
         Camera camera;
         std::vector<MeshRenderInfo> surfacesRenderInfo;
+        // simplified levels being generated in the background, uploaded when ready. there is at most
+        // one job per surface, a newer version of it waits in next for the cancelled job to stop.
+        struct PendingLods
+        {
+            UUId id;
+            std::shared_ptr<std::atomic<bool>> cancel = std::make_shared<std::atomic<bool>>(false);
+            std::future<std::vector<MeshLod>> lods;
+            std::optional<SurfaceMeshF> next;
+        };
+        std::vector<PendingLods> pendingLods;
+        // largest error (in pixels) a simplified level can show on screen.
+        double lodPixelError = 1.0;
+        std::vector<LinesRenderInfo> contoursRenderInfo;
+        Color contoursColor = Color{ 255, 200, 0, 255 };
+        std::vector<LinesRenderInfo> interferencesRenderInfo;
+        Color interferencesColor = Color{ 255, 0, 0, 255 };
+        // ctrl + click in the view, the pixel is measured from the top left corner of the view.
+        bool pickRequested = false;
+        Vec2d pickPixel = { 0 };
+    };
+
+    // picking BVH and heat method operators of a surface. the operators are prepared in the background
+    // with the distances to its first seed, the seeds added meanwhile are measured once the job is done.
+    struct GeodesicsCache
+    {
+        struct Distances
+        {
+            std::shared_ptr<const HeatGeodesics> heat;
+            std::vector<uint32_t> seeds; // the seeds the distances are measured from.
+            std::vector<double> values;
+        };
+        UUId id;
+        std::shared_ptr<const HeatGeodesics> heat;
+        MeshBVH bvh;
+        std::vector<uint32_t> seeds;
+        std::future<Distances> distances;
+    };
+
+    // solid voxelisation of a surface, kept to show its volume.
+    struct VoxelsCache
+    {
+        UUId id;
+        std::string name;
+        VoxelGrid grid;
+        size_t voxelsCount = 0;
     };
 
     struct State
     {
-        std::vector<SurfaceMesh> meshes;
+        // held in float like the STL files and the GPU buffers, the read-only routines take them as they
+        // are and only the ones that move or create positions get a widened copy.
+        std::vector<SurfaceMeshF> meshes;
+        std::vector<MeshValidation> validations; // defects of meshes[i], found when it was added.
+        std::vector<MassProperties> massProperties; // of meshes[i], cached like the validations.
         View3DState view3d;
+        int sliceLayersCount = 100;
+        std::vector<MeshesInterference> interferences;
+        int minComponentFacesCount = 100;
+        int scalarField = 0; // index in SCALAR_FIELDS of the field the surfaces are coloured by.
+        std::vector<GeodesicsCache> geodesics;
+        // jobs of the caches that were dropped, they can't be stopped and are thrown away once done.
+        std::vector<std::future<GeodesicsCache::Distances>> droppedGeodesics;
+        int smoothingMethod = 0; // index in SMOOTHING_METHODS.
+        int smoothingIterations = 10;
+        int subdivisionScheme = 0; // index in SUBDIVISION_SCHEMES.
+        int subdivisionLevels = 1;
+        int voxelResolution = 128; // voxels along the longest side of a surface box.
+        std::vector<VoxelsCache> voxels;
+        // applied to the visible surfaces, scaled then rotated in degrees around the axis then moved.
+        float transformScale = 1.0f;
+        float transformAxis[3] = { 0.0f, 0.0f, 1.0f };
+        float transformAngle = 0.0f;
+        float transformTranslation[3] = {};
     };
 
     View3DState CreateView3D();
     void FitView3D(View3DState& view);
-    void RenderView3D(ImVec2 area, const std::vector<SurfaceMesh>& meshes, View3DState& view);
+    void RenderView3D(ImVec2 area, const std::vector<SurfaceMeshF>& meshes, View3DState& view);
     void RenderShaderEditor(View3DState& state, bool& open);
 
     // called every frame.
     void Startup(State& state);
     void Update(State& state);
+    // stops the background jobs, before the state is destroyed.
+    void Shutdown(State& state);
 }
\ No newline at end of file
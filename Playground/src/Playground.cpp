@@ -5,11 +5,17 @@
 #include <GLFW/glfw3.h>
 #include <TextEditor.h>
 
-// surface with wireframes shaders
+#include <math.h>
+
+#include <algorithm>
+
+// surface with wireframes shaders, coloured by the per-vertex scalars when useScalars is set.
 static const char* wires_fs = R"V0G0N(#version 330 core
 out vec4 FragColor;
 in vec3 dist;
+in float faceScalar;
 uniform vec3 objectColor;
+uniform int useScalars;
 
 const float lineWidth = 0.5;
 
@@ -20,17 +26,30 @@ float edgeFactor()
     return min(min(f.x, f.y), f.z);
 }
 
+// diverging blue - white - red map.
+vec3 colorMap(float t)
+{
+    const vec3 low = vec3(0.23, 0.30, 0.75);
+    const vec3 middle = vec3(0.87, 0.87, 0.87);
+    const vec3 high = vec3(0.71, 0.02, 0.15);
+    return t < 0.5 ? mix(low, middle, t * 2.0) : mix(middle, high, t * 2.0 - 1.0);
+}
+
 void main()
 {
-    gl_FragColor = vec4(min(vec3(edgeFactor()), objectColor), 1.0);
+    vec3 color = useScalars != 0 ? colorMap(faceScalar) : objectColor;
+    gl_FragColor = vec4(min(vec3(edgeFactor()), color), 1.0);
 }
 )V0G0N";
 
 static const char* wires_vs = R"V0G0N(#version 330 core
-in vec4 position;
+layout(location = 0) in vec4 position;
+layout(location = 2) in float scalar;
+out float vertexScalar;
 void main()
 {
     gl_Position = position;
+    vertexScalar = scalar;
 }
 )V0G0N";
 
@@ -39,7 +58,9 @@ layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
 uniform mat4 view;
 uniform mat4 projection;
+in float vertexScalar[];
 out vec3 dist;
+out float faceScalar;
 
 void main()
 {
@@ -49,14 +70,17 @@ void main()
     vec4 p2 = mvp * gl_in[2].gl_Position;
 
     dist = vec3(1, 0, 0);
+    faceScalar = vertexScalar[0];
     gl_Position = p0;
     EmitVertex();
 
     dist = vec3(0, 1, 0);
+    faceScalar = vertexScalar[1];
     gl_Position = p1;
     EmitVertex();
 
     dist = vec3(0, 0, 1);
+    faceScalar = vertexScalar[2];
     gl_Position = p2;
     EmitVertex();
 
@@ -64,7 +88,31 @@ void main()
 }
 )V0G0N";
 
+// plain lines shaders
+static const char* lines_fs = R"V0G0N(#version 330 core
+out vec4 FragColor;
+uniform vec3 objectColor;
+
+void main()
+{
+    FragColor = vec4(objectColor, 1.0);
+}
+)V0G0N";
+
+static const char* lines_vs = R"V0G0N(#version 330 core
+layout(location = 0) in vec3 position;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * vec4(position, 1.0);
+}
+)V0G0N";
+
 static const ImVec4 BLUE(41 / 255., 74 / 255., 122 / 255., 1);
+static const ImVec4 GREEN(0, 1, 0, 1);
+static const ImVec4 RED(1, 0, 0, 1);
 
 namespace Resha
 {
@@ -75,26 +123,82 @@ namespace Resha
         std::string log;
         result.program = CreateProgram(wires_gs, wires_vs, wires_fs, log);
         assert(result.program.valid);
+        result.linesProgram = CreateProgram(nullptr, lines_vs, lines_fs, log);
+        assert(result.linesProgram.valid);
         return result;
     }
 
+    // fits the tight box of the corners of the meshes oriented boxes.
     void FitView3D(View3DState& view)
     {
-        BBox b;
+        std::vector<Vec3d> corners;
         for (const MeshRenderInfo& info : view.surfacesRenderInfo)
         {
-            b = Merge(b, info.box);
+            if (IsOBBValid(info.orientedBox))
+            {
+                Vec3d boxCorners[8];
+                CalculateOBBCorners(info.orientedBox, boxCorners);
+                corners.insert(corners.end(), boxCorners, boxCorners + 8);
+            }
         }
-        if (IsBBoxValid(b))
+        const OBB box = CalculateOrientedBoundingBox(corners, true);
+        if (IsOBBValid(box))
         {
-            CameraFitBBox(view.camera, b);
+            CameraFitOBB(view.camera, box);
             view.redraw = true;
         }
     }
 
-    void RenderView3D(ImVec2 area, const std::vector<SurfaceMesh>& meshes, View3DState& view)
+    void StartMeshLods(View3DState::PendingLods& pending, SurfaceMeshF mesh)
     {
+        pending.id = mesh.id;
+        pending.cancel->store(false);
+        pending.lods = std::async(std::launch::async, [source = std::move(mesh), cancel = pending.cancel]()
+        {
+            return GenerateMeshLods(WidenMesh(source), 6, 1024, cancel.get());
+        });
+    }
+
+    void UploadReadyLods(View3DState& view)
+    {
+        for (size_t i = 0; i < view.pendingLods.size();)
+        {
+            View3DState::PendingLods& pending = view.pendingLods[i];
+            if (pending.lods.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+            const std::vector<MeshLod> lods = pending.lods.get();
+            if (pending.next)
+            {
+                StartMeshLods(pending, std::move(*pending.next));
+                pending.next.reset();
+                i++;
+                continue;
+            }
+            for (MeshRenderInfo& info : view.surfacesRenderInfo)
+            {
+                if (info.id == pending.id && !pending.cancel->load())
+                {
+                    for (const MeshLod& lod : lods)
+                    {
+                        AddSurfaceMeshRenderLod(info, lod);
+                    }
+                    view.redraw = true;
+                }
+            }
+            view.pendingLods.erase(view.pendingLods.begin() + i);
+        }
+    }
+
+    void RenderView3D(ImVec2 area, const std::vector<SurfaceMeshF>& meshes, View3DState& view)
+    {
+        UploadReadyLods(view);
+
         ImGui::BeginChild("3D View", area);
+        // the view image starts at the top left corner of the child.
+        const ImVec2 imageOrigin = ImGui::GetCursorScreenPos();
         if (ImGui::IsWindowFocused())
         {
             ImGuiIO& io = ImGui::GetIO();
@@ -145,6 +249,13 @@ namespace Resha
                 }
             }
 
+            // pick a point on the surfaces.
+            if (ImGui::IsMouseClicked(0) && io.KeyCtrl && !io.KeyShift)
+            {
+                view.pickRequested = true;
+                view.pickPixel = Vec2d{ io.MousePos.x - imageOrigin.x, io.MousePos.y - imageOrigin.y };
+            }
+
             // reset best fit zoom.
             if (ImGui::IsKeyPressed(GLFW_KEY_R))
             {
@@ -185,9 +296,17 @@ namespace Resha
             SetProgramUniformV3f(view.program, "lightColor", lighColour.data);
 
 
+            // the meshes whose oriented box is outside the view are skipped, and the meshlets of
+            // the others at full resolution.
+            const Frustum frustum = CameraGetFrustum(view.camera, view.width, view.height);
+            const Vec3d eye = CameraGetPosition(view.camera);
             for (const MeshRenderInfo& info : view.surfacesRenderInfo)
             {
-                for (const SurfaceMesh& mesh : meshes)
+                if (IsOBBValid(info.orientedBox) && !IsOBBInFrustum(frustum, info.orientedBox))
+                {
+                    continue;
+                }
+                for (const SurfaceMeshF& mesh : meshes)
                 {
                     if (mesh.id == info.id && mesh.visible)
                     {
@@ -198,10 +317,55 @@ namespace Resha
                             mesh.color.b / 255.f
                         };
                         SetProgramUniformV3f(view.program, "objectColor", meshColor);
-                        RenderMesh(view.buffer, view.program, info);
+                        // the simplified levels have no scalars.
+                        const bool useScalars = info.scalarBufferId != 0;
+                        SetProgramUniform1i(view.program, "useScalars", useScalars);
+                        const size_t lod = useScalars ? 0 : SelectMeshLod(info, view.camera, view.height, view.lodPixelError);
+                        if (lod == 0 && !info.meshlets.empty())
+                        {
+                            RenderMeshlets(view.buffer, view.program, info, frustum, eye);
+                        }
+                        else
+                        {
+                            RenderMesh(view.buffer, view.program, info, lod);
+                        }
                     }
                 }
             }
+
+            if (!view.contoursRenderInfo.empty())
+            {
+                const float contoursColor[3]
+                {
+                    view.contoursColor.r / 255.f,
+                    view.contoursColor.g / 255.f,
+                    view.contoursColor.b / 255.f
+                };
+                SetProgramUniformM4x4f(view.linesProgram, "projection", projectionMatrixData);
+                SetProgramUniformM4x4f(view.linesProgram, "view", viewMatrixData);
+                SetProgramUniformV3f(view.linesProgram, "objectColor", contoursColor);
+                for (const LinesRenderInfo& info : view.contoursRenderInfo)
+                {
+                    RenderLines(view.buffer, view.linesProgram, info);
+                }
+            }
+
+            if (!view.interferencesRenderInfo.empty())
+            {
+                const float interferencesColor[3]
+                {
+                    view.interferencesColor.r / 255.f,
+                    view.interferencesColor.g / 255.f,
+                    view.interferencesColor.b / 255.f
+                };
+                SetProgramUniformM4x4f(view.linesProgram, "projection", projectionMatrixData);
+                SetProgramUniformM4x4f(view.linesProgram, "view", viewMatrixData);
+                SetProgramUniformV3f(view.linesProgram, "objectColor", interferencesColor);
+                for (const LinesRenderInfo& info : view.interferencesRenderInfo)
+                {
+                    RenderLines(view.buffer, view.linesProgram, info);
+                }
+            }
         }
         ImGui::Image((ImTextureID)(intptr_t)view.buffer.textureId, area);
         ImGui::EndChild();
@@ -329,21 +493,621 @@ namespace Resha
         ImGui::End();
     }
 
+    void ClearInterferences(State& state)
+    {
+        for (LinesRenderInfo& info : state.view3d.interferencesRenderInfo)
+        {
+            DestroyLinesRenderInfo(info);
+        }
+        state.view3d.interferencesRenderInfo.clear();
+        state.interferences.clear();
+        state.view3d.redraw = true;
+    }
+
+    // finds the intersecting faces between all the loaded surfaces and shows their contacts.
+    void CheckInterferences(State& state)
+    {
+        ClearInterferences(state);
+        state.interferences = FindInterferences(state.meshes);
+        for (const MeshesInterference& interference : state.interferences)
+        {
+            state.view3d.interferencesRenderInfo.push_back(CreateLinesRenderInfo(interference.segments));
+        }
+    }
+
+    // the levels of the surface with this id that are still being generated are thrown away.
+    void CancelMeshLods(const UUId& id, View3DState& view)
+    {
+        for (View3DState::PendingLods& pending : view.pendingLods)
+        {
+            if (pending.id == id)
+            {
+                pending.cancel->store(true);
+                pending.next.reset();
+            }
+        }
+    }
+
+    // the full resolution mesh is shown until the simplified levels are ready. previousId is the id
+    // the surface had before it changed, the job started for it is cancelled and this one waits for
+    // it to stop rather than running next to it.
+    void RequestMeshLods(SurfaceMeshF mesh, View3DState& view, const UUId& previousId)
+    {
+        for (View3DState::PendingLods& pending : view.pendingLods)
+        {
+            if (pending.id == previousId || pending.id == mesh.id)
+            {
+                pending.cancel->store(true);
+                pending.id = mesh.id;
+                pending.next = std::move(mesh);
+                return;
+            }
+        }
+        view.pendingLods.emplace_back();
+        StartMeshLods(view.pendingLods.back(), std::move(mesh));
+    }
+
+    // the job still running for the surface is kept aside until it is done rather than waited for.
+    void DropGeodesicsCache(const UUId& id, State& state)
+    {
+        for (size_t i = 0; i < state.geodesics.size(); ++i)
+        {
+            if (state.geodesics[i].id == id)
+            {
+                if (state.geodesics[i].distances.valid())
+                {
+                    state.droppedGeodesics.push_back(std::move(state.geodesics[i].distances));
+                }
+                state.geodesics.erase(state.geodesics.begin() + i);
+                break;
+            }
+        }
+    }
+
     // end object list functions.
+    void AddMesh(SurfaceMeshF mesh, State& state)
+    {
+        // the render info groups the faces in meshlets and orders each of them for rendering, the mesh
+        // is kept in that order.
+        MeshRenderInfo info = CreateSurfaceMeshRenderInfo(mesh);
+        const MeshValidation validation = ValidateMesh(mesh);
+        info.cullBackFacing = IsWatertight(validation) && validation.misorientedEdges.empty() && !validation.insideOut;
+        state.validations.push_back(validation);
+        state.massProperties.push_back(CalculateMassProperties(mesh));
+        state.meshes.push_back(mesh);
+        state.view3d.surfacesRenderInfo.push_back(std::move(info));
+        FitView3D(state.view3d);
+        state.view3d.redraw = true;
+        const UUId id = mesh.id;
+        RequestMeshLods(std::move(mesh), state.view3d, id);
+    }
+
     bool LoadMesh(const char* fileName, State& state)
     {
-        SurfaceMesh mesh;
+        // no spatial sort, the meshlets and their rendering order replace both orders anyway. the
+        // positions stay in float as stored in STL files.
+        SurfaceMeshF mesh;
         if (ReadMesh(fileName, mesh) == IOStatus::OK)
         {
-            state.meshes.push_back(mesh);
-            state.view3d.surfacesRenderInfo.push_back(CreateSurfaceMeshRenderInfo(mesh));
-            FitView3D(state.view3d);
-            state.view3d.redraw = true;
+            AddMesh(std::move(mesh), state);
             return true;
         }
         return false;
     }
 
+    void RemoveMesh(size_t index, State& state)
+    {
+        const UUId id = state.meshes[index].id;
+        CancelMeshLods(id, state.view3d);
+        std::vector<MeshRenderInfo>& infos = state.view3d.surfacesRenderInfo;
+        for (size_t i = 0; i < infos.size(); ++i)
+        {
+            if (infos[i].id == id)
+            {
+                DestroySurfaceMeshRenderInfo(infos[i]);
+                infos.erase(infos.begin() + i);
+                break;
+            }
+        }
+        DropGeodesicsCache(id, state);
+        for (size_t i = 0; i < state.voxels.size(); ++i)
+        {
+            if (state.voxels[i].id == id)
+            {
+                state.voxels.erase(state.voxels.begin() + i);
+                break;
+            }
+        }
+        state.validations.erase(state.validations.begin() + index);
+        state.massProperties.erase(state.massProperties.begin() + index);
+        state.meshes.erase(state.meshes.begin() + index);
+        state.view3d.redraw = true;
+    }
+
+    // replaces every visible surface by its connected components, dropping the small ones.
+    void SplitVisibleMeshes(State& state)
+    {
+        // the interferences refer to the meshes by index.
+        ClearInterferences(state);
+        std::vector<SurfaceMeshF> parts;
+        for (size_t i = 0; i < state.meshes.size();)
+        {
+            if (!state.meshes[i].visible)
+            {
+                i++;
+                continue;
+            }
+            const SurfaceMeshF& mesh = state.meshes[i];
+            const MeshComponents components = LabelMeshComponents(mesh);
+            if (components.facesCounts.size() == 1)
+            {
+                i++;
+                continue;
+            }
+            const SurfaceMeshF kept = RemoveSmallComponents(mesh, components, std::max(state.minComponentFacesCount, 0));
+            for (SurfaceMeshF& part : SplitMeshComponents(kept, LabelMeshComponents(kept)))
+            {
+                parts.push_back(std::move(part));
+            }
+            RemoveMesh(i, state);
+        }
+        for (SurfaceMeshF& part : parts)
+        {
+            AddMesh(std::move(part), state);
+        }
+    }
+
+    // slices the visible surfaces along Z with evenly spaced planes.
+    void SliceVisibleMeshes(State& state)
+    {
+        for (LinesRenderInfo& info : state.view3d.contoursRenderInfo)
+        {
+            DestroyLinesRenderInfo(info);
+        }
+        state.view3d.contoursRenderInfo.clear();
+        for (const SurfaceMeshF& mesh : state.meshes)
+        {
+            if (!mesh.visible)
+            {
+                continue;
+            }
+            const BBox box = CalculateBoundingBox(mesh);
+            const size_t layersCount = std::max(state.sliceLayersCount, 1);
+            std::vector<double> heights(layersCount);
+            for (size_t i = 0; i < layersCount; ++i)
+            {
+                heights[i] = box.min.z + (box.max.z - box.min.z) * (i + 0.5) / layersCount;
+            }
+            LinesRenderInfo info = CreateContoursRenderInfo(SliceMesh(mesh, Vec3d{ 0.0, 0.0, 1.0 }, heights));
+            info.id = mesh.id;
+            state.view3d.contoursRenderInfo.push_back(info);
+        }
+        state.view3d.redraw = true;
+    }
+
+    static const char* SUBDIVISION_SCHEMES[] = { "Loop", "Midpoint" };
+
+    // replaces every visible surface by its subdivision.
+    void SubdivideVisibleMeshes(State& state)
+    {
+        // the interferences refer to the meshes by index.
+        ClearInterferences(state);
+        const SubdivisionScheme scheme = state.subdivisionScheme == 0 ? SubdivisionScheme::LOOP : SubdivisionScheme::MIDPOINT;
+        std::vector<SurfaceMesh> subdivided;
+        for (size_t i = 0; i < state.meshes.size();)
+        {
+            if (!state.meshes[i].visible)
+            {
+                i++;
+                continue;
+            }
+            subdivided.push_back(SubdivideMesh(WidenMesh(state.meshes[i]), scheme, std::max(state.subdivisionLevels, 0)));
+            RemoveMesh(i, state);
+        }
+        for (const SurfaceMesh& mesh : subdivided)
+        {
+            AddMesh(NarrowMesh(mesh), state);
+        }
+    }
+
+    // adds the convex hull of every visible surface next to it.
+    void AddVisibleMeshesHulls(State& state)
+    {
+        std::vector<SurfaceMesh> hulls;
+        for (const SurfaceMeshF& mesh : state.meshes)
+        {
+            if (!mesh.visible)
+            {
+                continue;
+            }
+            std::vector<Vec3d> points(mesh.vertices.size());
+            for (size_t i = 0; i < points.size(); ++i)
+            {
+                points[i] = Vec3d{ mesh.vertices[i].x, mesh.vertices[i].y, mesh.vertices[i].z };
+            }
+            SurfaceMesh hull = CalculateConvexHull(points);
+            if (!hull.faces.empty())
+            {
+                hull.name = mesh.name + "_hull";
+                hulls.push_back(std::move(hull));
+            }
+        }
+        for (const SurfaceMesh& hull : hulls)
+        {
+            AddMesh(NarrowMesh(hull), state);
+        }
+    }
+
+    // voxelises every visible surface, replacing its previous voxels.
+    void VoxeliseVisibleMeshes(State& state)
+    {
+        state.voxels.clear();
+        for (const SurfaceMeshF& mesh : state.meshes)
+        {
+            if (!mesh.visible)
+            {
+                continue;
+            }
+            VoxelsCache cache;
+            cache.id = mesh.id;
+            cache.name = mesh.name;
+            cache.grid = VoxeliseMesh(mesh, uint32_t(std::max(state.voxelResolution, 1)));
+            cache.voxelsCount = CountSetVoxels(cache.grid);
+            state.voxels.push_back(std::move(cache));
+        }
+    }
+
+    // adds the marching cubes surface of every voxelised mesh.
+    void AddVoxelsSurfaces(State& state)
+    {
+        std::vector<SurfaceMesh> surfaces;
+        for (const VoxelsCache& cache : state.voxels)
+        {
+            SurfaceMesh surface = ExtractIsosurface(cache.grid);
+            if (!surface.faces.empty())
+            {
+                surface.name = cache.name + "_voxels";
+                surfaces.push_back(std::move(surface));
+            }
+        }
+        for (const SurfaceMesh& surface : surfaces)
+        {
+            AddMesh(NarrowMesh(surface), state);
+        }
+    }
+
+    static const char* SMOOTHING_METHODS[] = { "Taubin", "HC Laplacian" };
+
+    // moved is state.meshes[m] widened and moved with its faces unchanged, it replaces the surface
+    // under a new id. the caches and the simplified levels still being generated for the old one are
+    // dropped with it.
+    void UpdateMovedMesh(State& state, size_t m, const SurfaceMesh& moved, const std::vector<Vec3d>& normals)
+    {
+        SurfaceMeshF& mesh = state.meshes[m];
+        const UUId oldId = mesh.id;
+        mesh = NarrowMesh(moved);
+        mesh.id = GenerateUUID();
+        for (MeshRenderInfo& info : state.view3d.surfacesRenderInfo)
+        {
+            if (info.id == oldId)
+            {
+                info.id = mesh.id;
+                ClearSurfaceMeshScalars(info);
+                UpdateSurfaceMeshRenderInfo(info, moved, normals);
+            }
+        }
+        DropGeodesicsCache(oldId, state);
+        state.validations[m] = ValidateMesh(moved);
+        state.massProperties[m] = CalculateMassProperties(moved);
+        RequestMeshLods(mesh, state.view3d, oldId);
+    }
+
+    void SmoothVisibleMeshes(State& state)
+    {
+        ClearInterferences(state);
+        SmoothingOptions options;
+        options.method = state.smoothingMethod == 0 ? SmoothingMethod::TAUBIN : SmoothingMethod::HC_LAPLACIAN;
+        options.iterations = std::max(state.smoothingIterations, 0);
+        for (size_t m = 0; m < state.meshes.size(); ++m)
+        {
+            if (!state.meshes[m].visible)
+            {
+                continue;
+            }
+            SurfaceMesh mesh = WidenMesh(state.meshes[m]);
+            const VertexRings rings = BuildVertexRings(mesh);
+            SmoothMesh(mesh, rings, options);
+            UpdateMovedMesh(state, m, mesh, CalculateVertexNormals(mesh, rings));
+        }
+        state.view3d.redraw = true;
+    }
+
+    // the positive scale keeps the faces as they are, so the render infos only need the new vertices.
+    void TransformVisibleMeshes(State& state)
+    {
+        ClearInterferences(state);
+        const Vec3d axis{ state.transformAxis[0], state.transformAxis[1], state.transformAxis[2] };
+        Mat4 transform = Translate(Identity(), Vec3d{ state.transformTranslation[0], state.transformTranslation[1],
+                                                      state.transformTranslation[2] });
+        if (Length(axis) > 0.0)
+        {
+            transform = Rotate(transform, Deg2Rad(state.transformAngle), axis);
+        }
+        Mat4 scale = Identity();
+        for (int i = 0; i < 3; ++i)
+        {
+            scale.elements[i][i] = state.transformScale > 0.0f ? state.transformScale : 1.0;
+        }
+        transform = transform * scale;
+        for (size_t m = 0; m < state.meshes.size(); ++m)
+        {
+            if (!state.meshes[m].visible)
+            {
+                continue;
+            }
+            SurfaceMesh mesh = WidenMesh(state.meshes[m]);
+            const VertexRings rings = BuildVertexRings(mesh);
+            std::vector<Vec3d> normals = CalculateVertexNormals(mesh, rings);
+            TransformMesh(mesh, transform);
+            TransformNormals(normals, transform);
+            UpdateMovedMesh(state, m, mesh, normals);
+        }
+        state.view3d.redraw = true;
+    }
+
+    static const char* SCALAR_FIELDS[] =
+    {
+        "None", "Mean curvature", "Gaussian curvature", "Min principal curvature", "Max principal curvature"
+    };
+
+    // range symmetric around 0 that leaves out the 2% largest magnitudes, so a few spikes don't wash out the map.
+    double CalculateSymmetricRange(const std::vector<double>& values)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::vector<double> magnitudes(values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            magnitudes[i] = fabs(values[i]);
+        }
+        const auto percentile = magnitudes.begin() + (magnitudes.size() - 1) * 98 / 100;
+        std::nth_element(magnitudes.begin(), percentile, magnitudes.end());
+        return *percentile;
+    }
+
+    void ColourVisibleMeshes(State& state)
+    {
+        for (const SurfaceMeshF& mesh : state.meshes)
+        {
+            if (!mesh.visible)
+            {
+                continue;
+            }
+            for (MeshRenderInfo& info : state.view3d.surfacesRenderInfo)
+            {
+                if (!(info.id == mesh.id))
+                {
+                    continue;
+                }
+                if (state.scalarField == 0)
+                {
+                    ClearSurfaceMeshScalars(info);
+                    continue;
+                }
+                const VertexCurvatures curvatures = CalculateCurvatures(mesh, BuildVertexRings(mesh));
+                const std::vector<double>* fields[] =
+                {
+                    &curvatures.mean, &curvatures.gaussian, &curvatures.minPrincipal, &curvatures.maxPrincipal
+                };
+                const std::vector<double>& values = *fields[state.scalarField - 1];
+                const double range = CalculateSymmetricRange(values);
+                SetSurfaceMeshScalars(info, values, -range, range);
+            }
+        }
+        state.view3d.redraw = true;
+    }
+
+    GeodesicsCache& GetGeodesicsCache(const SurfaceMeshF& mesh, State& state)
+    {
+        for (GeodesicsCache& cache : state.geodesics)
+        {
+            if (cache.id == mesh.id)
+            {
+                return cache;
+            }
+        }
+        // the operators are only prepared once a seed lands on the surface.
+        state.geodesics.emplace_back();
+        state.geodesics.back().id = mesh.id;
+        state.geodesics.back().bvh = BuildMeshBVH(mesh);
+        return state.geodesics.back();
+    }
+
+    // the first job of a surface prepares its operators, the factorisation or the conjugate gradient
+    // of a large surface would stall the view for seconds.
+    void StartGeodesicDistances(const SurfaceMeshF& mesh, GeodesicsCache& cache)
+    {
+        cache.distances = std::async(std::launch::async, [source = mesh, heat = cache.heat, seeds = cache.seeds]()
+        {
+            const SurfaceMesh wide = WidenMesh(source);
+            GeodesicsCache::Distances result;
+            result.heat = heat ? heat : std::make_shared<const HeatGeodesics>(PrepareHeatGeodesics(wide));
+            result.seeds = seeds;
+            result.values = CalculateGeodesicDistances(wide, *result.heat, seeds);
+            return result;
+        });
+    }
+
+    // colours the surfaces by the distance to their seeds, the parts without seeds get the far colour.
+    // the distances to seeds that changed while they were measured are measured again.
+    void ShowReadyGeodesicDistances(State& state)
+    {
+        for (GeodesicsCache& cache : state.geodesics)
+        {
+            if (!cache.distances.valid() ||
+                cache.distances.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                continue;
+            }
+            const GeodesicsCache::Distances distances = cache.distances.get();
+            cache.heat = distances.heat;
+            if (cache.seeds.empty())
+            {
+                continue;
+            }
+            if (distances.seeds != cache.seeds)
+            {
+                for (const SurfaceMeshF& mesh : state.meshes)
+                {
+                    if (mesh.id == cache.id)
+                    {
+                        StartGeodesicDistances(mesh, cache);
+                    }
+                }
+                continue;
+            }
+            double maxDistance = 0.0;
+            for (double d : distances.values)
+            {
+                if (d != DBL_MAX)
+                {
+                    maxDistance = std::max(maxDistance, d);
+                }
+            }
+            for (MeshRenderInfo& info : state.view3d.surfacesRenderInfo)
+            {
+                if (info.id == cache.id)
+                {
+                    SetSurfaceMeshScalars(info, distances.values, 0.0, maxDistance);
+                }
+            }
+            state.view3d.redraw = true;
+        }
+        for (size_t i = 0; i < state.droppedGeodesics.size();)
+        {
+            if (state.droppedGeodesics[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                state.droppedGeodesics.erase(state.droppedGeodesics.begin() + i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    // adds the vertex closest to the picked point of the nearest visible surface to its seeds.
+    void PickGeodesicSeed(State& state)
+    {
+        View3DState& view = state.view3d;
+        view.pickRequested = false;
+        Vec3d origin, direction;
+        CameraGetRay(view.camera, view.width, view.height, view.pickPixel, origin, direction);
+        // the rays are cast on the surfaces with their cached BVHs, the closest hit is kept.
+        RayHit closestHit;
+        size_t closestMesh = SIZE_MAX;
+        for (size_t m = 0; m < state.meshes.size(); ++m)
+        {
+            const SurfaceMeshF& candidate = state.meshes[m];
+            if (!candidate.visible)
+            {
+                continue;
+            }
+            const RayHit hit = IntersectRay(candidate, GetGeodesicsCache(candidate, state).bvh, origin, direction);
+            if (hit.distance < closestHit.distance)
+            {
+                closestHit = hit;
+                closestMesh = m;
+            }
+        }
+        if (closestMesh == SIZE_MAX)
+        {
+            return;
+        }
+        const SurfaceMeshF& mesh = state.meshes[closestMesh];
+        GeodesicsCache& cache = GetGeodesicsCache(mesh, state);
+        uint32_t seed = UINT32_MAX;
+        double seedDistance = DBL_MAX;
+        for (uint32_t v : mesh.faces[closestHit.face].idx)
+        {
+            const Vec3f& p = mesh.vertices[v];
+            const double d = Length(Vec3d{ p.x, p.y, p.z } - closestHit.point);
+            if (d < seedDistance)
+            {
+                seedDistance = d;
+                seed = v;
+            }
+        }
+        cache.seeds.push_back(seed);
+        if (!cache.distances.valid())
+        {
+            StartGeodesicDistances(state.meshes[closestMesh], cache);
+        }
+    }
+
+    void ClearGeodesicSeeds(State& state)
+    {
+        for (GeodesicsCache& cache : state.geodesics)
+        {
+            if (cache.seeds.empty())
+            {
+                continue;
+            }
+            cache.seeds.clear();
+            for (MeshRenderInfo& info : state.view3d.surfacesRenderInfo)
+            {
+                if (info.id == cache.id)
+                {
+                    ClearSurfaceMeshScalars(info);
+                }
+            }
+        }
+        state.view3d.redraw = true;
+    }
+
+    void DrawMeshValidation(const MeshValidation& validation)
+    {
+        if (IsValid(validation))
+        {
+            ImGui::TextColored(GREEN, "Valid");
+            return;
+        }
+        const struct
+        {
+            const char* name;
+            size_t count;
+        } defects[]
+        {
+            { "Boundary edges", validation.boundaryEdges.size() },
+            { "Non-manifold edges", validation.nonManifoldEdges.size() },
+            { "Misoriented edges", validation.misorientedEdges.size() },
+            { "Degenerate faces", validation.degenerateFaces.size() },
+            { "Duplicate faces", validation.duplicateFaces.size() },
+        };
+        for (const auto& defect : defects)
+        {
+            if (defect.count > 0)
+            {
+                ImGui::TextColored(RED, "%s: %zu", defect.name, defect.count);
+            }
+        }
+        if (validation.insideOut)
+        {
+            ImGui::TextColored(RED, "Inside out");
+        }
+    }
+
+    void DrawMassProperties(const MassProperties& properties, const MeshValidation& validation)
+    {
+        ImGui::Text("Area %.6g", properties.area);
+        // an open surface doesn't bound a volume.
+        if (IsWatertight(validation))
+        {
+            ImGui::Text("Volume %.6g", properties.volume);
+            ImGui::Text("Centroid %.4g %.4g %.4g", properties.centroid.x, properties.centroid.y, properties.centroid.z);
+        }
+    }
+
     void DrawDocumentsBoard(State& state)
     {
         const ImVec2 minPoint = ImGui::GetWindowContentRegionMin();
@@ -354,8 +1118,9 @@ namespace Resha
         ImGui::BeginChild("Tools and Lists", ImVec2(width * 0.2, height));
         {
             ImGui::TextColored(BLUE, "Surfaces");
-            for (SurfaceMesh& mesh : state.meshes)
+            for (size_t m = 0; m < state.meshes.size(); ++m)
             {
+                SurfaceMeshF& mesh = state.meshes[m];
                 ImGui::Spacing();
                 if (ImGui::Checkbox(mesh.name.c_str(), &mesh.visible))
                 {
@@ -374,12 +1139,148 @@ namespace Resha
                     state.view3d.redraw = true;
                 }
                 ImGui::PopID();
+                for (const MeshRenderInfo& info : state.view3d.surfacesRenderInfo)
+                {
+                    if (info.id == mesh.id)
+                    {
+                        ImGui::Text("ACMR %.3f ATVR %.3f", info.cacheStatistics.acmr, info.cacheStatistics.atvr);
+                    }
+                }
+                DrawMeshValidation(state.validations[m]);
+                DrawMassProperties(state.massProperties[m], state.validations[m]);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Slicing");
+            ImGui::InputInt("Layers", &state.sliceLayersCount);
+            if (ImGui::Button("Slice"))
+            {
+                SliceVisibleMeshes(state);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear"))
+            {
+                for (LinesRenderInfo& info : state.view3d.contoursRenderInfo)
+                {
+                    DestroyLinesRenderInfo(info);
+                }
+                state.view3d.contoursRenderInfo.clear();
+                state.view3d.redraw = true;
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Smoothing");
+            ImGui::Combo("Method", &state.smoothingMethod, SMOOTHING_METHODS, IM_ARRAYSIZE(SMOOTHING_METHODS));
+            ImGui::InputInt("Iterations", &state.smoothingIterations);
+            if (ImGui::Button("Smooth"))
+            {
+                SmoothVisibleMeshes(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Transform");
+            ImGui::InputFloat("Scale", &state.transformScale);
+            ImGui::InputFloat3("Axis", state.transformAxis);
+            ImGui::InputFloat("Angle", &state.transformAngle);
+            ImGui::InputFloat3("Translation", state.transformTranslation);
+            if (ImGui::Button("Transform"))
+            {
+                TransformVisibleMeshes(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Subdivision");
+            ImGui::Combo("Scheme", &state.subdivisionScheme, SUBDIVISION_SCHEMES, IM_ARRAYSIZE(SUBDIVISION_SCHEMES));
+            ImGui::InputInt("Levels", &state.subdivisionLevels);
+            if (ImGui::Button("Subdivide"))
+            {
+                SubdivideVisibleMeshes(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Voxels");
+            ImGui::InputInt("Resolution", &state.voxelResolution);
+            if (ImGui::Button("Voxelise"))
+            {
+                VoxeliseVisibleMeshes(state);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Add surfaces"))
+            {
+                AddVoxelsSurfaces(state);
+            }
+            for (const VoxelsCache& cache : state.voxels)
+            {
+                const double size = cache.grid.voxelSize;
+                ImGui::Text("%s: %zu voxels, volume %.6g", cache.name.c_str(), cache.voxelsCount,
+                            cache.voxelsCount * size * size * size);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Convex hull");
+            if (ImGui::Button("Add hulls"))
+            {
+                AddVisibleMeshesHulls(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Colouring");
+            ImGui::Combo("Field", &state.scalarField, SCALAR_FIELDS, IM_ARRAYSIZE(SCALAR_FIELDS));
+            if (ImGui::Button("Apply"))
+            {
+                ColourVisibleMeshes(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Components");
+            ImGui::InputInt("Min faces", &state.minComponentFacesCount);
+            if (ImGui::Button("Split"))
+            {
+                SplitVisibleMeshes(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Geodesics");
+            ImGui::Text("Ctrl + click a surface to add a seed");
+            for (const GeodesicsCache& cache : state.geodesics)
+            {
+                if (cache.distances.valid())
+                {
+                    ImGui::Text("Measuring distances...");
+                    break;
+                }
+            }
+            if (ImGui::Button("Clear seeds"))
+            {
+                ClearGeodesicSeeds(state);
+            }
+
+            ImGui::Spacing();
+            ImGui::TextColored(BLUE, "Interferences");
+            if (ImGui::Button("Check"))
+            {
+                CheckInterferences(state);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear##Interferences"))
+            {
+                ClearInterferences(state);
+            }
+            for (const MeshesInterference& interference : state.interferences)
+            {
+                ImGui::Text("%s / %s: %zu faces", state.meshes[interference.meshA].name.c_str(),
+                            state.meshes[interference.meshB].name.c_str(), interference.faces.size());
             }
         }
         ImGui::Text("Application average: %.1f FPS", ImGui::GetIO().Framerate);
         ImGui::EndChild();
         ImGui::SameLine();
         RenderView3D(ImVec2(width * 0.8, height), state.meshes, state.view3d);
+        if (state.view3d.pickRequested)
+        {
+            PickGeodesicSeed(state);
+        }
+        ShowReadyGeodesicDistances(state);
     }
 
     void Startup(State& state)
@@ -388,6 +1289,19 @@ namespace Resha
         LoadMesh("d:/bunny.stl", state);
     }
 
+    void Shutdown(State& state)
+    {
+        for (View3DState::PendingLods& pending : state.view3d.pendingLods)
+        {
+            pending.cancel->store(true);
+            pending.next.reset();
+        }
+        state.view3d.pendingLods.clear();
+        // the geodesics jobs can't be stopped, they are waited for.
+        state.geodesics.clear();
+        state.droppedGeodesics.clear();
+    }
+
     void Update(State& state)
     {
         ImGuiStyle& style = ImGui::GetStyle();
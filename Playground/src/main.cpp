@@ -84,6 +84,7 @@ int main(int argc, char** argv)
     }
 
     // Cleanup
+    Resha::Shutdown(state);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();